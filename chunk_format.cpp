@@ -0,0 +1,385 @@
+#include "chunk_format.hpp"
+
+#include <algorithm> // For std::min, std::max
+#include <cerrno>   // For errno
+#include <chrono>   // For timing compression
+#include <cstring>  // For std::memcpy, std::strerror
+#include <fcntl.h>  // For open
+#include <unistd.h> // For pread, pwrite, close
+#ifdef VFIG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef VFIG_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef VFIG_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "shm_ring.hpp" // For shmRingNowNs()
+
+namespace
+{
+
+size_t compressBoundFor(uint32_t codec, size_t size)
+{
+    switch (codec)
+    {
+#ifdef VFIG_HAVE_ZLIB
+    case CHUNK_CODEC_ZLIB: return compressBound(static_cast<uLong>(size));
+#endif
+#ifdef VFIG_HAVE_LZ4
+    case CHUNK_CODEC_LZ4: return static_cast<size_t>(LZ4_compressBound(static_cast<int>(size)));
+#endif
+#ifdef VFIG_HAVE_ZSTD
+    case CHUNK_CODEC_ZSTD: return ZSTD_compressBound(size);
+#endif
+    default: return size;
+    }
+}
+
+/**
+ * @brief Compresses one block. Returns 0 if the codec failed or the block did not shrink.
+ */
+size_t compressBlock(uint32_t codec, int level, const uint8_t *src, size_t size, uint8_t *dst, size_t capacity)
+{
+    size_t out = 0;
+    switch (codec)
+    {
+#ifdef VFIG_HAVE_ZLIB
+    case CHUNK_CODEC_ZLIB:
+    {
+        uLongf length = static_cast<uLongf>(capacity);
+        if (compress2(dst, &length, src, static_cast<uLong>(size), std::min(level, 9)) == Z_OK)
+        {
+            out = length;
+        }
+        break;
+    }
+#endif
+#ifdef VFIG_HAVE_LZ4
+    case CHUNK_CODEC_LZ4:
+        out = static_cast<size_t>(std::max(0, LZ4_compress_fast(reinterpret_cast<const char *>(src), reinterpret_cast<char *>(dst),
+                                                                static_cast<int>(size), static_cast<int>(capacity), level)));
+        break;
+#endif
+#ifdef VFIG_HAVE_ZSTD
+    case CHUNK_CODEC_ZSTD:
+    {
+        size_t length = ZSTD_compress(dst, capacity, src, size, std::min(level, ZSTD_maxCLevel()));
+        out = ZSTD_isError(length) ? 0 : length;
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+    return out < size ? out : 0;
+}
+
+bool decompressBlock(uint32_t codec, const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size)
+{
+    switch (codec)
+    {
+    case CHUNK_CODEC_NONE:
+        if (size != raw_size) return false;
+        std::memcpy(dst, src, size);
+        return true;
+#ifdef VFIG_HAVE_ZLIB
+    case CHUNK_CODEC_ZLIB:
+    {
+        uLongf length = static_cast<uLongf>(raw_size);
+        return uncompress(dst, &length, src, static_cast<uLong>(size)) == Z_OK && length == raw_size;
+    }
+#endif
+#ifdef VFIG_HAVE_LZ4
+    case CHUNK_CODEC_LZ4:
+        return LZ4_decompress_safe(reinterpret_cast<const char *>(src), reinterpret_cast<char *>(dst),
+                                   static_cast<int>(size), static_cast<int>(raw_size)) == static_cast<int>(raw_size);
+#endif
+#ifdef VFIG_HAVE_ZSTD
+    case CHUNK_CODEC_ZSTD:
+        return ZSTD_decompress(dst, raw_size, src, size) == raw_size;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool readFullyAt(int fd, void *data, size_t size, uint64_t offset)
+{
+    uint8_t *p = static_cast<uint8_t *>(data);
+    while (size > 0)
+    {
+        ssize_t n = ::pread(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+bool writeFullyAt(int fd, const void *data, size_t size, uint64_t offset)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (size > 0)
+    {
+        ssize_t n = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool chunkCodecFromName(const std::string &name, uint32_t &codec)
+{
+    if (name == "none") codec = CHUNK_CODEC_NONE;
+#ifdef VFIG_HAVE_ZLIB
+    else if (name == "zlib") codec = CHUNK_CODEC_ZLIB;
+#endif
+#ifdef VFIG_HAVE_LZ4
+    else if (name == "lz4") codec = CHUNK_CODEC_LZ4;
+#endif
+#ifdef VFIG_HAVE_ZSTD
+    else if (name == "zstd") codec = CHUNK_CODEC_ZSTD;
+#endif
+    else return false;
+    return true;
+}
+
+std::string chunkCodecName(uint32_t codec)
+{
+    switch (codec)
+    {
+    case CHUNK_CODEC_NONE: return "none";
+    case CHUNK_CODEC_ZLIB: return "zlib";
+    case CHUNK_CODEC_LZ4: return "lz4";
+    case CHUNK_CODEC_ZSTD: return "zstd";
+    default: return "?";
+    }
+}
+
+ChunkWriter::~ChunkWriter()
+{
+    std::string ignored;
+    close(ignored);
+}
+
+bool ChunkWriter::open(const std::string &path, uint32_t codec, int level, uint32_t block_bytes, std::string &error)
+{
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        error = "open(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+    codec_ = codec;
+    level_ = level;
+    block_bytes_ = block_bytes;
+    ChunkFileHeader header = {CHUNK_FILE_MAGIC, 1, codec, block_bytes};
+    offset_ = sizeof(header);
+    if (!writeFullyAt(fd_, &header, sizeof(header), 0))
+    {
+        error = "error de escritura: " + std::string(std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+long long ChunkWriter::append(const cv::Mat &frame, int64_t index, std::string &error)
+{
+    if (fd_ < 0)
+    {
+        error = "archivo cerrado";
+        return -1;
+    }
+    cv::Mat pixels = frame.isContinuous() ? frame : frame.clone();
+    const uint8_t *data = pixels.data;
+    size_t size = pixels.total() * pixels.elemSize();
+    uint32_t block_count = static_cast<uint32_t>((size + block_bytes_ - 1) / block_bytes_);
+
+    // Compress every block of the frame into one buffer owned by this thread, so the frame
+    // is written with a single pwrite().
+    thread_local std::vector<uint8_t> packed;
+    thread_local std::vector<ChunkBlockEntry> entries;
+    packed.resize(static_cast<size_t>(block_count) * compressBoundFor(codec_, block_bytes_));
+    entries.assign(block_count, ChunkBlockEntry{});
+    size_t packed_size = 0;
+    long long raw_blocks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+        size_t raw = std::min<size_t>(block_bytes_, size - static_cast<size_t>(b) * block_bytes_);
+        const uint8_t *src = data + static_cast<size_t>(b) * block_bytes_;
+        size_t stored = compressBlock(codec_, level_, src, raw, packed.data() + packed_size, packed.size() - packed_size);
+        entries[b].codec = stored > 0 ? codec_ : CHUNK_CODEC_NONE;
+        if (stored == 0)
+        {
+            std::memcpy(packed.data() + packed_size, src, raw); // Incompressible: store as is.
+            stored = raw;
+            raw_blocks++;
+        }
+        entries[b].offset = packed_size; // Relative until the frame's position is known.
+        entries[b].stored_bytes = static_cast<uint32_t>(stored);
+        entries[b].raw_bytes = static_cast<uint32_t>(raw);
+        packed_size += stored;
+    }
+    compress_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    // Reserve the file range; the write itself happens outside the lock so several frames can
+    // be written at once.
+    uint64_t offset;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        offset = offset_;
+        offset_ += packed_size;
+    }
+    if (!writeFullyAt(fd_, packed.data(), packed_size, offset))
+    {
+        // The frame never enters the index, so readers skip its range instead of decoding it.
+        error = "error de escritura: " + std::string(std::strerror(errno));
+        return -1;
+    }
+    // Only frames whose bytes are on disk are recorded in the index.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ChunkFrameEntry entry = {};
+        entry.index = index;
+        entry.timestamp_ns = shmRingNowNs();
+        entry.width = static_cast<uint32_t>(pixels.cols);
+        entry.height = static_cast<uint32_t>(pixels.rows);
+        entry.type = static_cast<uint32_t>(pixels.type());
+        entry.block_count = block_count;
+        entry.first_block = block_index_.size();
+        frame_index_.push_back(entry);
+        for (ChunkBlockEntry block : entries)
+        {
+            block.offset += offset;
+            block_index_.push_back(block);
+        }
+    }
+    frames_++;
+    blocks_ += block_count;
+    blocks_raw_ += raw_blocks;
+    raw_bytes_ += static_cast<long long>(size);
+    stored_bytes_ += static_cast<long long>(packed_size);
+    return static_cast<long long>(packed_size);
+}
+
+bool ChunkWriter::close(std::string &error)
+{
+    if (fd_ < 0)
+    {
+        return true;
+    }
+    ChunkFileFooter footer = {};
+    footer.frames_offset = offset_;
+    footer.frame_count = frame_index_.size();
+    footer.blocks_offset = offset_ + frame_index_.size() * sizeof(ChunkFrameEntry);
+    footer.block_count = block_index_.size();
+    footer.magic = CHUNK_INDEX_MAGIC;
+    bool ok = writeFullyAt(fd_, frame_index_.data(), frame_index_.size() * sizeof(ChunkFrameEntry), footer.frames_offset) &&
+              writeFullyAt(fd_, block_index_.data(), block_index_.size() * sizeof(ChunkBlockEntry), footer.blocks_offset) &&
+              writeFullyAt(fd_, &footer, sizeof(footer), footer.blocks_offset + block_index_.size() * sizeof(ChunkBlockEntry));
+    if (!ok)
+    {
+        error = "error al escribir el índice: " + std::string(std::strerror(errno));
+    }
+    ::close(fd_);
+    fd_ = -1;
+    return ok;
+}
+
+ChunkReader::~ChunkReader()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool ChunkReader::open(const std::string &path, std::string &error)
+{
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    off_t size = fd_ >= 0 ? ::lseek(fd_, 0, SEEK_END) : -1;
+    ChunkFileFooter footer = {};
+    if (size < static_cast<off_t>(sizeof(header_) + sizeof(footer)) || !readFullyAt(fd_, &header_, sizeof(header_), 0) ||
+        header_.magic != CHUNK_FILE_MAGIC)
+    {
+        error = "no es un archivo .vfc: " + path;
+        return false;
+    }
+    if (!readFullyAt(fd_, &footer, sizeof(footer), static_cast<uint64_t>(size) - sizeof(footer)) || footer.magic != CHUNK_INDEX_MAGIC)
+    {
+        error = "archivo .vfc sin índice (¿grabación interrumpida?): " + path;
+        return false;
+    }
+    frames_.resize(footer.frame_count);
+    blocks_.resize(footer.block_count);
+    if (!readFullyAt(fd_, frames_.data(), frames_.size() * sizeof(ChunkFrameEntry), footer.frames_offset) ||
+        !readFullyAt(fd_, blocks_.data(), blocks_.size() * sizeof(ChunkBlockEntry), footer.blocks_offset))
+    {
+        error = "índice truncado: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool ChunkReader::read(size_t position, cv::Mat &frame, uint64_t &stored_bytes, std::string &error) const
+{
+    const ChunkFrameEntry &entry = frames_[position];
+    if (entry.block_count == 0 || entry.first_block + entry.block_count > blocks_.size())
+    {
+        error = "entrada de índice inválida";
+        return false;
+    }
+    // A frame's blocks are contiguous in the file: read them with one pread.
+    const ChunkBlockEntry &first = blocks_[entry.first_block];
+    const ChunkBlockEntry &last = blocks_[entry.first_block + entry.block_count - 1];
+    stored_bytes = last.offset + last.stored_bytes - first.offset;
+    thread_local std::vector<uint8_t> packed;
+    packed.resize(stored_bytes);
+    if (!readFullyAt(fd_, packed.data(), stored_bytes, first.offset))
+    {
+        error = "lectura truncada";
+        return false;
+    }
+    frame.create(static_cast<int>(entry.height), static_cast<int>(entry.width), static_cast<int>(entry.type));
+    size_t frame_bytes = frame.total() * frame.elemSize();
+    size_t out = 0;
+    for (uint32_t b = 0; b < entry.block_count; ++b)
+    {
+        const ChunkBlockEntry &block = blocks_[entry.first_block + b];
+        if (out + block.raw_bytes > frame_bytes ||
+            !decompressBlock(block.codec, packed.data() + (block.offset - first.offset), block.stored_bytes, frame.data + out, block.raw_bytes))
+        {
+            error = "bloque " + std::to_string(b) + " inválido";
+            return false;
+        }
+        out += block.raw_bytes;
+    }
+    if (out != frame_bytes)
+    {
+        error = "tamaño de frame inconsistente";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+// Chunked raw-frame container (.vfc) with block compression.
+//
+// Layout (host byte order):
+//   ChunkFileHeader
+//   compressed blocks, back to back (frames may appear in any order: writers run in parallel)
+//   ChunkFrameEntry[frame_count]
+//   ChunkBlockEntry[block_count]
+//   ChunkFileFooter (fixed size, at the very end of the file)
+//
+// Every frame's pixels are cut into blocks of block_bytes (the last one may be shorter) and
+// each block is compressed independently, so blocks can be compressed and decompressed on
+// different threads. A block that does not shrink is stored uncompressed (CHUNK_CODEC_NONE).
+
+#include <atomic>   // For std::atomic statistics
+#include <cstdint>  // For fixed-width integer types
+#include <mutex>    // For std::mutex
+#include <string>   // For std::string
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+
+const uint32_t CHUNK_FILE_MAGIC = 0x31434656;  // "VFC1" in little-endian.
+const uint32_t CHUNK_INDEX_MAGIC = 0x49434656; // "VFCI" in little-endian.
+
+// Block codecs. LZ4 and zstd are only available when CMake found them.
+const uint32_t CHUNK_CODEC_NONE = 0;
+const uint32_t CHUNK_CODEC_ZLIB = 1;
+const uint32_t CHUNK_CODEC_LZ4 = 2;
+const uint32_t CHUNK_CODEC_ZSTD = 3;
+
+struct ChunkFileHeader
+{
+    uint32_t magic;       // CHUNK_FILE_MAGIC.
+    uint32_t version;     // 1.
+    uint32_t codec;       // Codec requested for the blocks (some may be CHUNK_CODEC_NONE).
+    uint32_t block_bytes; // Uncompressed size of every block but the last of each frame.
+};
+
+struct ChunkFrameEntry
+{
+    int64_t index;         // Frame index given by the producer.
+    int64_t timestamp_ns;  // CLOCK_MONOTONIC time the frame was written.
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;         // OpenCV matrix type.
+    uint32_t block_count;
+    uint64_t first_block;  // Position of the frame's first ChunkBlockEntry.
+};
+
+struct ChunkBlockEntry
+{
+    uint64_t offset;           // File offset of the block data.
+    uint32_t stored_bytes;     // Bytes in the file.
+    uint32_t raw_bytes;        // Bytes after decompression.
+    uint32_t codec;            // Codec of this block.
+    uint32_t reserved;
+};
+
+struct ChunkFileFooter
+{
+    uint64_t frames_offset;
+    uint64_t blocks_offset;
+    uint64_t frame_count;
+    uint64_t block_count;
+    uint32_t magic;        // CHUNK_INDEX_MAGIC; missing if the writer did not finish.
+    uint32_t reserved;
+};
+
+/**
+ * @brief Parses a codec name ("zlib", "lz4", "zstd" or "none").
+ * @return false if the name is unknown or the codec was not compiled in.
+ */
+bool chunkCodecFromName(const std::string &name, uint32_t &codec);
+
+/**
+ * @brief Name of a codec, for reports.
+ */
+std::string chunkCodecName(uint32_t codec);
+
+/**
+ * @brief pwrite()s all of `size` bytes at `offset`, retrying short writes and EINTR.
+ * @return false on any other error, with errno set.
+ */
+bool writeFullyAt(int fd, const void *data, size_t size, uint64_t offset);
+
+/**
+ * @brief Writes frames into a .vfc file. append() may be called from several threads at once:
+ *        each caller compresses its own frame, then reserves space and writes with pwrite().
+ */
+class ChunkWriter
+{
+public:
+    ~ChunkWriter();
+
+    /**
+     * @param level Codec level (zlib 1-9, zstd 1-22, LZ4 acceleration); clamped per codec.
+     */
+    bool open(const std::string &path, uint32_t codec, int level, uint32_t block_bytes, std::string &error);
+    /**
+     * @brief Compresses and writes one frame; safe to call from several threads at once.
+     * @return Bytes stored for this frame (after compression), or -1 with `error` set.
+     */
+    long long append(const cv::Mat &frame, int64_t index, std::string &error);
+
+    /**
+     * @brief Writes the index and footer and closes the file. No append() may be running.
+     */
+    bool close(std::string &error);
+
+    long long frames() const { return frames_.load(); }
+    long long blocks() const { return blocks_.load(); }
+    long long blocksStoredRaw() const { return blocks_raw_.load(); } // Blocks that did not shrink.
+    long long rawBytes() const { return raw_bytes_.load(); }
+    long long storedBytes() const { return stored_bytes_.load(); }
+    long long compressNs() const { return compress_ns_.load(); }     // Summed over all threads.
+
+private:
+    int fd_ = -1;
+    uint32_t codec_ = CHUNK_CODEC_NONE;
+    int level_ = 1;
+    uint32_t block_bytes_ = 0;
+    std::mutex mutex_; // Protects offset_ and the index.
+    uint64_t offset_ = 0;
+    std::vector<ChunkFrameEntry> frame_index_;
+    std::vector<ChunkBlockEntry> block_index_;
+    std::atomic<long long> frames_{0}, blocks_{0}, blocks_raw_{0}, raw_bytes_{0}, stored_bytes_{0}, compress_ns_{0};
+};
+
+/**
+ * @brief Reads frames from a finished .vfc file. read() is thread-safe (pread).
+ */
+class ChunkReader
+{
+public:
+    ~ChunkReader();
+    bool open(const std::string &path, std::string &error);
+
+    size_t frameCount() const { return frames_.size(); }
+    const ChunkFileHeader &header() const { return header_; }
+    const ChunkFrameEntry &frame(size_t position) const { return frames_[position]; }
+
+    /**
+     * @brief Decodes the frame at `position` into `frame`, decompressing its blocks in order.
+     * @param stored_bytes Receives the number of bytes read from the file.
+     */
+    bool read(size_t position, cv::Mat &frame, uint64_t &stored_bytes, std::string &error) const;
+
+private:
+    int fd_ = -1;
+    ChunkFileHeader header_ = {};
+    std::vector<ChunkFrameEntry> frames_;
+    std::vector<ChunkBlockEntry> blocks_;
+};
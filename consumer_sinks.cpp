@@ -0,0 +1,153 @@
+#include "consumer_sinks.hpp"
+#include <sstream>  // For std::ostringstream (reports)
+
+std::string InProcessSink::report() const
+{
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    std::ostringstream out;
+    for (const ConsumerStats &stats : consumers_)
+    {
+        out << "    Consumidor " << stats.name << ": " << stats.frames.load() << " frames\n";
+        if (stats.frames.load() > 0)
+        {
+            out << "      edad al recibir: " << stats.age.summary() << "\n";
+            out << "      retenido: " << stats.hold.summary() << "\n";
+        }
+    }
+    return out.str();
+}
+
+ConsumerStats &InProcessSink::consumer(int id, const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    for (ConsumerStats &stats : consumers_)
+    {
+        if (stats.id == id)
+        {
+            return stats;
+        }
+    }
+    consumers_.emplace_back();
+    consumers_.back().id = id;
+    consumers_.back().name = name;
+    return consumers_.back();
+}
+
+CallbackSink::CallbackSink(Callback callback, std::string name)
+    : callback_(std::move(callback)), name_(std::move(name))
+{
+}
+
+bool CallbackSink::write(const ImageData &imgData, int saver_id)
+{
+    ConsumerStats &stats = consumer(saver_id, "guardador " + std::to_string(saver_id));
+    int64_t received_ns = liveStatsNowNs();
+    if (imgData.created_ns > 0)
+    {
+        stats.age.record(received_ns - imgData.created_ns);
+    }
+    bool ok = callback_(imgData, saver_id);
+    stats.hold.record(liveStatsNowNs() - received_ns);
+    stats.frames++;
+    if (ok)
+    {
+        bytes_written_ += static_cast<long long>(imgData.image.total() * imgData.image.elemSize());
+    }
+    return ok;
+}
+
+PulledFrame &PulledFrame::operator=(PulledFrame &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        frame_ = std::move(other.frame_);
+        stats_ = other.stats_;
+        received_ns_ = other.received_ns_;
+        other.stats_ = nullptr;
+    }
+    return *this;
+}
+
+void PulledFrame::release()
+{
+    if (stats_)
+    {
+        stats_->hold.record(liveStatsNowNs() - received_ns_);
+        stats_ = nullptr;
+    }
+    frame_.image.release(); // Drops this reference; the pool reuses the buffer once it is the last.
+}
+
+PullSink::PullSink(size_t capacity, std::string name) : capacity_(capacity > 0 ? capacity : 1), name_(std::move(name))
+{
+}
+
+bool PullSink::write(const ImageData &imgData, int saver_id)
+{
+    (void)saver_id;
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_ready_.wait(lock, [this] { return handoff_.size() < capacity_ || closed_; });
+    if (closed_)
+    {
+        return false;
+    }
+    handoff_.push_back(imgData); // Shares the buffer with the pipeline, no pixel copy.
+    bytes_written_ += static_cast<long long>(imgData.image.total() * imgData.image.elemSize());
+    frame_ready_.notify_one();
+    return true;
+}
+
+void PullSink::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    frame_ready_.notify_all();
+}
+
+int PullSink::addConsumer(const std::string &name)
+{
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_consumer_id_++;
+    }
+    consumer(id, name);
+    return id;
+}
+
+bool PullSink::next(int consumer_id, PulledFrame &frame)
+{
+    frame.release();
+    ConsumerStats &stats = consumer(consumer_id, "consumidor " + std::to_string(consumer_id));
+    ImageData imgData;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        frame_ready_.wait(lock, [this] { return !handoff_.empty() || finished_; });
+        if (handoff_.empty())
+        {
+            return false; // The pipeline has finished and everything was consumed.
+        }
+        imgData = std::move(handoff_.front());
+        handoff_.pop_front();
+        space_ready_.notify_one();
+    }
+    frame.received_ns_ = liveStatsNowNs();
+    if (imgData.created_ns > 0)
+    {
+        stats.age.record(frame.received_ns_ - imgData.created_ns);
+    }
+    stats.frames++;
+    frame.frame_ = std::move(imgData);
+    frame.stats_ = &stats;
+    return true;
+}
+
+void PullSink::close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    finished_ = true;
+    space_ready_.notify_all();
+    frame_ready_.notify_all();
+}
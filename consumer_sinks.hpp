@@ -0,0 +1,144 @@
+#pragma once
+
+// Sinks that hand frames to code running in the same process (test rigs, embedding
+// applications) instead of storing them. Frames are passed as the cv::Mat the pipeline already
+// holds, so nothing is copied; when the generator draws its buffers from a FramePool, a buffer
+// goes back to the pool as soon as the consumer lets go of its last reference.
+
+#include <condition_variable> // For std::condition_variable
+#include <cstdint>  // For int64_t
+#include <deque>    // For std::deque
+#include <functional> // For std::function
+#include <mutex>    // For std::mutex
+#include <string>   // For std::string
+#include "sinks.hpp"      // FrameSink
+#include "live_stats.hpp" // LatencyHistogram
+
+// Statistics of one consumer of an in-process sink.
+struct ConsumerStats
+{
+    int id = 0;
+    std::string name;
+    std::atomic<long long> frames{0};
+    LatencyHistogram age;  // From the frame entering the pipeline to the consumer receiving it.
+    LatencyHistogram hold; // From receiving the frame to releasing it.
+};
+
+/**
+ * @brief Common part of the in-process sinks: per-consumer statistics and their report.
+ */
+class InProcessSink : public FrameSink
+{
+public:
+    /**
+     * @brief One line per consumer: frames, age when received and time held.
+     */
+    std::string report() const override;
+
+protected:
+    /**
+     * @brief Statistics of consumer `id`, created with `name` on first use. The reference
+     *        stays valid for the life of the sink.
+     */
+    ConsumerStats &consumer(int id, const std::string &name);
+
+private:
+    mutable std::mutex consumers_mutex_;
+    std::deque<ConsumerStats> consumers_; // A deque never moves its elements.
+};
+
+/**
+ * @brief Calls a function for every frame, on the saver threads of the sink; each saver thread
+ *        is a consumer. The frame is only valid during the call unless the callback keeps a
+ *        copy of the cv::Mat header (which keeps the buffer out of the pool until released).
+ */
+class CallbackSink : public InProcessSink
+{
+public:
+    // Returns false if the frame could not be consumed (counted as a write error).
+    using Callback = std::function<bool(const ImageData &frame, int consumer_id)>;
+
+    explicit CallbackSink(Callback callback, std::string name = "callback");
+    bool write(const ImageData &imgData, int saver_id) override;
+    std::string describe() const override { return name_; }
+
+private:
+    Callback callback_;
+    std::string name_;
+};
+
+class PullSink;
+
+/**
+ * @brief A frame handed out by PullSink::next(). Holding it keeps the buffer in use; release()
+ *        (or destroying it) gives the buffer back and records how long it was held.
+ */
+class PulledFrame
+{
+public:
+    PulledFrame() = default;
+    PulledFrame(const PulledFrame &) = delete;
+    PulledFrame &operator=(const PulledFrame &) = delete;
+    PulledFrame(PulledFrame &&other) noexcept { *this = std::move(other); }
+    PulledFrame &operator=(PulledFrame &&other) noexcept;
+    ~PulledFrame() { release(); }
+
+    const ImageData &frame() const { return frame_; }
+    const cv::Mat &image() const { return frame_.image; }
+    int index() const { return frame_.index; }
+    explicit operator bool() const { return stats_ != nullptr; }
+
+    void release();
+
+private:
+    friend class PullSink;
+    ImageData frame_;
+    ConsumerStats *stats_ = nullptr;
+    int64_t received_ns_ = 0;
+};
+
+/**
+ * @brief Lets consumer threads pull frames with next(), each frame going to exactly one of them.
+ *
+ * Frames wait in a hand-off buffer of `capacity` frames; when it is full the saver threads
+ * block, so the channel queue in front of the sink fills up and its drop policy applies, as
+ * with a slow disk. Consumers that stop early must call close(), otherwise the savers would
+ * wait for them forever.
+ */
+class PullSink : public InProcessSink
+{
+public:
+    explicit PullSink(size_t capacity = 4, std::string name = "pull");
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override { return name_; }
+
+    /**
+     * @brief Registers a consumer thread.
+     * @return The id to pass to next().
+     */
+    int addConsumer(const std::string &name);
+
+    /**
+     * @brief Waits for the next frame.
+     * @return false once the pipeline has finished (or close() was called) and no frame is left.
+     */
+    bool next(int consumer_id, PulledFrame &frame);
+
+    /**
+     * @brief Stops accepting frames: writes fail from now on and waiting consumers return.
+     *        Frames already in the hand-off buffer can still be pulled.
+     */
+    void close();
+
+private:
+    size_t capacity_;
+    std::string name_;
+    std::mutex mutex_;
+    std::condition_variable frame_ready_; // A frame arrived, or no more will.
+    std::condition_variable space_ready_; // A frame was taken, or the sink was closed.
+    std::deque<ImageData> handoff_;
+    bool finished_ = false; // No more frames will be written (finish() or close()).
+    bool closed_ = false;   // close() was called: writes fail.
+    int next_consumer_id_ = 0;
+};
@@ -0,0 +1,251 @@
+#include "delta_format.hpp"
+
+#include <cerrno>   // For errno
+#include <chrono>   // For timing the encoder
+#include <cstring>  // For std::memcpy, std::strerror
+#include <fcntl.h>  // For open
+#include <unistd.h> // For close, ftruncate
+#include <zlib.h>   // For compress2-style deflate/inflate
+#include "chunk_format.hpp" // For writeFullyAt()
+#include "shm_ring.hpp" // For shmRingNowNs()
+
+DeltaWriter::~DeltaWriter()
+{
+    std::string ignored;
+    close(ignored);
+}
+
+bool DeltaWriter::open(const std::string &path, int key_interval, int level, std::string &error)
+{
+    // A raw descriptor rather than a stream: a failed write must not poison every later one.
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        error = "no se pudo crear " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    header_.magic = DELTA_FILE_MAGIC;
+    header_.version = 1;
+    header_.key_interval = static_cast<uint32_t>(key_interval);
+    level_ = level;
+    return true;
+}
+
+bool DeltaWriter::append(const cv::Mat &frame, int64_t index, std::string &error)
+{
+    if (fd_ < 0)
+    {
+        error = "archivo cerrado";
+        return false;
+    }
+    if (index_.empty() && header_.width == 0)
+    {
+        // The first frame fixes the geometry; the header is written here, once it is known.
+        header_.width = static_cast<uint32_t>(frame.cols);
+        header_.height = static_cast<uint32_t>(frame.rows);
+        header_.type = static_cast<uint32_t>(frame.type());
+        if (!writeFullyAt(fd_, &header_, sizeof(header_), 0))
+        {
+            header_.width = 0; // Retried with the next frame.
+            error = "error de escritura: " + std::string(std::strerror(errno));
+            return false;
+        }
+        frame_bytes_ = frame.total() * frame.elemSize();
+        previous_.resize(frame_bytes_);
+        current_.resize(frame_bytes_);
+        staging_.resize(frame_bytes_);
+        compressed_.resize(compressBound(static_cast<uLong>(frame_bytes_)));
+        offset_ = sizeof(header_);
+    }
+    if (frame.cols != static_cast<int>(header_.width) || frame.rows != static_cast<int>(header_.height) ||
+        frame.type() != static_cast<int>(header_.type))
+    {
+        error = "el frame no tiene el tamaño y tipo del primero";
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t row_bytes = frame.cols * frame.elemSize();
+    for (int r = 0; r < frame.rows; ++r)
+    {
+        std::memcpy(current_.data() + r * row_bytes, frame.ptr(r), row_bytes);
+    }
+    bool key = header_.key_interval <= 1 || index_.size() % header_.key_interval == 0;
+    if (!key)
+    {
+        // XOR with the previous frame. previous_ is only replaced once this frame is written.
+        const uint8_t *__restrict current = current_.data();
+        const uint8_t *__restrict previous = previous_.data();
+        uint8_t *__restrict delta = staging_.data();
+        for (size_t i = 0; i < frame_bytes_; ++i)
+        {
+            delta[i] = current[i] ^ previous[i];
+        }
+    }
+
+    // Deltas are mostly runs of zeros, which Z_RLE handles about as well as full deflate at a
+    // fraction of the cost; keyframes use the normal strategy.
+    z_stream stream = {};
+    deflateInit2(&stream, level_, Z_DEFLATED, 15, 8, key ? Z_DEFAULT_STRATEGY : Z_RLE);
+    stream.next_in = key ? current_.data() : staging_.data();
+    stream.avail_in = static_cast<uInt>(frame_bytes_);
+    stream.next_out = compressed_.data();
+    stream.avail_out = static_cast<uInt>(compressed_.size());
+    int status = deflate(&stream, Z_FINISH);
+    uint64_t compressed_bytes = stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END)
+    {
+        error = "deflate falló";
+        return false;
+    }
+    encode_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    DeltaRecordHeader record = {};
+    record.kind = key ? DELTA_KIND_KEY : DELTA_KIND_DELTA;
+    record.index = index;
+    record.timestamp_ns = shmRingNowNs();
+    record.compressed_bytes = compressed_bytes;
+    // A failed or partial record is overwritten by the next one, since offset_ does not move.
+    if (!writeFullyAt(fd_, &record, sizeof(record), offset_) ||
+        !writeFullyAt(fd_, compressed_.data(), compressed_bytes, offset_ + sizeof(record)))
+    {
+        error = "error de escritura: " + std::string(std::strerror(errno));
+        return false;
+    }
+    previous_.swap(current_);
+    index_.push_back({index, offset_, record.kind, 0});
+    offset_ += sizeof(record) + compressed_bytes;
+
+    (key ? keyframes_ : deltas_)++;
+    (key ? key_bytes_ : delta_bytes_) += static_cast<long long>(sizeof(record) + compressed_bytes);
+    raw_bytes_ += static_cast<long long>(frame_bytes_);
+    return true;
+}
+
+bool DeltaWriter::close(std::string &error)
+{
+    if (fd_ < 0)
+    {
+        return true;
+    }
+    bool ok = true;
+    if (header_.width == 0)
+    {
+        ok = writeFullyAt(fd_, &header_, sizeof(header_), 0); // No frames: header only.
+        offset_ = sizeof(header_);
+    }
+    DeltaFileFooter footer = {};
+    footer.index_offset = offset_;
+    footer.frame_count = index_.size();
+    footer.magic = DELTA_INDEX_MAGIC;
+    uint64_t index_bytes = index_.size() * sizeof(DeltaIndexEntry);
+    ok = ok && writeFullyAt(fd_, index_.data(), index_bytes, offset_) &&
+         writeFullyAt(fd_, &footer, sizeof(footer), offset_ + index_bytes) &&
+         ::ftruncate(fd_, static_cast<off_t>(offset_ + index_bytes + sizeof(footer))) == 0;
+    if (!ok)
+    {
+        error = "error al escribir el índice: " + std::string(std::strerror(errno));
+    }
+    ::close(fd_);
+    fd_ = -1;
+    return ok;
+}
+
+bool DeltaReader::open(const std::string &path, std::string &error)
+{
+    in_.open(path, std::ios::binary);
+    DeltaFileFooter footer = {};
+    if (!in_ || !in_.read(reinterpret_cast<char *>(&header_), sizeof(header_)) || header_.magic != DELTA_FILE_MAGIC)
+    {
+        error = "no es un archivo .vfd: " + path;
+        return false;
+    }
+    in_.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+    if (!in_.read(reinterpret_cast<char *>(&footer), sizeof(footer)) || footer.magic != DELTA_INDEX_MAGIC)
+    {
+        error = "archivo .vfd sin índice (¿grabación interrumpida?): " + path;
+        return false;
+    }
+    index_.resize(footer.frame_count);
+    in_.seekg(static_cast<std::streamoff>(footer.index_offset));
+    if (!in_.read(reinterpret_cast<char *>(index_.data()), static_cast<std::streamsize>(index_.size() * sizeof(DeltaIndexEntry))))
+    {
+        error = "índice truncado: " + path;
+        return false;
+    }
+    frame_bytes_ = static_cast<size_t>(header_.width) * header_.height * CV_ELEM_SIZE(header_.type);
+    current_.resize(frame_bytes_);
+    staging_.resize(frame_bytes_);
+    return true;
+}
+
+bool DeltaReader::decodeRecord(size_t position, std::string &error)
+{
+    DeltaRecordHeader record = {};
+    in_.seekg(static_cast<std::streamoff>(index_[position].offset));
+    if (!in_.read(reinterpret_cast<char *>(&record), sizeof(record)))
+    {
+        error = "registro truncado";
+        return false;
+    }
+    compressed_.resize(record.compressed_bytes);
+    if (!in_.read(reinterpret_cast<char *>(compressed_.data()), static_cast<std::streamsize>(record.compressed_bytes)))
+    {
+        error = "registro truncado";
+        return false;
+    }
+    bytes_read_ += static_cast<long long>(sizeof(record) + record.compressed_bytes);
+    bool key = record.kind == DELTA_KIND_KEY;
+    uLongf size = static_cast<uLongf>(frame_bytes_);
+    if (uncompress(key ? current_.data() : staging_.data(), &size, compressed_.data(),
+                   static_cast<uLong>(compressed_.size())) != Z_OK || size != frame_bytes_)
+    {
+        error = "datos comprimidos inválidos";
+        return false;
+    }
+    if (!key)
+    {
+        uint8_t *__restrict current = current_.data();
+        const uint8_t *__restrict delta = staging_.data();
+        for (size_t i = 0; i < frame_bytes_; ++i)
+        {
+            current[i] ^= delta[i];
+        }
+    }
+    records_decoded_++;
+    current_position_ = static_cast<long long>(position);
+    return true;
+}
+
+bool DeltaReader::read(size_t position, cv::Mat &frame, std::string &error)
+{
+    if (position >= index_.size())
+    {
+        error = "posición fuera de rango";
+        return false;
+    }
+    size_t key = position;
+    while (key > 0 && index_[key].kind != DELTA_KIND_KEY)
+    {
+        key--;
+    }
+    // Sequential reading: continue from the frame already decoded when it lies between the
+    // keyframe and the target (the target itself included).
+    size_t start = key;
+    if (current_position_ >= static_cast<long long>(key) && current_position_ <= static_cast<long long>(position))
+    {
+        start = static_cast<size_t>(current_position_) + 1;
+    }
+    for (size_t p = start; p <= position; ++p)
+    {
+        if (!decodeRecord(p, error))
+        {
+            current_position_ = -1;
+            return false;
+        }
+    }
+    frame.create(static_cast<int>(header_.height), static_cast<int>(header_.width), static_cast<int>(header_.type));
+    std::memcpy(frame.data, current_.data(), frame_bytes_);
+    return true;
+}
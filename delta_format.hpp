@@ -0,0 +1,144 @@
+#pragma once
+
+// Lossless delta-frame container (.vfd) for temporally coherent content.
+//
+// Layout (host byte order):
+//   DeltaFileHeader
+//   one record per frame: DeltaRecordHeader followed by `compressed_bytes` of deflate data
+//   DeltaIndexEntry[frame_count]
+//   DeltaFileFooter (fixed size, at the very end of the file)
+//
+// A keyframe stores the frame's pixels; a delta frame stores the XOR of its pixels with the
+// previous frame in the file, which is mostly zero bytes when little changes between frames.
+// Both are deflated. Frame k is decoded by starting at the nearest keyframe at or before k and
+// applying the deltas up to k; the index at the end of the file makes that a direct seek.
+
+#include <cstdint>  // For fixed-width integer types
+#include <fstream>  // For std::ifstream
+#include <string>   // For std::string
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+
+const uint32_t DELTA_FILE_MAGIC = 0x31444656;  // "VFD1" in little-endian.
+const uint32_t DELTA_INDEX_MAGIC = 0x49444656; // "VFDI" in little-endian.
+const uint32_t DELTA_KIND_KEY = 0;
+const uint32_t DELTA_KIND_DELTA = 1;
+
+struct DeltaFileHeader
+{
+    uint32_t magic;        // DELTA_FILE_MAGIC.
+    uint32_t version;      // 1.
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;         // OpenCV matrix type of every frame.
+    uint32_t key_interval; // A keyframe is written every key_interval frames.
+};
+
+struct DeltaRecordHeader
+{
+    uint32_t kind;             // DELTA_KIND_KEY or DELTA_KIND_DELTA.
+    uint32_t reserved;
+    int64_t index;             // Frame index given by the producer.
+    int64_t timestamp_ns;      // CLOCK_MONOTONIC time the frame was written.
+    uint64_t compressed_bytes; // Length of the deflate data that follows.
+};
+
+struct DeltaIndexEntry
+{
+    int64_t index;   // Frame index given by the producer.
+    uint64_t offset; // File offset of the frame's DeltaRecordHeader.
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+struct DeltaFileFooter
+{
+    uint64_t index_offset; // File offset of the first DeltaIndexEntry.
+    uint64_t frame_count;
+    uint32_t magic;        // DELTA_INDEX_MAGIC; missing if the writer did not finish.
+    uint32_t reserved;
+};
+
+/**
+ * @brief Writes frames, in order, into a .vfd file. Not thread-safe: one writer thread.
+ *        A frame that fails to be written is left out and the next one is encoded against
+ *        the last frame written, so the file stays decodable after a write error.
+ */
+class DeltaWriter
+{
+public:
+    ~DeltaWriter();
+
+    /**
+     * @param level zlib compression level (1 = fastest).
+     */
+    bool open(const std::string &path, int key_interval, int level, std::string &error);
+
+    /**
+     * @brief Appends a frame. Every frame must have the size and type of the first one.
+     */
+    bool append(const cv::Mat &frame, int64_t index, std::string &error);
+
+    /**
+     * @brief Writes the index and footer and closes the file.
+     */
+    bool close(std::string &error);
+
+    long long keyframes() const { return keyframes_; }
+    long long deltas() const { return deltas_; }
+    long long keyBytes() const { return key_bytes_; }     // Compressed bytes of all keyframes.
+    long long deltaBytes() const { return delta_bytes_; } // Compressed bytes of all delta frames.
+    long long rawBytes() const { return raw_bytes_; }     // Uncompressed bytes of all frames.
+    long long encodeNs() const { return encode_ns_; }     // Time spent in XOR and deflate.
+
+private:
+    int fd_ = -1;
+    DeltaFileHeader header_ = {};
+    int level_ = 1;
+    size_t frame_bytes_ = 0;
+    std::vector<uint8_t> previous_;   // Pixels of the last frame written.
+    std::vector<uint8_t> current_;    // Pixels of the frame being written; becomes previous_ once it is.
+    std::vector<uint8_t> staging_;    // XOR of current_ and previous_ for delta frames.
+    std::vector<uint8_t> compressed_;
+    std::vector<DeltaIndexEntry> index_;
+    uint64_t offset_ = 0;
+    long long keyframes_ = 0, deltas_ = 0, key_bytes_ = 0, delta_bytes_ = 0, raw_bytes_ = 0, encode_ns_ = 0;
+};
+
+/**
+ * @brief Reads frames from a finished .vfd file, sequentially or at random.
+ */
+class DeltaReader
+{
+public:
+    bool open(const std::string &path, std::string &error);
+
+    size_t frameCount() const { return index_.size(); }
+    const DeltaFileHeader &header() const { return header_; }
+    int64_t frameIndex(size_t position) const { return index_[position].index; }
+
+    /**
+     * @brief Decodes the frame at `position` (0-based, in file order) into `frame`.
+     *
+     * Reading the frame after the last one decoded applies a single delta; any other position
+     * goes back to its nearest keyframe.
+     */
+    bool read(size_t position, cv::Mat &frame, std::string &error);
+
+    long long recordsDecoded() const { return records_decoded_; } // Keyframes and deltas inflated so far.
+    long long bytesRead() const { return bytes_read_; }           // Compressed bytes read so far.
+
+private:
+    bool decodeRecord(size_t position, std::string &error);
+
+    std::ifstream in_;
+    DeltaFileHeader header_ = {};
+    size_t frame_bytes_ = 0;
+    std::vector<DeltaIndexEntry> index_;
+    std::vector<uint8_t> current_;    // Pixels of the frame at current_position_.
+    std::vector<uint8_t> staging_;
+    std::vector<uint8_t> compressed_;
+    long long current_position_ = -1;
+    long long records_decoded_ = 0;
+    long long bytes_read_ = 0;
+};
@@ -0,0 +1,242 @@
+#include "frame_generators.hpp"
+#include <algorithm> // For std::max, std::upper_bound
+#include <sstream>   // For std::istringstream
+
+cv::Mat generateRandomImage(int width, int height)
+{
+    cv::Mat image(height, width, CV_8UC3); // Create a 3-channel (color) image.
+    // Fill the image with random pixel values (BGR order).
+    cv::randu(image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    return image;
+}
+
+void FrameGenerator::generateBatch(int first_index, int count, std::vector<ImageData> &frames)
+{
+    for (int k = 0; k < count; ++k)
+    {
+        ImageData frame{cv::Mat(), first_index + k};
+        Result result = generate(first_index + k, frame);
+        if (result == Result::Frame)
+        {
+            frames.push_back(std::move(frame));
+        }
+        else if (result == Result::Finished)
+        {
+            break;
+        }
+    }
+}
+
+NoiseGenerator::NoiseGenerator(int width, int height, size_t pool_buffers)
+    : width_(width), height_(height), pool_(pool_buffers > 0 ? std::make_unique<FramePool>(pool_buffers) : nullptr)
+{
+}
+
+FrameGenerator::Result NoiseGenerator::generate(int index, ImageData &frame)
+{
+    (void)index;
+    if (!pool_)
+    {
+        frame.image = generateRandomImage(width_, height_);
+        return Result::Frame;
+    }
+    frame.image = pool_->acquire(cv::Size(width_, height_), CV_8UC3);
+    cv::randu(frame.image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    return Result::Frame;
+}
+
+/**
+ * @brief SplitMix64 finalizer: turns a (seed, frame) key into well-mixed bits.
+ */
+static uint64_t mixBits(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+FrameGenerator::Result SeededNoiseGenerator::generate(int index, ImageData &frame)
+{
+    frame.image.create(height_, width_, CV_8UC3); // No-op when the caller passes a buffer to reuse.
+    cv::RNG rng(mixBits(mixBits(seed_) ^ static_cast<uint64_t>(index)));
+    rng.fill(frame.image, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+    return Result::Frame;
+}
+
+void NoiseGenerator::generateBatch(int first_index, int count, std::vector<ImageData> &frames)
+{
+    cv::Size size(width_, height_ * count);
+    cv::Mat batch = pool_ ? pool_->acquire(size, CV_8UC3) : cv::Mat(size, CV_8UC3);
+    cv::randu(batch, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    for (int k = 0; k < count; ++k)
+    {
+        // Full-width row bands of a continuous matrix are themselves continuous.
+        frames.push_back({batch.rowRange(k * height_, (k + 1) * height_), first_index + k});
+    }
+}
+
+FrameGenerator::Result CoherentGenerator::generate(int index, ImageData &frame)
+{
+    if (previous_.empty())
+    {
+        previous_ = generateRandomImage(width_, height_);
+        frame.image = previous_;
+        return Result::Frame;
+    }
+    // The previous frame may still be queued for the sinks, so the new one is a copy.
+    cv::Mat image = previous_.clone();
+    int band = std::max(1, height_ / 16);
+    int top = (index * std::max(1, band / 4)) % (height_ - band + 1);
+    cv::Mat rows = image.rowRange(top, top + band);
+    cv::randu(rows, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    previous_ = image;
+    frame.image = image;
+    return Result::Frame;
+}
+
+/**
+ * @brief Parses "<w>x<h>" into `size`.
+ */
+static bool parseFrameSize(const std::string &text, cv::Size &size)
+{
+    size_t x = text.find('x');
+    if (x == std::string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        size = cv::Size(std::stoi(text.substr(0, x)), std::stoi(text.substr(x + 1)));
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return size.width > 0 && size.height > 0;
+}
+
+bool FrameSizeDistribution::parse(const std::string &spec, cv::Size max_size, std::string &error)
+{
+    sizes_.clear();
+    cumulative_.clear();
+    max_size_ = max_size;
+    crop_ = spec.rfind("crop:", 0) == 0;
+    if (crop_)
+    {
+        // Crops have even sides (see sizeOf()), so an odd minimum is rounded up.
+        bool parsed = parseFrameSize(spec.substr(5), min_size_);
+        min_size_ = cv::Size((min_size_.width + 1) & ~1, (min_size_.height + 1) & ~1);
+        if (!parsed || min_size_.width > max_size.width ||
+            min_size_.height > max_size.height)
+        {
+            error = "tamaño mínimo de recorte inválido o, redondeado a par, mayor que " + std::to_string(max_size.width) + "x" +
+                    std::to_string(max_size.height) + ": " + spec.substr(5);
+            return false;
+        }
+        return true;
+    }
+    std::istringstream items(spec);
+    std::string item;
+    double total = 0;
+    while (std::getline(items, item, ','))
+    {
+        size_t colon = item.find(':');
+        cv::Size size;
+        double weight = 1;
+        try
+        {
+            weight = colon == std::string::npos ? 1 : std::stod(item.substr(colon + 1));
+        }
+        catch (const std::exception &)
+        {
+            weight = 0;
+        }
+        if (!parseFrameSize(item.substr(0, colon), size) || weight <= 0)
+        {
+            error = "tamaño inválido: " + item;
+            return false;
+        }
+        if (size.width > max_size.width || size.height > max_size.height)
+        {
+            error = "el tamaño " + item.substr(0, colon) + " supera " + std::to_string(max_size.width) + "x" +
+                    std::to_string(max_size.height);
+            return false;
+        }
+        sizes_.push_back(size);
+        total += weight;
+        cumulative_.push_back(total);
+    }
+    if (sizes_.empty())
+    {
+        error = "ningún tamaño";
+        return false;
+    }
+    for (double &weight : cumulative_)
+    {
+        weight /= total;
+    }
+    return true;
+}
+
+size_t FrameSizeDistribution::choiceOf(int index) const
+{
+    double u = (mixBits(static_cast<uint64_t>(index)) >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+    size_t k = static_cast<size_t>(std::upper_bound(cumulative_.begin(), cumulative_.end(), u) - cumulative_.begin());
+    return std::min(k, sizes_.size() - 1);
+}
+
+cv::Size FrameSizeDistribution::sizeOf(int index) const
+{
+    if (!crop_)
+    {
+        return sizes_[choiceOf(index)];
+    }
+    // Even dimensions, so that the crops can still be converted to YUV 4:2:0 (--process).
+    uint64_t bits = mixBits(static_cast<uint64_t>(index));
+    auto draw = [](int low, int high, uint64_t r) {
+        int steps = (high - low) / 2 + 1;
+        return low + 2 * static_cast<int>(r % static_cast<uint64_t>(steps));
+    };
+    return cv::Size(draw(min_size_.width, max_size_.width, bits & 0xFFFFFFFF), draw(min_size_.height, max_size_.height, bits >> 32));
+}
+
+double FrameSizeDistribution::meanPixels() const
+{
+    if (crop_)
+    {
+        // Dimensions are drawn independently, so the mean area is the product of the mean sides.
+        int width_steps = (max_size_.width - min_size_.width) / 2;
+        int height_steps = (max_size_.height - min_size_.height) / 2;
+        return (min_size_.width + width_steps) * static_cast<double>(min_size_.height + height_steps);
+    }
+    double mean = 0;
+    double previous = 0;
+    for (size_t k = 0; k < sizes_.size(); ++k)
+    {
+        mean += (cumulative_[k] - previous) * sizes_[k].area();
+        previous = cumulative_[k];
+    }
+    return mean;
+}
+
+VariableSizeGenerator::VariableSizeGenerator(FrameSizeDistribution sizes, size_t pool_buffers)
+    : sizes_(std::move(sizes)), pool_(pool_buffers), frames_per_size_(sizes_.sizes().size(), 0)
+{
+}
+
+FrameGenerator::Result VariableSizeGenerator::generate(int index, ImageData &frame)
+{
+    cv::Size size = sizes_.sizeOf(index);
+    if (!sizes_.crops())
+    {
+        size_t choice = sizes_.choiceOf(index);
+        size = sizes_.sizes()[choice];
+        frames_per_size_[choice]++;
+    }
+    frame.image = pool_.acquire(size, CV_8UC3);
+    cv::randu(frame.image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    frames_++;
+    pixels_ += size.area();
+    return Result::Frame;
+}
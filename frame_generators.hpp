@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>   // For std::atomic<bool> (stop flag passed to begin())
+#include <chrono>   // For std::chrono::steady_clock
+#include <cstdint>  // For uint64_t
+#include <memory>   // For std::unique_ptr
+#include <string>   // For std::string
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+#include "image_data.hpp"   // ImageData
+#include "frame_pool.hpp"   // FramePool (pooled noise frames)
+
+/**
+ * @brief Generates a random color image.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @return An OpenCV Mat object representing the generated image.
+ */
+cv::Mat generateRandomImage(int width, int height);
+
+/**
+ * @brief Source of frames for Pipeline::generate(), which calls it once per frame from the
+ *        producer thread: synthetic content, or frames received or read from elsewhere.
+ */
+class FrameGenerator
+{
+public:
+    enum class Result
+    {
+        Frame,     // `frame` holds a new frame for the pipeline.
+        Delivered, // The generator delivered the frame itself (e.g. into shared memory); it
+                   // counts as generated and saved but does not go through the sinks.
+        Failed,    // No frame this time; nothing is counted.
+        Finished   // The source is exhausted (e.g. every producer disconnected); stop generating.
+    };
+
+    virtual ~FrameGenerator() = default;
+
+    /**
+     * @brief Produces frame number `index` into `frame` (its index field is already set).
+     *        If `frame.image` already holds a buffer of the right size, it may be reused.
+     *        Unpaced generators may replace the index with the one the frame arrived with.
+     */
+    virtual Result generate(int index, ImageData &frame) = 0;
+
+    /**
+     * @brief Produces frames `first_index` to `first_index + count - 1` and appends those that
+     *        were generated to `frames`. The default calls generate() once per frame; frames
+     *        that the generator delivers itself (Result::Delivered) are not supported here.
+     */
+    virtual void generateBatch(int first_index, int count, std::vector<ImageData> &frames);
+
+    /**
+     * @brief True if every frame depends only on its index, so that several threads may call
+     *        generate() at once, in any order (required by Pipeline::setFused()).
+     */
+    virtual bool independentFrames() const { return false; }
+
+    /**
+     * @brief False for sources that deliver frames at their own rate (ingest): Pipeline::generate()
+     *        then calls generate() back to back, without a schedule or late frames, and every call
+     *        must return within about 100 ms so that the deadline and stop requests are honoured.
+     */
+    virtual bool paced() const { return true; }
+
+    /**
+     * @brief Number of frames the generator can produce (frames 0 to frameCount() - 1), or -1
+     *        if it is unlimited. Pipeline::generate() stops once the schedule reaches it.
+     */
+    virtual long long frameCount() const { return -1; }
+
+    /**
+     * @brief Called by Pipeline::generate() on the producer thread before the first frame.
+     *        Generators that block (waiting for a producer, a file...) give up once `end_time`
+     *        passes or `stop` is set.
+     */
+    virtual void begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop)
+    {
+        (void)end_time;
+        (void)stop;
+    }
+};
+
+/**
+ * @brief Independent random frames (--content=noise).
+ *
+ * With `pool_buffers` > 0 the frames are drawn from a FramePool of that many buffers, so a
+ * buffer is reused as soon as every sink (or in-process consumer) has released it.
+ */
+class NoiseGenerator : public FrameGenerator
+{
+public:
+    NoiseGenerator(int width, int height, size_t pool_buffers = 0);
+    Result generate(int index, ImageData &frame) override;
+
+    /**
+     * @brief Generates the whole batch in one allocation (and one cv::randu call): every frame
+     *        is a band of rows of the same buffer, which is released once all of them are.
+     */
+    void generateBatch(int first_index, int count, std::vector<ImageData> &frames) override;
+
+    const FramePool *pool() const { return pool_.get(); } // nullptr without pool_buffers.
+
+private:
+    int width_;
+    int height_;
+    std::unique_ptr<FramePool> pool_;
+};
+
+/**
+ * @brief Deterministic noise: frame `index` is always the same image (a cv::RNG seeded from
+ *        `seed` and the index), whichever thread generates it and in whatever order. Used by
+ *        the fused mode, where every saver generates the frames it is assigned.
+ */
+class SeededNoiseGenerator : public FrameGenerator
+{
+public:
+    SeededNoiseGenerator(int width, int height, uint64_t seed = 0) : width_(width), height_(height), seed_(seed) {}
+    Result generate(int index, ImageData &frame) override;
+    bool independentFrames() const override { return true; }
+
+private:
+    int width_;
+    int height_;
+    uint64_t seed_;
+};
+
+/**
+ * @brief Temporally coherent content (--content=coherent): every frame is the previous one with
+ *        one horizontal band re-randomized. The band covers 1/16 of the height and moves down a
+ *        quarter of its height every frame, like a slow scene change.
+ */
+class CoherentGenerator : public FrameGenerator
+{
+public:
+    CoherentGenerator(int width, int height) : width_(width), height_(height) {}
+    Result generate(int index, ImageData &frame) override;
+
+private:
+    int width_;
+    int height_;
+    cv::Mat previous_; // Last frame generated.
+};
+
+/**
+ * @brief Resolution of every frame of a variable-size run (--sizes): a weighted list of sizes,
+ *        or random crops between a minimum size and the maximum size. The size of frame
+ *        `index` depends only on the index.
+ */
+class FrameSizeDistribution
+{
+public:
+    /**
+     * @brief Parses "<w>x<h>[:<weight>],..." or "crop:<min w>x<min h>". No size may exceed
+     *        `max_size`, which is also the largest crop.
+     * @return false (with `error` set) if the spec is invalid.
+     */
+    bool parse(const std::string &spec, cv::Size max_size, std::string &error);
+
+    cv::Size sizeOf(int index) const;
+    bool crops() const { return crop_; }
+    const std::vector<cv::Size> &sizes() const { return sizes_; } // The listed sizes (not crops).
+
+    /**
+     * @brief Index in sizes() of the size of frame `index` (list mode only).
+     */
+    size_t choiceOf(int index) const;
+
+    /**
+     * @brief Average number of pixels per frame.
+     */
+    double meanPixels() const;
+
+private:
+    std::vector<cv::Size> sizes_;
+    std::vector<double> cumulative_; // Cumulative weights of sizes_, normalized to 1.
+    bool crop_ = false;
+    cv::Size min_size_;
+    cv::Size max_size_;
+};
+
+/**
+ * @brief Independent random frames whose size is drawn from a FrameSizeDistribution (--sizes).
+ *        The buffers come from a FramePool with size classes, so frames of different sizes
+ *        still reuse buffers once the sinks release them.
+ */
+class VariableSizeGenerator : public FrameGenerator
+{
+public:
+    VariableSizeGenerator(FrameSizeDistribution sizes, size_t pool_buffers);
+    Result generate(int index, ImageData &frame) override;
+
+    const FrameSizeDistribution &distribution() const { return sizes_; }
+    const FramePool &pool() const { return pool_; }
+    // Frames generated per listed size (list mode), and pixels of all frames.
+    const std::vector<long long> &framesPerSize() const { return frames_per_size_; }
+    long long frames() const { return frames_; }
+    long long pixels() const { return pixels_; }
+
+private:
+    FrameSizeDistribution sizes_;
+    FramePool pool_;
+    std::vector<long long> frames_per_size_;
+    long long frames_ = 0;
+    long long pixels_ = 0;
+};
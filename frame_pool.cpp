@@ -0,0 +1,113 @@
+#include "frame_pool.hpp"
+#include <algorithm> // For std::sort
+
+FramePool::FramePool(size_t max_buffers) : max_buffers_(max_buffers)
+{
+}
+
+size_t FramePool::classElements(size_t elements)
+{
+    // Four classes per power of two: round up to a multiple of a quarter of the highest power
+    // of two not above `elements`, which wastes at most 20% of a buffer.
+    size_t power = 1;
+    while (power <= elements / 2)
+    {
+        power *= 2;
+    }
+    size_t step = std::max<size_t>(power / 4, 1);
+    return (elements + step - 1) / step * step;
+}
+
+FramePool::ClassStats &FramePool::statsOf(int type, size_t bytes)
+{
+    for (ClassStats &stats : classes_)
+    {
+        if (stats.type == type && stats.bytes == bytes)
+        {
+            return stats;
+        }
+    }
+    classes_.emplace_back();
+    classes_.back().type = type;
+    classes_.back().bytes = bytes;
+    return classes_.back();
+}
+
+cv::Mat FramePool::acquire(cv::Size size, int type)
+{
+    size_t elements = static_cast<size_t>(size.area());
+    size_t capacity = classElements(elements);
+    size_t elem_size = CV_ELEM_SIZE(type);
+    requested_bytes_ += static_cast<long long>(elements * elem_size);
+    reserved_bytes_ += static_cast<long long>(capacity * elem_size);
+    // A view of the first `elements` elements, shaped as the frame; it shares the buffer's
+    // reference count, so the pool sees when it is released.
+    auto view = [&](const cv::Mat &buffer) {
+        return buffer.colRange(0, static_cast<int>(elements)).reshape(0, size.height);
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClassStats &stats = statsOf(type, capacity * elem_size);
+    cv::Mat *reusable = nullptr; // A free buffer of another class, if the pool has to make room.
+    for (cv::Mat &buffer : buffers_)
+    {
+        // refcount == 1 means only the pool still references the buffer. Other threads can
+        // only decrement it concurrently, so a stale read at worst skips a free buffer.
+        if (!buffer.u || buffer.u->refcount != 1)
+        {
+            continue;
+        }
+        if (static_cast<size_t>(buffer.cols) == capacity && buffer.type() == type)
+        {
+            hits_++;
+            stats.hits++;
+            return view(buffer);
+        }
+        reusable = reusable ? reusable : &buffer;
+    }
+    misses_++;
+    stats.misses++;
+    cv::Mat buffer(1, static_cast<int>(capacity), type);
+    if (buffers_.size() < max_buffers_)
+    {
+        buffers_.push_back(buffer);
+        stats.buffers++;
+    }
+    else if (reusable)
+    {
+        // Mixed sizes: a full pool of free buffers of other classes would otherwise never serve
+        // this class again.
+        statsOf(reusable->type(), reusable->cols * reusable->elemSize()).buffers--;
+        *reusable = buffer;
+        stats.buffers++;
+        evictions_++;
+    }
+    else
+    {
+        overflows_++;
+    }
+    return view(buffer);
+}
+
+size_t FramePool::pooledBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bytes = 0;
+    for (const cv::Mat &buffer : buffers_)
+    {
+        bytes += buffer.total() * buffer.elemSize();
+    }
+    return bytes;
+}
+
+std::vector<FramePool::ClassStats> FramePool::classStats() const
+{
+    std::vector<ClassStats> classes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        classes = classes_;
+    }
+    std::sort(classes.begin(), classes.end(),
+              [](const ClassStats &a, const ClassStats &b) { return a.bytes < b.bytes; });
+    return classes;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>   // For std::atomic counters
+#include <mutex>    // For std::mutex
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+
+/**
+ * @brief Pool of reusable frame buffers.
+ *
+ * A buffer handed out by acquire() is an ordinary cv::Mat that can be queued and shared freely.
+ * The pool keeps one reference to every buffer it owns; once all other references are gone
+ * (the frame was saved or dropped) the buffer's reference count is back to 1 and the next
+ * acquire() of the same size class and type reuses it instead of allocating.
+ *
+ * Buffers are allocated in size classes (four per power of two of the pixel count), so frames
+ * of slightly different sizes share buffers: a request gets a view of the first rows*cols
+ * elements of a buffer of its class. The unused tail of the buffer is the internal
+ * fragmentation reported by requestedBytes() / reservedBytes().
+ */
+class FramePool
+{
+public:
+    // Counters of one size class.
+    struct ClassStats
+    {
+        int type = 0;         // OpenCV type of the buffers.
+        size_t bytes = 0;     // Size of one buffer of the class.
+        size_t buffers = 0;   // Buffers of the class kept by the pool.
+        long long hits = 0;   // Requests served by reusing one of them.
+        long long misses = 0; // Requests that had to allocate.
+    };
+
+    /**
+     * @param max_buffers Maximum number of buffers kept by the pool. When no pooled buffer of
+     *        the class is free and the pool is full, acquire() replaces a free buffer of another
+     *        class, or falls back to a plain allocation if every buffer is in use.
+     */
+    explicit FramePool(size_t max_buffers);
+
+    /**
+     * @brief Returns a continuous buffer of the given size and type (contents are undefined).
+     */
+    cv::Mat acquire(cv::Size size, int type);
+
+    /**
+     * @brief Number of elements of the size class that holds `elements` elements.
+     */
+    static size_t classElements(size_t elements);
+
+    long long hits() const { return hits_.load(); }     // Requests served by reusing a buffer.
+    long long misses() const { return misses_.load(); } // Requests that had to allocate.
+    long long evictions() const { return evictions_.load(); } // Free buffers of another class replaced.
+    long long overflows() const { return overflows_.load(); } // Allocations not kept (every buffer in use).
+    long long requestedBytes() const { return requested_bytes_.load(); } // Bytes asked for, all requests.
+    long long reservedBytes() const { return reserved_bytes_.load(); }   // Bytes of the class buffers handed out.
+
+    /**
+     * @brief Bytes held by the pool's buffers right now.
+     */
+    size_t pooledBytes() const;
+
+    /**
+     * @brief Counters of every size class used so far, smallest first.
+     */
+    std::vector<ClassStats> classStats() const;
+
+private:
+    ClassStats &statsOf(int type, size_t bytes); // Under mutex_.
+
+    size_t max_buffers_;
+    mutable std::mutex mutex_;
+    std::vector<cv::Mat> buffers_; // 1 x classElements() buffers.
+    std::vector<ClassStats> classes_;
+    std::atomic<long long> hits_{0};
+    std::atomic<long long> misses_{0};
+    std::atomic<long long> evictions_{0};
+    std::atomic<long long> overflows_{0};
+    std::atomic<long long> requested_bytes_{0};
+    std::atomic<long long> reserved_bytes_{0};
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+// Minimal framing protocol used to stream frames over a Unix domain stream socket.
+//
+// Each frame is sent as a FrameSocketHeader immediately followed by `bytes` payload bytes.
+// The payload is either raw pixels or an encoded image, using the same SHM_FORMAT_* values
+// as the shared-memory ring. All fields are in host byte order (the socket is local).
+//
+// Like shm_ring.hpp, this header has no OpenCV dependency so producers can include it alone.
+
+#include <cerrno>   // For errno
+#include <cstdint>  // For fixed-width integer types
+#include <cstring>  // For std::strerror, std::memset
+#include <string>   // For std::string
+#include <sys/socket.h> // For socket, bind, listen, accept, send
+#include <sys/uio.h>    // For iovec
+#include <sys/un.h>     // For sockaddr_un
+#include <unistd.h>     // For read, close, unlink
+#include "shm_ring.hpp" // For SHM_FORMAT_RAW / SHM_FORMAT_ENCODED
+
+// "VFGS" in little-endian; marks the start of every frame on the socket.
+const uint32_t FRAME_SOCKET_MAGIC = 0x53474656;
+
+struct FrameSocketHeader
+{
+    uint32_t magic;       // FRAME_SOCKET_MAGIC.
+    uint32_t format;      // SHM_FORMAT_RAW or SHM_FORMAT_ENCODED.
+    int64_t index;        // Producer-assigned frame index.
+    int64_t timestamp_ns; // CLOCK_MONOTONIC capture time (see shmRingNowNs()).
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;        // OpenCV matrix type for SHM_FORMAT_RAW.
+    uint32_t reserved;
+    uint64_t bytes;       // Payload length in bytes.
+    uint64_t step;        // Bytes per row for SHM_FORMAT_RAW (rows are sent back to back).
+};
+
+/**
+ * @brief Fills a sockaddr_un for `path`.
+ * @return false if the path does not fit in sun_path.
+ */
+inline bool frameSocketAddress(const std::string &path, sockaddr_un &addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/**
+ * @brief Creates a listening Unix stream socket at `path`, replacing a stale socket file.
+ * @return The listening descriptor, or -1 with `error` set.
+ */
+inline int frameSocketListen(const std::string &path, std::string &error)
+{
+    sockaddr_un addr;
+    if (!frameSocketAddress(path, addr))
+    {
+        error = "ruta de socket demasiado larga: " + path;
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = "socket: " + std::string(std::strerror(errno));
+        return -1;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 8) != 0)
+    {
+        error = "bind/listen(" + path + "): " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Connects to a frame socket listening at `path`.
+ * @return The connected descriptor, or -1 with `error` set.
+ */
+inline int frameSocketConnect(const std::string &path, std::string &error)
+{
+    sockaddr_un addr;
+    if (!frameSocketAddress(path, addr))
+    {
+        error = "ruta de socket demasiado larga: " + path;
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = "socket: " + std::string(std::strerror(errno));
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        error = "connect(" + path + "): " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Reads exactly `size` bytes, retrying on short reads and EINTR.
+ * @return false on EOF or error.
+ */
+inline bool frameSocketReadFully(int fd, void *buffer, size_t size)
+{
+    uint8_t *p = static_cast<uint8_t *>(buffer);
+    while (size > 0)
+    {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Sends one frame (header + payload) with a single gathered write where possible.
+ * @return false if the peer went away or an error occurred.
+ */
+inline bool frameSocketSend(int fd, const FrameSocketHeader &header, const void *payload)
+{
+    iovec iov[2];
+    iov[0].iov_base = const_cast<FrameSocketHeader *>(&header);
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<void *>(payload);
+    iov[1].iov_len = header.bytes;
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return false;
+        }
+        // Advance past what was sent (short writes happen with large frames).
+        size_t sent = static_cast<size_t>(n);
+        while (msg.msg_iovlen > 0 && sent >= msg.msg_iov[0].iov_len)
+        {
+            sent -= msg.msg_iov[0].iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov[0].iov_base = static_cast<uint8_t *>(msg.msg_iov[0].iov_base) + sent;
+            msg.msg_iov[0].iov_len -= sent;
+        }
+    }
+    return true;
+}
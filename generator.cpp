@@ -3,7 +3,6 @@
 #include <queue>    // For std::deque (used as a queue)
 #include <deque>    // For std::deque explicitly
 #include <mutex>    // For std::mutex and std::lock_guard, std::unique_lock
-#include <condition_variable> // For std::condition_variable
 #include <chrono>   // For time-related operations (steady_clock, duration)
 #include <iomanip>  // For I/O manipulators (setprecision, fixed)
 #include <filesystem> // For filesystem operations (create_directories, exists)
@@ -13,20 +12,29 @@
 #include <opencv2/core.hpp>     // OpenCV core functionalities
 #include <opencv2/imgcodecs.hpp> // OpenCV image reading/writing
 #include <opencv2/imgproc.hpp>   // OpenCV image processing (though mainly randu is used here)
+#include <algorithm> // For std::min, std::max
+#include <cstdlib>  // For std::abs
+#include <poll.h>   // For poll (control socket)
+#include <fcntl.h>  // For open, posix_fadvise, readahead (read benchmark)
+#include <sys/stat.h> // For fstat
+#include <memory>   // For std::unique_ptr
+#include <sstream>  // For std::istringstream (sink specs)
+#include <fstream>  // For std::ofstream (--stats-file)
+#include <csignal>  // For sigset_t, sigtimedwait (graceful shutdown)
+#include <pthread.h> // For pthread_sigmask
+#include "shm_ring.hpp" // Shared-memory frame ring (optional output instead of disk)
+#include "frame_socket.hpp" // Unix socket helpers and full reads (control socket, read benchmark)
+#include "sinks.hpp" // Frame sinks (disk, socket, shared memory)
+#include "processing.hpp" // Per-frame operator chain (--process)
+#include "frame_generators.hpp" // Noise and coherent frame generators
+#include "source_generators.hpp" // Shared-memory ring, ingest and replay sources
+#include "pipeline.hpp" // Producer -> processing -> sinks pipeline
+#include "yuv420.hpp" // BGR to NV12/I420 conversion (--yuv-bench)
+#include "live_stats.hpp" // Latency histograms and thread states (SIGUSR1 snapshot)
+#include "watermark.hpp" // Per-frame watermarks (--watermark, --verify-watermarks)
 
 namespace fs = std::filesystem;
 
-// Configuration: Number of threads dedicated to saving images.
-const int NUM_SAVER_THREADS = 7;
-
-// Structure to hold an image and its unique generation index.
-// This is passed through the queue from the generator to savers.
-struct ImageData
-{
-    cv::Mat image; // The OpenCV matrix holding image data.
-    int index;     // Unique index of the image, used for naming files.
-};
-
 // Structure to hold arguments passed to the generator and saver threads.
 struct ThreadArgs
 {
@@ -35,194 +43,1533 @@ struct ThreadArgs
     int duration_seconds;  // How long the image generation process should run.
     double fps;            // Target frames per second for image generation.
     std::string image_extension; // File extension for saved images (e.g., "png", "jpg").
-    std::string output_directory; // Directory where images will be saved.
+    std::vector<std::string> output_directories = {"generated_images"}; // Directories (one per device) where images will be saved.
     int totalImages;       // Total images expected to be generated (fps * duration).
+    std::string shm_ring_name; // POSIX shm name of the frame ring; empty = save to disk.
+    int shm_slots = 64;        // Number of frame slots in the shared-memory ring.
+    std::string ingest_source; // "shm" or "unix" to record frames from another process; empty = generate.
+    std::string ingest_target; // Ring name or socket path for ingest mode.
+    std::string replay_directory; // Directory of images to re-stream through the savers; empty = generate.
+    int replay_threads = 4;       // Decoder threads used in replay mode.
+    int replay_prefetch = 32;     // Maximum decoded frames kept ahead of the replay position.
+    std::string read_bench_path;  // Output to read back in read-benchmark mode; empty = normal run.
+    int read_threads = 4;         // Reader threads in read-benchmark mode.
+    std::string read_advice = "none"; // Page-cache hint for upcoming files: "none", "fadvise" or "readahead".
+    int read_prefetch = 16;       // How many files ahead of the current one the hint is issued for.
+    bool read_decode = true;      // Decode what was read (otherwise only measure raw reads).
+    bool read_drop_cache = false; // Evict the files from the page cache before starting.
+    std::vector<std::string> sink_specs; // --sink specifications; empty = one disk sink for image_extension.
+    std::string stripe_policy = "rr"; // How disk sinks spread frames over several directories: "rr" or "adaptive".
+    std::string publish_mode = "direct"; // How disk sinks publish files: "direct", "tmpfile" or "rename".
+    std::string process_spec;     // Operator chain applied to every frame before the sinks (--process); empty = none.
+    int process_threads = 4;      // Worker threads of the processing stage.
+    int pyramid_levels = 0;       // Reduced levels (1/2, 1/4...) saved next to every frame (--pyramid).
+    int yuv_bench_frames = 0;     // Frames converted per variant in YUV benchmark mode; 0 = normal run.
+    std::string content = "noise"; // Generated content: "noise" (independent frames) or "coherent".
+    std::string control_path;     // Unix socket for runtime reconfiguration (--control); empty = none.
+    std::string stats_file;       // Where SIGUSR1 snapshots are appended; empty = stderr.
+    double drain_deadline = 10;   // Seconds allowed to drain the queues after SIGINT/SIGTERM.
+    bool demand = false;          // Generate only when the sinks have room (--demand).
+    bool fused = false;           // Savers generate the frames they save (--fused).
+    double fused_deadline_ms = 1000; // Fused mode: how late a saver may start a frame.
+    int batch = 1;                // Frames generated per wakeup (--batch).
+    std::string sizes_spec;       // Size of every frame (--sizes); empty = always <width>x<height>.
+    std::string watermark;        // --watermark: "" (none), "pixels", "meta" or "both".
+    std::string verify_watermarks_path; // Directory to audit in watermark verification mode; empty = normal run.
 };
 
-// --- Shared variables for inter-thread communication and synchronization ---
-
-// Maximum number of images allowed in the queue. If full, oldest is dropped. 
-// Could manually increase it if the computer can handle it.
-const size_t MAX_QUEUE_SIZE = 100; 
-// Queue to transfer ImageData from the generator thread to saver threads.
-std::deque<ImageData> imageQueue;
-// Mutex to protect access to shared resources: imageQueue and finishedGenerating flag.
-std::mutex queueMutex;         
-// Condition variable to signal saver threads when new images are available or generation is finished.
-std::condition_variable queueCV; 
-// Flag to indicate to saver threads that the image generator has finished its work.
-bool finishedGenerating = false;   
-// Atomic counter for the total number of images generated by the producer thread.
-std::atomic<int> total_images_generated_count = 0; 
-// Atomic counter for the total number of images successfully saved to disk by consumer threads.
-std::atomic<int> total_images_saved_count = 0;     
-// Atomic counter for images pushed into the queue by the generator.
-std::atomic<int> total_images_enqueued_count = 0;
-// Atomic counter for frames the generator skipped because it was falling behind the target FPS.
-std::atomic<int> total_images_dropped_due_to_delay = 0;
+/**
+ * @brief Creates the frame generator for the run (shared-memory ring, ingest, replay, --content,
+ *        --fused or --sizes).
+ * @return nullptr (with `error` set) if the ring or the ingest socket could not be created.
+ */
+std::unique_ptr<FrameGenerator> makeFrameGenerator(const ThreadArgs &args, const Pipeline &pipeline, std::string &error)
+{
+    if (!args.shm_ring_name.empty())
+    {
+        auto ring = std::make_unique<ShmRingGenerator>(args.width, args.height, args.image_extension);
+        if (!ring->open(args.shm_ring_name, static_cast<uint32_t>(args.shm_slots), error))
+        {
+            error = "No se pudo crear el anillo de memoria compartida: " + error;
+            return nullptr;
+        }
+        return ring;
+    }
+    if (args.ingest_source == "shm")
+    {
+        return std::make_unique<ShmIngestGenerator>(args.ingest_target);
+    }
+    if (args.ingest_source == "unix")
+    {
+        auto socket = std::make_unique<SocketIngestGenerator>(args.ingest_target);
+        if (!socket->listen(error))
+        {
+            error = "No se pudo crear el socket de ingesta: " + error;
+            return nullptr;
+        }
+        return socket;
+    }
+    if (!args.replay_directory.empty())
+    {
+        return std::make_unique<ReplayGenerator>(args.replay_directory, args.replay_threads, args.replay_prefetch);
+    }
+    if (args.content == "coherent")
+    {
+        return std::make_unique<CoherentGenerator>(args.width, args.height);
+    }
+    if (args.fused)
+    {
+        return std::make_unique<SeededNoiseGenerator>(args.width, args.height);
+    }
+    if (!args.sizes_spec.empty())
+    {
+        FrameSizeDistribution sizes;
+        sizes.parse(args.sizes_spec, cv::Size(args.width, args.height), error); // Validated in main().
+        // Enough buffers for every frame that can be queued or being written at once, as for
+        // the processing stage's pool.
+        size_t in_flight = 2;
+        const SinkChannel *stage = pipeline.stageChannel();
+        if (stage)
+        {
+            in_flight += stage->max_queue_size + static_cast<size_t>(stage->num_threads);
+        }
+        for (const auto &route : pipeline.routes())
+        for (const auto &channel : route->channels)
+        {
+            in_flight += channel->max_queue_size + static_cast<size_t>(channel->num_threads);
+        }
+        return std::make_unique<VariableSizeGenerator>(sizes, in_flight);
+    }
+    return std::make_unique<NoiseGenerator>(args.width, args.height);
+}
+
+/**
+ * @brief Prints the sizes generated with --sizes and how well the size-class pool reused buffers.
+ */
+void printVariableSizeSummary(const VariableSizeGenerator &generator)
+{
+    const FrameSizeDistribution &sizes = generator.distribution();
+    const FramePool &pool = generator.pool();
+    std::cout << "\n--- Tamaños variables (--sizes) ---\n";
+    if (!sizes.crops())
+    {
+        for (size_t k = 0; k < sizes.sizes().size(); ++k)
+        {
+            std::cout << sizes.sizes()[k].width << "x" << sizes.sizes()[k].height << ": "
+                      << generator.framesPerSize()[k] << " frames\n";
+        }
+    }
+    if (generator.frames() > 0)
+    {
+        std::cout << std::fixed << std::setprecision(0)
+                  << "Píxeles medios por frame: " << static_cast<double>(generator.pixels()) / generator.frames()
+                  << " (esperados " << sizes.meanPixels() << ")\n";
+    }
+    long long requests = pool.hits() + pool.misses();
+    if (requests == 0)
+    {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(1) << "Buffers reutilizados: " << 100.0 * pool.hits() / requests
+              << "% (" << pool.misses() << " asignaciones, " << pool.evictions() << " buffers de otra clase sustituidos, "
+              << pool.overflows() << " fuera del pool)\n";
+    std::cout << std::fixed << std::setprecision(1) << "Fragmentación interna: "
+              << 100.0 * (1.0 - static_cast<double>(pool.requestedBytes()) / pool.reservedBytes())
+              << "% de los bytes reservados sin usar\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "Memoria retenida por el pool: " << pool.pooledBytes() / (1024.0 * 1024.0) << " MB\n";
+    for (const FramePool::ClassStats &stats : pool.classStats())
+    {
+        long long class_requests = stats.hits + stats.misses;
+        std::cout << std::fixed << std::setprecision(0) << "  Clase de " << stats.bytes / 1024.0 << " KB: "
+                  << stats.buffers << " buffers, " << class_requests << " peticiones, " << std::setprecision(1)
+                  << 100.0 * stats.hits / class_requests << "% reutilizadas\n";
+    }
+}
+
+/**
+ * @brief Prints the summary of an ingest run (--ingest).
+ */
+void printIngestSummary(const ThreadArgs &args, const Pipeline &pipeline, const IngestGenerator &ingest,
+                        double ingest_time_seconds)
+{
+    std::cout << "--- Resumen ingesta (hilo receptor) ---\n";
+    std::cout << "Origen: " << args.ingest_source << ":" << args.ingest_target << "\n";
+    std::cout << "Imágenes recibidas y encoladas: " << pipeline.counters().generated.load() << "\n";
+    std::cout << "Imágenes perdidas antes de recibirlas (anillo sobrescrito): " << ingest.framesLost() << "\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "Tiempo de ingesta del hilo: " << ingest_time_seconds << " segundos\n";
+    if (ingest_time_seconds > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "FPS efectivo de ingesta: " << pipeline.counters().generated.load() / ingest_time_seconds << "\n";
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Throughput recibido: " << ingest.bytesReceived() / (1024.0 * 1024.0) / ingest_time_seconds << " MB/s\n";
+    }
+}
+
+/**
+ * @brief Prints the summary of a replay run (--replay).
+ */
+void printReplaySummary(const ThreadArgs &args, const Pipeline &pipeline, const ReplayGenerator &replay,
+                        double replay_time_seconds)
+{
+    std::cout << "--- Resumen reproducción (hilo reproductor) ---\n";
+    std::cout << "Directorio de origen: " << args.replay_directory << " (" << replay.frameCount() << " imágenes)\n";
+    std::cout << "Imágenes reproducidas y encoladas: " << pipeline.counters().generated.load() << "\n";
+    std::cout << "Imágenes descartadas por atraso (no encoladas): " << pipeline.counters().late.load() << "\n";
+    std::cout << "Imágenes que no se pudieron decodificar: " << replay.decodeFailures() << "\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "Tiempo de reproducción del hilo: " << replay_time_seconds << " segundos\n";
+    if (replay_time_seconds > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "FPS efectivo de reproducción: " << pipeline.counters().generated.load() / replay_time_seconds << "\n";
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Lectura de origen: " << replay.bytesRead() / (1024.0 * 1024.0) / replay_time_seconds << " MB/s\n";
+    }
+    if (replay.decodeNs() > 0)
+    {
+        // Decode capacity of the whole pool if decoding were the only work.
+        double decoded = static_cast<double>(replay.filesDecoded());
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Capacidad de decodificación (" << replay.threads() << " hilos): "
+                  << decoded * replay.threads() / (replay.decodeNs() / 1e9) << " FPS\n";
+    }
+}
+
+/**
+ * @brief Prints the summary of the shared-memory ring (--shm-ring).
+ */
+void printShmRingSummary(const ThreadArgs &args, const ShmRingGenerator &generator, double generation_time_seconds)
+{
+    const ShmRingProducer &ring = generator.ring();
+    double published_mb = generator.bytesPublished() / (1024.0 * 1024.0);
+    std::cout << "\n--- Resumen anillo de memoria compartida ---\n";
+    std::cout << "Anillo: " << args.shm_ring_name << " (" << ring.slotCount() << " slots de "
+              << ring.slotBytes() << " bytes)\n";
+    std::cout << "Frames publicados: " << ring.published() << "\n";
+    std::cout << "Frames leídos por el consumidor: " << ring.consumed() << "\n";
+    std::cout << "Slots sobrescritos sin consumir (overruns): " << ring.overruns() << "\n";
+    std::cout << "Frames codificados demasiado grandes para un slot: " << generator.framesTooLarge() << "\n";
+    if (generation_time_seconds > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Throughput publicado: " << published_mb / generation_time_seconds << " MB/s\n";
+    }
+}
+
+/**
+ * @brief Function executed by the image generator thread.
+ * 
+ * Generates images at the pipeline's target FPS for a specified duration (see
+ * Pipeline::generate()) and prints the generation summary. In fused mode it only hands out
+ * frame indices and deadlines; the saver threads generate the frames. In ingest and replay
+ * modes the generator receives or reads the frames instead, and their own summary is printed.
+ * 
+ * @param args ThreadArgs structure containing generation parameters.
+ * @param pipeline Pipeline receiving the frames.
+ * @param generator Source of the frames; it must outlive the pipeline's savers (fused mode).
+ */
+void imageGenerator(ThreadArgs args, Pipeline &pipeline, FrameGenerator &generator)
+{
+    auto start_generation_timer = std::chrono::steady_clock::now();
+    // Calculate the time when the generation should stop.
+    auto end_time = start_generation_timer + std::chrono::seconds(args.duration_seconds);
+
+    pipeline.generate(generator, end_time);
+
+    // Calculate and print generation summary.
+    const PipelineCounters &counters = pipeline.counters();
+    double generation_time_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_generation_timer).count();
+    if (auto *ingest = dynamic_cast<const IngestGenerator *>(&generator))
+    {
+        printIngestSummary(args, pipeline, *ingest, generation_time_seconds);
+        return;
+    }
+    if (auto *replay = dynamic_cast<const ReplayGenerator *>(&generator))
+    {
+        printReplaySummary(args, pipeline, *replay, generation_time_seconds);
+        return;
+    }
+    double effective_fps = 0;
+    if (generation_time_seconds > 0)
+    {
+        effective_fps = counters.generated.load() / generation_time_seconds;
+    }
+
+    std::cout << "--- Resumen generación (hilo generador) ---\n";
+    std::cout << "Imágenes objetivo a generar: " << args.totalImages << "\n";
+    std::cout << "Imágenes realmente generadas y encoladas: " << counters.generated.load() << "\n";
+    std::cout << "Imágenes descartadas por atraso (no encoladas): " << counters.late.load() << "\n";
+    if (pipeline.demandDriven())
+    {
+        std::cout << "Imágenes sin demanda (destinos llenos, no generadas): " << counters.undemanded.load() << "\n";
+    }
+    if (pipeline.batchSize() > 1)
+    {
+        std::cout << "Lotes generados: " << counters.batches.load() << " de hasta " << pipeline.batchSize()
+                  << " frames (una espera y un bloqueo por cola por lote)\n";
+    }
+    std::cout << std::fixed << std::setprecision(2)
+              << "Tiempo de generación del hilo: " << generation_time_seconds << " segundos\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "FPS efectivo generación (reloj del hilo): " << effective_fps << "\n";
+    if (auto *variable = dynamic_cast<const VariableSizeGenerator *>(&generator))
+    {
+        printVariableSizeSummary(*variable);
+    }
+    if (auto *ring = dynamic_cast<ShmRingGenerator *>(&generator))
+    {
+        printShmRingSummary(args, *ring, generation_time_seconds);
+        ring->close(); // Signals consumers that no more frames will arrive.
+    }
+}
+
+/**
+ * @brief Reads a whole file into `buffer` with plain read() calls.
+ * @return false if the file could not be opened or read.
+ */
+bool readWholeFile(const std::string &path, std::vector<uchar> &buffer)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0;
+    if (ok)
+    {
+        buffer.resize(static_cast<size_t>(st.st_size));
+        ok = st.st_size == 0 || frameSocketReadFully(fd, buffer.data(), buffer.size());
+    }
+    ::close(fd);
+    return ok;
+}
+
+/**
+ * @brief Asks the kernel to start loading a file into the page cache in the background.
+ * @param advice "fadvise" (posix_fadvise WILLNEED) or "readahead" (Linux readahead()).
+ */
+void hintFileAhead(const std::string &path, const std::string &advice)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    if (advice == "fadvise")
+    {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+    else
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+        {
+            ::readahead(fd, 0, static_cast<size_t>(st.st_size));
+        }
+    }
+    ::close(fd);
+}
+
+#ifdef VFIG_HAVE_ZLIB
+/**
+ * @brief Read benchmark of a delta-frame container: decodes every frame in order, then decodes
+ *        frames at random positions to measure the cost of seeking through the keyframes.
+ * @return Process exit code.
+ */
+int runDeltaReadBenchmark(const ThreadArgs &args)
+{
+    DeltaReader reader;
+    std::string error;
+    if (!reader.open(args.read_bench_path, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    const DeltaFileHeader &header = reader.header();
+    std::cout << "--- Resumen benchmark de lectura (" << args.read_bench_path << ") ---\n";
+    std::cout << "Frames: " << reader.frameCount() << " de " << header.width << "x" << header.height
+              << ", keyframe cada " << header.key_interval << "\n";
+    if (reader.frameCount() == 0)
+    {
+        return 0;
+    }
+
+    cv::Mat frame;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < reader.frameCount(); ++p)
+    {
+        if (!reader.read(p, frame, error))
+        {
+            std::cerr << "Error: frame " << p << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double raw_mb = reader.frameCount() * frame.total() * frame.elemSize() / (1024.0 * 1024.0);
+    std::cout << std::fixed << std::setprecision(2)
+              << "Secuencial: " << reader.frameCount() / seconds << " frames/s, " << raw_mb / seconds
+              << " MB/s decodificados, " << reader.bytesRead() / (1024.0 * 1024.0) / seconds << " MB/s leídos\n";
+
+    // Random access: each read goes back to the nearest keyframe, so its cost grows with the
+    // distance from it (on average half the keyframe interval).
+    const int samples = static_cast<int>(std::min<size_t>(100, reader.frameCount()));
+    cv::RNG rng(12345);
+    long long records_before = reader.recordsDecoded();
+    start = std::chrono::steady_clock::now();
+    for (int k = 0; k < samples; ++k)
+    {
+        size_t position = static_cast<size_t>(rng.uniform(0, static_cast<int>(reader.frameCount())));
+        if (!reader.read(position, frame, error))
+        {
+            std::cerr << "Error: frame " << position << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(3)
+              << "Acceso aleatorio: " << seconds * 1000.0 / samples << " ms por frame ("
+              << std::setprecision(1) << static_cast<double>(reader.recordsDecoded() - records_before) / samples
+              << " registros decodificados de media, " << samples << " muestras)\n";
+    return 0;
+}
+#endif
+
+/**
+ * @brief Read benchmark of a chunked container: --readers threads each take the next frame
+ *        and decompress its blocks, so decompression runs in parallel across frames.
+ * @return Process exit code.
+ */
+int runChunkReadBenchmark(const ThreadArgs &args)
+{
+    ChunkReader reader;
+    std::string error;
+    if (!reader.open(args.read_bench_path, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    std::atomic<size_t> next_frame{0};
+    std::atomic<long long> stored_bytes{0};
+    std::atomic<long long> raw_bytes{0};
+    std::atomic<int> failures{0};
+    auto decoder = [&]() {
+        cv::Mat frame; // Reused for every frame decoded by this thread.
+        std::string decode_error;
+        size_t p;
+        while ((p = next_frame++) < reader.frameCount())
+        {
+            uint64_t stored = 0;
+            if (!reader.read(p, frame, stored, decode_error))
+            {
+                std::cerr << "Error: frame " << p << ": " << decode_error << std::endl;
+                failures++;
+                continue;
+            }
+            stored_bytes += static_cast<long long>(stored);
+            raw_bytes += static_cast<long long>(frame.total() * frame.elemSize());
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < args.read_threads; ++t)
+    {
+        threads.emplace_back(decoder);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "--- Resumen benchmark de lectura (" << args.read_bench_path << ") ---\n";
+    std::cout << "Frames: " << reader.frameCount() << ", códec " << chunkCodecName(reader.header().codec)
+              << ", bloques de " << reader.header().block_bytes / 1024 << " KB, " << args.read_threads << " hilos\n";
+    std::cout << "Errores: " << failures.load() << "\n";
+    if (seconds > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Frames por segundo: " << reader.frameCount() / seconds << "\n"
+                  << "Leído: " << stored_bytes.load() / (1024.0 * 1024.0) / seconds << " MB/s, descomprimido: "
+                  << raw_bytes.load() / (1024.0 * 1024.0) / seconds << " MB/s\n";
+    }
+    return failures.load() > 0 ? 1 : 0;
+}
+
+/**
+ * @brief Read-back benchmark: loads previously written output with several reader threads
+ *        and reports read MB/s and decoded frames/s.
+ *
+ * Each reader claims the next file, optionally hints the page cache about the file
+ * `read_prefetch` positions ahead, reads the file fully and optionally decodes it.
+ *
+ * @param args ThreadArgs structure containing the read-benchmark options.
+ * @return Process exit code.
+ */
+int runReadBenchmark(const ThreadArgs &args)
+{
+    if (fs::is_regular_file(args.read_bench_path) && fs::path(args.read_bench_path).extension() == ".vfc")
+    {
+        return runChunkReadBenchmark(args);
+    }
+    if (fs::is_regular_file(args.read_bench_path) && fs::path(args.read_bench_path).extension() == ".vfd")
+    {
+#ifdef VFIG_HAVE_ZLIB
+        return runDeltaReadBenchmark(args);
+#else
+        std::cerr << "Error: Compilado sin zlib; no se pueden leer archivos .vfd." << std::endl;
+        return 1;
+#endif
+    }
+    if (!fs::is_directory(args.read_bench_path))
+    {
+        std::cerr << "Error: No existe el directorio a leer: " << args.read_bench_path << std::endl;
+        return 1;
+    }
+    std::vector<fs::path> files = listReplayFiles(args.read_bench_path);
+    if (files.empty())
+    {
+        std::cerr << "Error: No hay imágenes en " << args.read_bench_path << std::endl;
+        return 1;
+    }
+
+    if (args.read_drop_cache)
+    {
+        // Only clean pages can be dropped; the files were closed by whoever wrote them.
+        for (const fs::path &file : files)
+        {
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0)
+            {
+                ::fdatasync(fd);
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                ::close(fd);
+            }
+        }
+    }
+
+    std::atomic<size_t> next_file{0};
+    std::atomic<long long> bytes_read{0};
+    std::atomic<int> files_read{0};
+    std::atomic<int> frames_decoded{0};
+    std::atomic<int> failures{0};
+    std::atomic<long long> read_ns{0};
+    std::atomic<long long> decode_ns{0};
+
+    auto reader = [&]() {
+        std::vector<uchar> buffer; // Reused for every file read by this thread.
+        size_t i;
+        while ((i = next_file++) < files.size())
+        {
+            if (args.read_advice != "none" && i + args.read_prefetch < files.size())
+            {
+                hintFileAhead(files[i + args.read_prefetch].string(), args.read_advice);
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (!readWholeFile(files[i].string(), buffer))
+            {
+                failures++;
+                continue;
+            }
+            auto read_done = std::chrono::steady_clock::now();
+            read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(read_done - start).count();
+            bytes_read += static_cast<long long>(buffer.size());
+            files_read++;
+            if (args.read_decode)
+            {
+                cv::Mat image = cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+                decode_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - read_done).count();
+                if (image.empty())
+                {
+                    failures++;
+                }
+                else
+                {
+                    frames_decoded++;
+                }
+            }
+        }
+    };
+
+    if (args.read_advice != "none")
+    {
+        // Warm up the first window so the readers do not start cold.
+        for (size_t i = 0; i < files.size() && i < static_cast<size_t>(args.read_prefetch); ++i)
+        {
+            hintFileAhead(files[i].string(), args.read_advice);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> readers;
+    for (int t = 0; t < args.read_threads; ++t)
+    {
+        readers.emplace_back(reader);
+    }
+    for (std::thread &t : readers)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = bytes_read.load() / (1024.0 * 1024.0);
+
+    std::cout << "--- Resumen benchmark de lectura ---\n";
+    std::cout << "Origen: " << args.read_bench_path << " (" << files.size() << " archivos)\n";
+    std::cout << "Hilos lectores: " << args.read_threads << ", aviso de caché: " << args.read_advice
+              << (args.read_advice != "none" ? " (" + std::to_string(args.read_prefetch) + " archivos por delante)" : "")
+              << ", decodificación: " << (args.read_decode ? "sí" : "no")
+              << (args.read_drop_cache ? ", caché vaciada al inicio" : "") << "\n";
+    std::cout << "Archivos leídos: " << files_read.load() << " (" << std::fixed << std::setprecision(2) << megabytes << " MB)\n";
+    std::cout << "Errores de lectura/decodificación: " << failures.load() << "\n";
+    std::cout << std::fixed << std::setprecision(2) << "Tiempo total: " << elapsed << " segundos\n";
+    if (elapsed > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Throughput de lectura: " << megabytes / elapsed << " MB/s (" << files_read.load() / elapsed << " archivos/s)\n";
+        if (args.read_decode)
+        {
+            std::cout << std::fixed << std::setprecision(2)
+                      << "Frames decodificados por segundo: " << frames_decoded.load() / elapsed << "\n";
+        }
+    }
+    if (files_read.load() > 0)
+    {
+        std::cout << std::fixed << std::setprecision(3)
+                  << "Tiempo medio por archivo: lectura " << read_ns.load() / 1e6 / files_read.load() << " ms";
+        if (args.read_decode)
+        {
+            std::cout << ", decodificación " << decode_ns.load() / 1e6 / files_read.load() << " ms";
+        }
+        std::cout << "\n";
+    }
+    return failures.load() == 0 ? 0 : 1;
+}
+
+/**
+ * @brief YUV benchmark mode (--yuv-bench): converts random BGR frames of the requested size to
+ *        NV12 and I420 with the built-in converter and with cv::cvtColor, and compares them.
+ * @return Process exit code.
+ */
+int runYuvBenchmark(const ThreadArgs &args)
+{
+    if (args.width <= 0 || args.height <= 0 || args.width % 2 != 0 || args.height % 2 != 0)
+    {
+        std::cerr << "Error: El benchmark YUV requiere ancho y alto positivos y pares." << std::endl;
+        return 1;
+    }
+    cv::Mat frame = generateRandomImage(args.width, args.height);
+    std::cout << "--- Benchmark conversión BGR -> YUV 4:2:0 (" << args.width << "x" << args.height
+              << ", " << args.yuv_bench_frames << " frames) ---\n";
+    for (Yuv420Layout layout : {Yuv420Layout::NV12, Yuv420Layout::I420})
+    {
+        cv::Mat ours, reference;
+        double ms[2];
+        for (int variant = 0; variant < 2; ++variant)
+        {
+            cv::Mat &dst = variant == 0 ? ours : reference;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < args.yuv_bench_frames; ++i)
+            {
+                if (variant == 0)
+                {
+                    bgrToYuv420(frame, dst, layout);
+                }
+                else
+                {
+                    bgrToYuv420OpenCV(frame, dst, layout);
+                }
+            }
+            ms[variant] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / args.yuv_bench_frames;
+        }
+        // Largest difference in any Y/U/V sample between the two converters.
+        int max_diff = 0;
+        for (size_t i = 0; i < ours.total(); ++i)
+        {
+            max_diff = std::max(max_diff, std::abs(ours.data[i] - reference.data[i]));
+        }
+        std::cout << std::fixed << std::setprecision(3)
+                  << (layout == Yuv420Layout::NV12 ? "NV12" : "I420") << ": propio " << ms[0] << " ms/frame, cv::cvtColor "
+                  << ms[1] << " ms/frame (x" << std::setprecision(2) << ms[1] / ms[0] << "), diferencia máxima "
+                  << max_diff << "\n";
+    }
+    return 0;
+}
+
+/**
+ * @brief With disk sinks writing directly and others publishing atomically (see the README's
+ *        "Atomic File Publishing"), prints both times per frame and the difference, over all of
+ *        them. Sinks wrapped by a simulation decorator are left out.
+ */
+void printPublishComparison(const Pipeline &pipeline)
+{
+    DiskSink::PublishTimes direct, atomic;
+    for (const auto &route : pipeline.routes())
+    for (const auto &channel : route->channels)
+    {
+        const DiskSink *disk = dynamic_cast<const DiskSink *>(channel->sink.get());
+        if (!disk)
+        {
+            continue;
+        }
+        for (auto pair : {std::make_pair(&direct, disk->directTimes()), std::make_pair(&atomic, disk->atomicTimes())})
+        {
+            pair.first->frames += pair.second.frames;
+            pair.first->encode_ns += pair.second.encode_ns;
+            pair.first->write_ns += pair.second.write_ns;
+        }
+    }
+    if (direct.frames == 0 || atomic.frames == 0)
+    {
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(3) << "Publicación atómica frente a escritura directa (por frame): codificación "
+              << atomic.encodeMs() << " / " << direct.encodeMs() << " ms, escritura " << atomic.writeMs() << " / "
+              << direct.writeMs() << " ms, diferencia " << std::showpos
+              << (atomic.encodeMs() + atomic.writeMs()) - (direct.encodeMs() + direct.writeMs()) << std::noshowpos << " ms\n";
+}
+
+/**
+ * @brief Watermark verification mode (--verify-watermarks): reads the watermark of every image
+ *        in a directory, taking the file's modification time as the moment it was consumed, and
+ *        reports latency, duplicates, reordering and gaps.
+ * @return Process exit code: 1 if a frame was duplicated, unmarked or under another frame's name.
+ *         Reordering and gaps are reported only: parallel savers and drop policies cause them.
+ */
+int runWatermarkVerification(const ThreadArgs &args)
+{
+    if (!fs::is_directory(args.verify_watermarks_path))
+    {
+        std::cerr << "Error: No existe el directorio a verificar: " << args.verify_watermarks_path << std::endl;
+        return 1;
+    }
+    // Files in the order they were written.
+    struct WrittenFile
+    {
+        fs::path path;
+        int64_t mtime_ns;
+    };
+    std::vector<WrittenFile> files;
+    for (const fs::path &path : listReplayFiles(args.verify_watermarks_path))
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0)
+        {
+            files.push_back({path, static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec});
+        }
+    }
+    std::stable_sort(files.begin(), files.end(),
+                     [](const WrittenFile &a, const WrittenFile &b) { return a.mtime_ns < b.mtime_ns; });
+    if (files.empty())
+    {
+        std::cerr << "Error: No hay imágenes en " << args.verify_watermarks_path << std::endl;
+        return 1;
+    }
+
+    WatermarkAudit audit;
+    timespec tick;
+    clock_getres(CLOCK_REALTIME_COARSE, &tick); // Resolution of file modification times.
+    int64_t tick_ns = static_cast<int64_t>(tick.tv_sec) * 1000000000LL + tick.tv_nsec;
+    audit.setTolerance(2 * tick_ns);
+    int from_metadata = 0;
+    int from_pixels = 0;
+    int name_mismatch = 0;
+    for (const WrittenFile &file : files)
+    {
+        std::ifstream in(file.path, std::ios::binary);
+        std::vector<uchar> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        // The metadata is cheap to find; the pixels are only decoded for files without it.
+        Watermark mark;
+        if (readWatermarkMetadata(bytes.data(), bytes.size(), mark))
+        {
+            from_metadata++;
+        }
+        else if (readWatermark(cv::imdecode(bytes, cv::IMREAD_UNCHANGED), mark))
+        {
+            from_pixels++;
+        }
+        else
+        {
+            audit.recordUnmarked();
+            continue;
+        }
+        // Names written by the disk sinks: image_<index>[_l<level>].<ext>
+        int index = -1;
+        int level = 0;
+        if (std::sscanf(file.path.stem().c_str(), "image_%d_l%d", &index, &level) >= 1 && index != mark.index)
+        {
+            name_mismatch++;
+        }
+        audit.record(mark, file.mtime_ns, level);
+    }
+
+    std::cout << "--- Verificación de marcas de agua (" << args.verify_watermarks_path << ") ---\n";
+    std::cout << "Archivos: " << files.size() << " (marca en metadatos: " << from_metadata
+              << ", marca en píxeles: " << from_pixels << ")\n";
+    std::cout << std::fixed << std::setprecision(3) << "Consumo = fecha de modificación del archivo (resolución "
+              << tick_ns / 1e6 << " ms); orden = orden de escritura\n";
+    std::cout << audit.report();
+    if (name_mismatch > 0)
+    {
+        std::cout << "    Índice del nombre distinto del de la marca: " << name_mismatch << "\n";
+    }
+    // Several savers and the drop policies reorder and skip frames in a healthy run, so only
+    // frames that cannot come from a correct pipeline count as errors.
+    bool clean = audit.duplicates() == 0 && audit.unmarked() == 0 && name_mismatch == 0;
+    std::cout << (clean ? "Resultado: correcto" : "Resultado: con incidencias")
+              << " (el desorden y los huecos no cuentan como incidencias)\n";
+    return clean ? 0 : 1;
+}
+
+/**
+ * @brief Handles SIGINT, SIGTERM and SIGUSR1 for `pipeline`, which every other thread has
+ *        blocked, until `stop` is set. Being an ordinary thread (sigtimedwait, not a signal handler), it can
+ *        format and write reports freely.
+ *
+ * SIGUSR1 appends a Pipeline::dumpLiveStats() snapshot to `stats_file` (stderr if empty).
+ *
+ * On SIGINT/SIGTERM (recorded in `stop_signal`) the producer stops and the pipeline drains normally. If it has not
+ * finished `drain_deadline` seconds later (or a second signal arrives), the frames still queued
+ * or in transit are abandoned and counted, and the savers only finish the frames in hand.
+ */
+void signalWatcher(Pipeline &pipeline, double drain_deadline, std::string stats_file, std::atomic<int> &stop_signal,
+                   std::atomic<bool> &stop)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    timespec poll_interval = {0, 100 * 1000 * 1000}; // Re-check `stop` and the deadline every 100 ms.
+    std::chrono::steady_clock::time_point deadline;
+    while (!stop)
+    {
+        int signal = ::sigtimedwait(&signals, nullptr, &poll_interval);
+        auto now = std::chrono::steady_clock::now();
+        if (signal == SIGUSR1)
+        {
+            if (stats_file.empty())
+            {
+                pipeline.dumpLiveStats(std::cerr);
+            }
+            else
+            {
+                std::ofstream out(stats_file, std::ios::app);
+                pipeline.dumpLiveStats(out);
+                if (!out)
+                {
+                    std::cerr << "Advertencia: No se pudieron escribir las estadísticas en " << stats_file << std::endl;
+                }
+            }
+        }
+        if (signal == SIGINT || signal == SIGTERM)
+        {
+            if (!pipeline.stopRequested())
+            {
+                stop_signal = signal;
+                deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                     std::chrono::duration<double>(drain_deadline));
+                pipeline.requestStop();
+                std::cerr << "\n" << (signal == SIGINT ? "SIGINT" : "SIGTERM")
+                          << " recibida: se detiene la generación y se vacían las colas (plazo " << drain_deadline
+                          << " s; otra señal abandona lo pendiente)" << std::endl;
+            }
+            else
+            {
+                deadline = now;
+            }
+        }
+        if (pipeline.stopRequested() && !pipeline.abandoning() && now >= deadline)
+        {
+            std::cerr << "Plazo de vaciado vencido: se abandonan las imágenes pendientes" << std::endl;
+            pipeline.abandonPending();
+        }
+    }
+}
+
+/**
+ * @brief Finds the route named by a control command argument (its number in "Resumen por destino").
+ * @return The route number, or -1 with `reply` set.
+ */
+long controlRoute(const Pipeline &pipeline, const std::string &text, std::string &reply)
+{
+    const auto &routes = pipeline.routes();
+    try
+    {
+        size_t r = static_cast<size_t>(std::stoul(text));
+        if (r < routes.size())
+        {
+            return static_cast<long>(r);
+        }
+    }
+    catch (...)
+    {
+    }
+    reply = "ERR destino inexistente: " + text + " (0-" + std::to_string(static_cast<int>(routes.size()) - 1) + ")";
+    return -1;
+}
+
+/**
+ * @brief Executes one line of the control protocol and returns the reply line.
+ *
+ * Changes apply to frames that have not been written yet; frames in flight are never paused.
+ */
+std::string handleControlCommand(Pipeline &pipeline, const std::string &line)
+{
+    std::istringstream tokens(line);
+    std::string command, target, value, extra;
+    tokens >> command >> target >> value >> extra;
+    std::string reply;
+    try
+    {
+        if (command == "fps" && !target.empty() && value.empty())
+        {
+            double fps = std::stod(target);
+            if (fps <= 0)
+            {
+                return "ERR fps debe ser positivo";
+            }
+            pipeline.setTargetFps(fps);
+            return "OK fps " + target;
+        }
+        if (command == "savers" && !value.empty() && extra.empty())
+        {
+            long route = controlRoute(pipeline, target, reply);
+            int wanted = std::stoi(value);
+            if (route < 0) return reply;
+            std::string error;
+            if (!pipeline.setSaverCount(static_cast<size_t>(route), wanted, error)) return "ERR " + error;
+            return "OK savers " + target + " " + value;
+        }
+        if ((command == "drop" || command == "queue") && !value.empty() && extra.empty())
+        {
+            long route = controlRoute(pipeline, target, reply);
+            if (route < 0) return reply;
+            DropPolicy policy = DropPolicy::Oldest;
+            if (command == "drop" && !parseDropPolicy(value, policy)) return "ERR drop debe ser oldest, newest o block";
+            if (command == "queue" && std::stoi(value) < 1) return "ERR queue debe ser positivo";
+            if (command == "drop" && !pipeline.setDropPolicy(static_cast<size_t>(route), policy))
+            {
+                return "ERR con --demand los destinos solo admiten drop block";
+            }
+            if (command == "queue")
+            {
+                pipeline.setQueueLimit(static_cast<size_t>(route), static_cast<size_t>(std::stoi(value)));
+            }
+            return "OK " + command + " " + target + " " + value;
+        }
+        if (command == "set" && !extra.empty())
+        {
+            long route = controlRoute(pipeline, target, reply);
+            std::string parameter = value; // "set <destino> <parámetro> <valor>": extra holds the value.
+            if (route < 0) return reply;
+            std::string error;
+            for (auto &channel : pipeline.routes()[static_cast<size_t>(route)]->channels)
+            {
+                if (!channel->sink->setParameter(parameter, extra, error)) return "ERR " + error;
+            }
+            return "OK set " + target + " " + parameter + " " + extra;
+        }
+        if (command == "status" && target.empty())
+        {
+            std::ostringstream out;
+            out << "OK fps " << pipeline.targetFps() << " generadas " << pipeline.counters().generated.load()
+                << " guardadas " << pipeline.counters().saved.load();
+            for (size_t r = 0; r < pipeline.routes().size(); ++r)
+            for (auto &channel : pipeline.routes()[r]->channels)
+            {
+                std::lock_guard<std::mutex> lock(channel->queueMutex);
+                out << " | [" << r << "] " << channel->sink->describe() << " hilos " << channel->num_threads
+                    << " cola " << channel->imageQueue.size() << "/" << channel->max_queue_size << " drop "
+                    << dropPolicyName(channel->drop_policy) << " guardadas "
+                    << channel->saved.load() << " descartadas " << channel->dropped.load();
+            }
+            return out.str();
+        }
+        if (command == "help" && target.empty())
+        {
+            return "OK fps <n> | savers <destino> <n> | drop <destino> oldest|newest|block | queue <destino> <n> | "
+                   "set <destino> jpeg_quality|png_compression|webp_quality|publish <valor> | status";
+        }
+    }
+    catch (...)
+    {
+        return "ERR valor inválido: " + line;
+    }
+    return "ERR orden desconocida: " + line + " (pruebe help)";
+}
+
+/**
+ * @brief Serves the --control socket until `stop` is set: one client at a time, one command
+ *        per line, one reply line per command.
+ */
+void controlServer(Pipeline &pipeline, int listen_fd, std::atomic<bool> &stop)
+{
+    int client = -1;
+    std::string pending;
+    while (!stop)
+    {
+        // Short poll timeouts so the thread notices `stop` promptly.
+        pollfd fds = {client >= 0 ? client : listen_fd, POLLIN, 0};
+        if (::poll(&fds, 1, 100) <= 0)
+        {
+            continue;
+        }
+        if (client < 0)
+        {
+            client = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            pending.clear();
+            continue;
+        }
+        char buffer[1024];
+        ssize_t n = ::read(client, buffer, sizeof(buffer));
+        if (n <= 0)
+        {
+            ::close(client);
+            client = -1;
+            continue;
+        }
+        pending.append(buffer, static_cast<size_t>(n));
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty())
+            {
+                continue;
+            }
+            std::string reply = handleControlCommand(pipeline, line) + "\n";
+            std::cout << "Control: " << line << " -> " << reply << std::flush;
+            ::send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+        }
+    }
+    if (client >= 0)
+    {
+        ::close(client);
+    }
+    ::close(listen_fd);
+}
+
+/**
+ * @brief Creates the output directory if it does not exist.
+ * @return false (after printing an error) if it could not be created.
+ */
+bool prepareOutputDirectory(const std::string &directory)
+{
+    if (!fs::exists(directory))
+    {
+        std::error_code ec;
+        if (!fs::create_directories(directory, ec))
+        {
+            std::cerr << "Error: No se pudo crear el directorio de salida: " << directory << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Splits a colon-separated list of directories (like PATH).
+ */
+std::vector<std::string> splitDirectoryList(const std::string &list)
+{
+    std::vector<std::string> directories;
+    std::istringstream tokens(list);
+    std::string directory;
+    while (std::getline(tokens, directory, ':'))
+    {
+        if (!directory.empty())
+        {
+            directories.push_back(directory);
+        }
+    }
+    return directories;
+}
+
+/**
+ * @brief Builds a sink route from a --sink specification.
+ *
+ * Format: <destino>[,clave=valor...] where <destino> is an image extension (saved to disk),
+ * unix:<ruta> or shm:<nombre>, and the keys are threads, queue, drop (oldest|newest|block),
+ * dir (disk sinks; several directories separated by ':' are striped), stripe (rr|adaptive)
+ * and slots (shm sinks). threads and queue apply to every directory of a striped sink.
+ *
+ * @return The route, or nullptr with `error` set.
+ */
+std::unique_ptr<SinkRoute> makeSinkRoute(const std::string &spec, const ThreadArgs &args, std::string &error)
+{
+    std::istringstream tokens(spec);
+    std::string target;
+    std::getline(tokens, target, ',');
+
+    auto route = std::make_unique<SinkRoute>();
+    route->stripe_policy = args.stripe_policy == "adaptive" ? StripePolicy::Adaptive : StripePolicy::RoundRobin;
+    std::vector<std::string> directories = args.output_directories;
+    int slots = args.shm_slots;
+    bool ordered = target.rfind("delta:", 0) == 0; // Each delta depends on the frame before it.
+    std::string publish = args.publish_mode;
+    SlowStorageConfig slow;
+    FaultInjectionConfig faults;
+    bool chunked = target.rfind("chunk:", 0) == 0;
+    bool segmented = target.rfind("segment:", 0) == 0;
+    bool single_writer = ordered || segmented || target.rfind("unix:", 0) == 0 || target.rfind("shm:", 0) == 0;
+    int num_threads = single_writer ? 1 : NUM_SAVER_THREADS; // Socket/ring writes are serialised anyway.
+    int key_interval = 30;
+    int level = 1;
+    uint32_t codec = CHUNK_CODEC_NONE;
+    chunkCodecFromName("zlib", codec); // Default block codec when zlib is available.
+    uint32_t block_kb = 256;
+    double segment_seconds = 0;
+    uint64_t segment_mb = 0;
+    size_t max_queue_size = MAX_QUEUE_SIZE;
+    DropPolicy drop_policy = DropPolicy::Oldest;
+
+    std::string option;
+    while (std::getline(tokens, option, ','))
+    {
+        size_t eq = option.find('=');
+        std::string key = option.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : option.substr(eq + 1);
+        try
+        {
+            if (key == "threads" && std::stoi(value) > 0) num_threads = std::stoi(value);
+            else if (key == "queue" && std::stoi(value) > 0) max_queue_size = static_cast<size_t>(std::stoi(value));
+            else if (key == "drop" && parseDropPolicy(value, drop_policy)) {}
+            else if (key == "dir" && !splitDirectoryList(value).empty()) directories = splitDirectoryList(value);
+            else if (key == "stripe" && (value == "rr" || value == "adaptive"))
+                route->stripe_policy = value == "rr" ? StripePolicy::RoundRobin : StripePolicy::Adaptive;
+            else if (key == "slots" && std::stoi(value) > 0) slots = std::stoi(value);
+            else if (key == "key" && std::stoi(value) > 0) key_interval = std::stoi(value);
+            else if (key == "level" && std::stoi(value) >= 1 && std::stoi(value) <= (ordered ? 9 : 22)) level = std::stoi(value);
+            else if (key == "codec" && chunkCodecFromName(value, codec)) {}
+            else if (key == "latency" && slow.parseLatency(value)) {}
+            else if (key == "bw" && std::stod(value) > 0) slow.bandwidth_mb_s = std::stod(value);
+            else if (key == "stall" && slow.parseStall(value)) {}
+            else if (key == "seed") slow.seed = faults.seed = static_cast<unsigned int>(std::stoul(value));
+            else if (key == "fail" && std::stod(value) >= 0 && std::stod(value) <= 1) faults.fail_probability = std::stod(value);
+            else if (key == "errno" && faults.parseErrors(value)) {}
+            else if (key == "short" && std::stod(value) >= 0 && std::stod(value) <= 1) faults.short_probability = std::stod(value);
+            else if (key == "hang" && faults.parseHang(value)) {}
+            else if (key == "publish" && (value == "direct" || value == "tmpfile" || value == "rename")) publish = value;
+            else if (key == "seconds" && std::stod(value) > 0) segment_seconds = std::stod(value);
+            else if (key == "mb" && std::stoi(value) > 0) segment_mb = static_cast<uint64_t>(std::stoi(value));
+            else if (key == "block" && std::stoi(value) > 0 && std::stoi(value) <= 65536) block_kb = static_cast<uint32_t>(std::stoi(value));
+            else
+            {
+                error = "opción de destino inválida: " + option;
+                return nullptr;
+            }
+        }
+        catch (...)
+        {
+            error = "valor inválido: " + option;
+            return nullptr;
+        }
+    }
+
+    if (ordered && num_threads != 1)
+    {
+        error = "un destino delta: necesita un solo hilo (threads=1)";
+        return nullptr;
+    }
+    if (segmented && num_threads != 1)
+    {
+        error = "un destino segment: escribe en orden con un solo hilo (threads=1)";
+        return nullptr;
+    }
+    if (ordered && !args.sizes_spec.empty())
+    {
+        error = "un destino delta: necesita frames del mismo tamaño (no admite --sizes)";
+        return nullptr;
+    }
+    bool watermark_metadata = args.watermark == "meta" || args.watermark == "both";
+    if (args.watermark == "meta" && !watermarkMetadataSupported(target))
+    {
+        error = "--watermark=meta solo marca destinos png y jpg en disco (use --watermark=both)";
+        return nullptr;
+    }
+
+    auto addChannel = [&](std::unique_ptr<FrameSink> sink) {
+        if (slow.enabled())
+        {
+            sink = std::make_unique<SlowSink>(std::move(sink), slow); // Simulated slow storage.
+        }
+        if (faults.enabled())
+        {
+            // Outermost, so failed writes do not wait for the simulated storage.
+            sink = std::make_unique<FaultSink>(std::move(sink), faults);
+        }
+        auto channel = std::make_unique<SinkChannel>();
+        channel->sink = std::move(sink);
+        channel->num_threads = num_threads;
+        channel->ordered = ordered || segmented; // Both append frames in queue order.
+        channel->max_queue_size = max_queue_size;
+        channel->drop_policy = drop_policy;
+        route->channels.push_back(std::move(channel));
+    };
+
+    if (target.rfind("unix:", 0) == 0)
+    {
+        auto sink = std::make_unique<SocketSink>(target.substr(5));
+        if (!sink->open(error))
+        {
+            return nullptr;
+        }
+        addChannel(std::move(sink));
+    }
+    else if (target.rfind("shm:", 0) == 0)
+    {
+        std::string name = target.substr(4);
+        name = !name.empty() && name[0] == '/' ? name : "/" + name;
+        uint64_t slot_bytes = static_cast<uint64_t>(args.width) * args.height * 3;
+        auto sink = std::make_unique<ShmSink>(name, static_cast<uint32_t>(slots), slot_bytes);
+        if (!sink->open(error))
+        {
+            return nullptr;
+        }
+        addChannel(std::move(sink));
+    }
+    else if (target == "null")
+    {
+        addChannel(std::make_unique<NullSink>());
+    }
+    else if (segmented)
+    {
+        std::string directory = target.substr(8);
+        if (!prepareOutputDirectory(directory))
+        {
+            error = "directorio de segmentos inválido: " + directory;
+            return nullptr;
+        }
+        if (segment_seconds == 0 && segment_mb == 0)
+        {
+            segment_seconds = 10;
+        }
+        // Preallocate what one segment is expected to hold: the size limit, or the raw frames
+        // of `seconds` at the target FPS, whichever is smaller.
+        double pixels = static_cast<double>(args.width) * args.height;
+        if (!args.sizes_spec.empty())
+        {
+            FrameSizeDistribution sizes;
+            sizes.parse(args.sizes_spec, cv::Size(args.width, args.height), error);
+            pixels = sizes.meanPixels();
+        }
+        uint64_t frame_bytes = static_cast<uint64_t>(pixels * 3) + sizeof(FrameSocketHeader);
+        uint64_t preallocate = segment_mb << 20;
+        if (segment_seconds > 0)
+        {
+            uint64_t expected = static_cast<uint64_t>(segment_seconds * args.fps * frame_bytes);
+            preallocate = preallocate == 0 ? expected : std::min(preallocate, expected);
+        }
+        auto sink = std::make_unique<SegmentSink>(directory, segment_seconds, segment_mb << 20, preallocate);
+        if (!sink->open(error))
+        {
+            return nullptr;
+        }
+        addChannel(std::move(sink));
+    }
+    else if (chunked)
+    {
+        auto sink = std::make_unique<ChunkSink>(target.substr(6), codec, level, block_kb * 1024);
+        if (!sink->open(error))
+        {
+            return nullptr;
+        }
+        addChannel(std::move(sink));
+    }
+    else if (ordered)
+    {
+#ifdef VFIG_HAVE_ZLIB
+        auto sink = std::make_unique<DeltaSink>(target.substr(6), key_interval, level);
+        if (!sink->open(error))
+        {
+            return nullptr;
+        }
+        addChannel(std::move(sink));
+#else
+        error = "compilado sin zlib";
+        return nullptr;
+#endif
+    }
+    else if (!target.empty() && target != "raw")
+    {
+        // One channel (queue + savers) per output directory, i.e. per device.
+        for (const std::string &directory : directories)
+        {
+            if (!prepareOutputDirectory(directory))
+            {
+                error = "directorio de salida inválido: " + directory;
+                return nullptr;
+            }
+            PublishMode mode = publish == "tmpfile" ? PublishMode::TmpFile
+                             : publish == "rename"  ? PublishMode::Rename
+                                                    : PublishMode::Direct;
+            auto sink = std::make_unique<DiskSink>(directory, target, mode);
+            sink->setWatermarkMetadata(watermark_metadata && watermarkMetadataSupported(target));
+            addChannel(std::move(sink));
+        }
+    }
+    else
+    {
+        error = "destino inválido: " + spec;
+        return nullptr;
+    }
+    return route;
+}
 
 /**
- * @brief Generates a random color image.
- * @param width Width of the image.
- * @param height Height of the image.
- * @return An OpenCV Mat object representing the generated image.
+ * @brief Prints the command-line usage, including the optional "--clave=valor" options.
  */
-cv::Mat generateRandomImage(int width, int height)
+void printUsage(const char *program)
 {
-    cv::Mat image(height, width, CV_8UC3); // Create a 3-channel (color) image.
-    // Fill the image with random pixel values (BGR order).
-    cv::randu(image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
-    return image;
+    std::cerr << "Uso: " << program << " <ancho> <alto> <duración_segundos> <fps> <extensión> [opciones]\n";
+    std::cerr << "Ejemplo: " << program << " 640 480 10 30 png\n";
+    std::cerr << "Opciones:\n";
+    std::cerr << "  --sink=<destino>[,clave=valor...]\n";
+    std::cerr << "                        Destino adicional con cola e hilos propios; se puede repetir. <destino> es una\n";
+    std::cerr << "                        extensión (disco), unix:<ruta>, shm:<nombre>, delta:<archivo.vfd>,\n";
+    std::cerr << "                        chunk:<archivo.vfc> o segment:<directorio>. Claves: threads, queue,\n";
+    std::cerr << "                        drop=oldest|newest|block, dir (disco, dir1:dir2 reparte), stripe, slots (shm),\n";
+    std::cerr << "                        key (delta, keyframe cada n), level (delta, chunk), codec=zlib|lz4|zstd|none\n";
+    std::cerr << "                        y block=<KB> (chunk), seconds y mb (segment, duración o tamaño de segmento),\n";
+    std::cerr << "                        publish (disco). null descarta los frames. Almacenamiento lento simulado en\n";
+    std::cerr << "                        cualquier destino: latency=fixed:<ms>|uniform:<min>:<max>|normal:<media>:<sd>|\n";
+    std::cerr << "                        exp:<media>|lognormal:<mediana>:<sigma>, bw=<MB/s>, stall=<cada_s>:<ms>, seed.\n";
+    std::cerr << "                        Fallos inyectados (deterministas con seed): fail=<p>, errno=EIO:ENOSPC..., short=<p>,\n";
+    std::cerr << "                        hang=<p>:<ms>.\n";
+    std::cerr << "                        Reemplaza al destino de <extensión>.\n";
+    std::cerr << "  --output-dirs=<d1:d2> Directorios de salida (uno por dispositivo) entre los que se reparten los frames\n";
+    std::cerr << "                        (por defecto generated_images); cada uno tiene su propia cola e hilos\n";
+    std::cerr << "  --stripe=<rr|adaptive> Reparto entre directorios: turnos o según cola y velocidad medida (por defecto rr)\n";
+    std::cerr << "  --publish=<modo>      direct (imwrite), tmpfile (O_TMPFILE + linkat) o rename: cómo aparecen los\n";
+    std::cerr << "                        archivos en disco; con tmpfile y rename nunca se ven a medio escribir\n";
+    std::cerr << "  --read-bench=<dir>    Benchmark de lectura: lee (y decodifica) las imágenes de un directorio (o un\n";
+    std::cerr << "                        archivo .vfd o .vfc) y termina\n";
+    std::cerr << "  --readers=<n>         Hilos lectores del benchmark de lectura (por defecto 4)\n";
+    std::cerr << "  --read-advice=<modo>  none, fadvise (POSIX_FADV_WILLNEED) o readahead para los archivos siguientes\n";
+    std::cerr << "  --read-prefetch=<n>   Archivos por delante a los que se aplica el aviso (por defecto 16)\n";
+    std::cerr << "  --decode=<0|1>        Decodificar lo leído en el benchmark de lectura (por defecto 1)\n";
+    std::cerr << "  --drop-cache          Expulsa los archivos de la caché de páginas antes de leerlos\n";
+    std::cerr << "  --shm-ring=<nombre>   Publica los frames en un anillo de memoria compartida en vez de guardarlos en disco\n";
+    std::cerr << "                        (con extensión raw se generan directamente en el slot, sin copia)\n";
+    std::cerr << "  --shm-slots=<n>       Número de slots del anillo (por defecto 64)\n";
+    std::cerr << "  --ingest=shm:<nombre> Graba los frames de un anillo de memoria compartida de otro proceso en vez de generarlos\n";
+    std::cerr << "  --ingest=unix:<ruta>  Graba los frames recibidos en un socket Unix (ver frame_socket.hpp)\n";
+    std::cerr << "  --replay=<directorio> Reenvía las imágenes de un directorio a los guardadores al FPS objetivo (transcodificación)\n";
+    std::cerr << "  --replay-threads=<n>  Hilos decodificadores en modo replay (por defecto 4)\n";
+    std::cerr << "  --replay-prefetch=<n> Frames decodificados por adelantado en modo replay (por defecto 32)\n";
+    std::cerr << "  --process=<op,...>    Procesa cada frame antes de los destinos. Operadores: resize:<factor>,\n";
+    std::cerr << "                        resize:<ancho>x<alto>, yuv, nv12, i420 (nv12:cv, i420:cv con cvtColor), gray,\n";
+    std::cerr << "                        gamma:<g>, blur:<k impar>\n";
+    std::cerr << "  --process-threads=<n> Hilos de la etapa de procesamiento (por defecto 4)\n";
+    std::cerr << "  --pyramid=<n>         Guarda además n niveles reducidos de cada frame (1/2, 1/4...) como image_<i>_l<k>\n";
+    std::cerr << "  --sizes=<tamaños>     Tamaño variable por frame, como máximo <ancho>x<alto>: lista ponderada\n";
+    std::cerr << "                        <an>x<al>[:<peso>],... (p. ej. 1280x720:2,1920x1080) o crop:<an>x<al> (recortes\n";
+    std::cerr << "                        aleatorios de ese tamaño mínimo hasta <ancho>x<alto>)\n";
+    std::cerr << "  --content=<tipo>      noise (frames independientes, por defecto) o coherent (cambia una franja por frame)\n";
+    std::cerr << "  --fused[=<ms>]        Cada guardador genera (con semilla determinista por índice) y guarda el frame que\n";
+    std::cerr << "                        le toca; el hilo generador solo reparte índices con un plazo de <ms> para\n";
+    std::cerr << "                        empezarlos (por defecto 1000)\n";
+    std::cerr << "  --batch=<k>           Genera k frames por despertar del hilo generador (un solo buffer, un bloqueo\n";
+    std::cerr << "                        por cola y lote); pensado para frames pequeños a FPS muy altos\n";
+    std::cerr << "  --demand              Genera bajo demanda: ningún destino descarta (drop=block) y cada frame se genera\n";
+    std::cerr << "                        cuando su cola tiene sitio, sin superar el FPS objetivo\n";
+    std::cerr << "  --drain-deadline=<s>  Con SIGINT/SIGTERM: segundos para vaciar las colas antes de abandonar lo\n";
+    std::cerr << "                        pendiente (por defecto 10); después se imprime el resumen completo\n";
+    std::cerr << "  --stats-file=<ruta>   Archivo al que SIGUSR1 añade una instantánea de estadísticas (por defecto stderr)\n";
+    std::cerr << "  --control=<ruta>      Socket Unix de control: fps, savers, drop, queue y parámetros del codificador\n";
+    std::cerr << "                        se cambian en marcha, una orden por línea (help las lista)\n";
+    std::cerr << "  --yuv-bench=<n>       Compara la conversión BGR -> NV12/I420 propia con cv::cvtColor en n frames y termina\n";
+    std::cerr << "  --watermark[=<modo>]  Marca cada frame con su índice y su hora de entrada: pixels (código de barras en\n";
+    std::cerr << "                        las primeras filas, por defecto), meta (texto en los PNG/JPG) o both\n";
+    std::cerr << "  --verify-watermarks=<directorio>\n";
+    std::cerr << "                        Lee las marcas de las imágenes de un directorio e informa de latencia, duplicados,\n";
+    std::cerr << "                        desorden y huecos; no genera nada\n";
 }
 
 /**
- * @brief Function executed by the image generator thread.
- * 
- * Generates images at a target FPS for a specified duration.
- * Puts generated images into a shared queue for saver threads to process.
- * Handles queue size limits and tracks generation statistics.
- * 
- * @param args ThreadArgs structure containing generation parameters.
+ * @brief Parses one optional "--clave=valor" argument into args.
+ * @return false if the option is unknown or its value is invalid. std::stoi may throw.
  */
-void imageGenerator(ThreadArgs args)
+bool parseOption(const std::string &option, ThreadArgs &args)
 {
-    auto start_generation_timer = std::chrono::steady_clock::now();
-    // Calculate the duration of a single frame based on the target FPS.
-    std::chrono::duration<double> frame_duration(1.0 / args.fps);
-
-    int i = 0; // Counter for generated images (used for indexing).
-    auto start_time = std::chrono::steady_clock::now();
-    // Calculate the time when the generation should stop.
-    auto end_time = start_time + std::chrono::seconds(args.duration_seconds);
+    size_t eq = option.find('=');
+    std::string key = option.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : option.substr(eq + 1);
 
-    // Loop until the specified duration has elapsed.
-    while (std::chrono::steady_clock::now() < end_time)
+    if (key == "--shm-ring" && !value.empty())
     {
-        auto current_time = std::chrono::steady_clock::now();
-        // Calculate the ideal time at which the next frame *should* be generated.
-        auto next_frame_time = start_time + frame_duration * (i + 1);
-
-        // --- FPS Control Logic ---
-        // If the current time is already past the ideal time for the next frame,
-        // it means we're falling behind. Skip this frame.
-        if (current_time > next_frame_time)
+        // POSIX shm names must start with a single slash.
+        args.shm_ring_name = value[0] == '/' ? value : "/" + value;
+        return true;
+    }
+    if (key == "--ingest")
+    {
+        size_t colon = value.find(':');
+        if (colon == std::string::npos || colon + 1 == value.size())
         {
-            total_images_dropped_due_to_delay++; // Increment counter for skipped frames.
-            i++; // Still increment image index to maintain sequence for subsequent frames.
-            continue; // Skip to the next iteration to try for the next frame.
+            return false;
         }
-
-        // Wait/sleep until the ideal time for the next frame arrives.
-        // This helps maintain the target FPS if generation is faster than required.
-        std::this_thread::sleep_until(next_frame_time);
-        
-        // Generate the actual image.
-        cv::Mat image = generateRandomImage(args.width, args.height);
-
-        // --- Critical Section: Accessing the shared queue ---
+        args.ingest_source = value.substr(0, colon);
+        args.ingest_target = value.substr(colon + 1);
+        if (args.ingest_source == "shm" && args.ingest_target[0] != '/')
         {
-            std::lock_guard<std::mutex> lock(queueMutex); // Lock the mutex to protect the queue.
-            // If the queue has reached its maximum allowed size, remove the oldest image.
-            if (imageQueue.size() >= MAX_QUEUE_SIZE)
-            {
-                imageQueue.pop_front(); // Remove from the front (oldest).
-            }
-            // Add the new image to the back of the queue.
-            imageQueue.push_back({image, i});
-            total_images_enqueued_count++; // Increment count of images put into the queue.
-        } // Mutex is automatically released here by lock_guard.
-
-        // Notify one or all waiting saver threads that a new image is available.
-        // notify_all() is used here; notify_one() could be an alternative if only one saver
-        // is expected to wake up and process efficiently.
-        queueCV.notify_all(); 
-        total_images_generated_count++; // Increment overall count of generated images.
-        i++; // Increment image index for the next image.
+            args.ingest_target = "/" + args.ingest_target;
+        }
+        return args.ingest_source == "shm" || args.ingest_source == "unix";
     }
-
-    // --- Post-generation: Signal savers that generation is complete ---
+    if (key == "--output-dirs")
     {
-        std::lock_guard<std::mutex> lock(queueMutex); // Lock to safely modify finishedGenerating.
-        finishedGenerating = true; // Set the flag.
+        args.output_directories = splitDirectoryList(value);
+        return !args.output_directories.empty();
     }
-    queueCV.notify_all(); // Notify all saver threads so they can check the flag and exit if queue is empty.
-
-    // Calculate and print generation summary.
-    double generation_time_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_generation_timer).count();
-    double effective_fps = 0;
-    if (generation_time_seconds > 0)
+    if (key == "--stripe")
     {
-        effective_fps = total_images_enqueued_count.load() / generation_time_seconds;
+        args.stripe_policy = value;
+        return value == "rr" || value == "adaptive";
     }
-
-    std::cout << "--- Resumen generación (hilo generador) ---\n";
-    std::cout << "Imágenes objetivo a generar: " << args.totalImages << "\n";
-    std::cout << "Imágenes realmente generadas y encoladas: " << total_images_generated_count.load() << "\n";
-    std::cout << "Imágenes descartadas por atraso (no encoladas): " << total_images_dropped_due_to_delay.load() << "\n";
-    std::cout << std::fixed << std::setprecision(2)
-              << "Tiempo de generación del hilo: " << generation_time_seconds << " segundos\n";
-    std::cout << std::fixed << std::setprecision(2)
-              << "FPS efectivo generación (reloj del hilo): " << effective_fps << "\n";
-}
-
-/**
- * @brief Function executed by each image saver thread.
- * 
- * Continuously fetches images from the shared queue and saves them to disk
- * until the generator signals completion and the queue is empty.
- * 
- * @param args ThreadArgs structure containing output directory and image extension.
- * @param saver_id A unique ID for the saver thread (for logging purposes).
- */
-void imageSaver(ThreadArgs args, int saver_id)
-{
-    while (true)
+    if (key == "--publish")
     {
-        std::unique_lock<std::mutex> lock(queueMutex); // Acquire lock to check queue and wait.
-        // Wait on the condition variable. The thread will sleep until:
-        // 1. The queue is not empty (an image is available), OR
-        // 2. The `finishedGenerating` flag is true (generator is done).
-        // The lambda predicate prevents spurious wakeups.
-        queueCV.wait(lock, []
-                     { return !imageQueue.empty() || finishedGenerating; });
-
-        // --- Process images currently in the queue ---
-        // This inner loop ensures all available images are processed after a wakeup
-        // before re-evaluating the main loop condition (especially `finishedGenerating`).
-        while (!imageQueue.empty())
-        {
-            ImageData imgData = imageQueue.front(); // Get image from the front of the queue.
-            imageQueue.pop_front();                 // Remove it from the queue.
-            lock.unlock(); // IMPORTANT: Unlock the mutex while saving the image (I/O bound, can be slow).
-                           // This allows other savers or the generator to access the queue.
-
-            // Construct the filename.
-            std::string filename = args.output_directory + "/image_" + std::to_string(imgData.index) + "." + args.image_extension;
-            // Save the image to disk. Uses OpenCV's default settings for the given extension.
-            bool success = cv::imwrite(filename, imgData.image); 
-
-            if (success)
-            {
-                total_images_saved_count++; // Increment global counter for saved images.
-            }
-            else
-            {
-                std::cerr << "Error: Hilo guardador " << saver_id << " no pudo guardar la imagen: " << filename << std::endl;
-            }
-
-            lock.lock(); // Re-acquire the lock before checking imageQueue.empty() in the loop condition
-                         // and before potentially waiting on queueCV again.
-        }
-
-        // --- Exit Condition for Saver Thread ---
-        // If image generation is finished AND the queue is now empty, the saver can exit.
-        if (finishedGenerating && imageQueue.empty())
+        args.publish_mode = value;
+        return value == "direct" || value == "tmpfile" || value == "rename";
+    }
+    if (key == "--sink" && !value.empty())
+    {
+        args.sink_specs.push_back(value);
+        return true;
+    }
+    if (key == "--read-bench" && !value.empty())
+    {
+        args.read_bench_path = value;
+        return true;
+    }
+    if (key == "--readers")
+    {
+        args.read_threads = std::stoi(value);
+        return args.read_threads > 0;
+    }
+    if (key == "--read-advice")
+    {
+        args.read_advice = value;
+        return value == "none" || value == "fadvise" || value == "readahead";
+    }
+    if (key == "--read-prefetch")
+    {
+        args.read_prefetch = std::stoi(value);
+        return args.read_prefetch > 0;
+    }
+    if (key == "--decode")
+    {
+        args.read_decode = std::stoi(value) != 0;
+        return true;
+    }
+    if (key == "--drop-cache" && value.empty())
+    {
+        args.read_drop_cache = true;
+        return true;
+    }
+    if (key == "--replay" && !value.empty())
+    {
+        args.replay_directory = value;
+        return true;
+    }
+    if (key == "--replay-threads")
+    {
+        args.replay_threads = std::stoi(value);
+        return args.replay_threads > 0;
+    }
+    if (key == "--replay-prefetch")
+    {
+        args.replay_prefetch = std::stoi(value);
+        return args.replay_prefetch > 0;
+    }
+    if (key == "--process" && !value.empty())
+    {
+        args.process_spec = value;
+        return true;
+    }
+    if (key == "--process-threads")
+    {
+        args.process_threads = std::stoi(value);
+        return args.process_threads > 0;
+    }
+    if (key == "--pyramid")
+    {
+        args.pyramid_levels = std::stoi(value);
+        return args.pyramid_levels > 0 && args.pyramid_levels <= MAX_PYRAMID_LEVELS;
+    }
+    if (key == "--stats-file" && !value.empty())
+    {
+        args.stats_file = value;
+        return true;
+    }
+    if (key == "--drain-deadline")
+    {
+        args.drain_deadline = std::stod(value);
+        return args.drain_deadline >= 0;
+    }
+    if (key == "--control" && !value.empty())
+    {
+        args.control_path = value;
+        return true;
+    }
+    if (key == "--fused")
+    {
+        args.fused = true;
+        if (!value.empty())
         {
-            break; // Exit the while(true) loop.
+            args.fused_deadline_ms = std::stod(value);
         }
-        // If finishedGenerating is true but queue was not empty, loop continues to process remaining items.
-        // If queue became empty but finishedGenerating is false, loop continues to wait for more images.
+        return args.fused_deadline_ms > 0;
+    }
+    if (key == "--batch")
+    {
+        args.batch = std::stoi(value);
+        return args.batch >= 1;
+    }
+    if (key == "--demand" && value.empty())
+    {
+        args.demand = true;
+        return true;
+    }
+    if (key == "--watermark")
+    {
+        args.watermark = value.empty() ? "pixels" : value;
+        return args.watermark == "pixels" || args.watermark == "meta" || args.watermark == "both";
+    }
+    if (key == "--verify-watermarks" && !value.empty())
+    {
+        args.verify_watermarks_path = value;
+        return true;
+    }
+    if (key == "--sizes" && !value.empty())
+    {
+        args.sizes_spec = value;
+        return true;
+    }
+    if (key == "--content")
+    {
+        args.content = value;
+        return value == "noise" || value == "coherent";
     }
+    if (key == "--yuv-bench")
+    {
+        args.yuv_bench_frames = std::stoi(value);
+        return args.yuv_bench_frames > 0;
+    }
+    if (key == "--shm-slots")
+    {
+        args.shm_slots = std::stoi(value);
+        return args.shm_slots > 0;
+    }
+    return false;
 }
 
 /**
@@ -230,11 +1577,20 @@ void imageSaver(ThreadArgs args, int saver_id)
  */
 int main(int argc, char *argv[])
 {
+    // SIGINT/SIGTERM/SIGUSR1 are handled by a dedicated thread (see signalWatcher()). They are
+    // blocked first thing, before any sink can start a thread of its own (SegmentSink's
+    // finalizer, for instance), so every thread inherits the mask and none is killed by them.
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    sigaddset(&shutdown_signals, SIGUSR1); // Live statistics, handled by the same thread.
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+
     // Argument validation.
-    if (argc != 6)
+    if (argc < 6)
     {
-        std::cerr << "Uso: " << argv[0] << " <ancho> <alto> <duración_segundos> <fps> <extensión>\n";
-        std::cerr << "Ejemplo: " << argv[0] << " 640 480 10 30 png\n";
+        printUsage(argv[0]);
         return 1;
     }
 
@@ -248,6 +1604,16 @@ int main(int argc, char *argv[])
         args.image_extension = argv[5];
         // Calculate the total number of images the generator will aim for.
         args.totalImages = static_cast<int>(args.fps * args.duration_seconds);
+
+        for (int a = 6; a < argc; ++a)
+        {
+            if (!parseOption(argv[a], args))
+            {
+                std::cerr << "Error: Opción desconocida o inválida: " << argv[a] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
     }
     catch (...)
     {
@@ -255,7 +1621,24 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    args.output_directory = "generated_images"; // Set default output directory name.
+    // The read benchmark only reads existing output, so it runs on its own and exits. These
+    // standalone modes have no signal thread: the signals keep their default action.
+    if (!args.read_bench_path.empty() || args.yuv_bench_frames > 0 || !args.verify_watermarks_path.empty())
+    {
+        pthread_sigmask(SIG_UNBLOCK, &shutdown_signals, nullptr);
+    }
+    if (!args.read_bench_path.empty())
+    {
+        return runReadBenchmark(args);
+    }
+    if (args.yuv_bench_frames > 0)
+    {
+        return runYuvBenchmark(args);
+    }
+    if (!args.verify_watermarks_path.empty())
+    {
+        return runWatermarkVerification(args);
+    }
 
     // Validate parsed numeric arguments.
     if (args.width <= 0 || args.height <= 0 || args.fps <= 0 || args.duration_seconds <=0)
@@ -274,75 +1657,467 @@ int main(int argc, char *argv[])
     }
 
 
-    // Create the output directory if it does not exist.
-    if (!fs::exists(args.output_directory))
+    if ((!args.shm_ring_name.empty()) + (!args.ingest_source.empty()) + (!args.replay_directory.empty()) > 1)
+    {
+        std::cerr << "Error: --shm-ring, --ingest y --replay no se pueden combinar." << std::endl;
+        return 1;
+    }
+    if (!args.shm_ring_name.empty() && !args.sink_specs.empty())
+    {
+        std::cerr << "Error: --shm-ring genera directamente en el anillo y no admite --sink (use --sink=shm:<nombre>)." << std::endl;
+        return 1;
+    }
+    if (!args.shm_ring_name.empty() && (!args.process_spec.empty() || args.pyramid_levels > 0))
+    {
+        std::cerr << "Error: --shm-ring genera directamente en el anillo y no admite --process ni --pyramid (use --sink=shm:<nombre>)." << std::endl;
+        return 1;
+    }
+    if (args.fused && (!args.shm_ring_name.empty() || !args.ingest_source.empty() || !args.replay_directory.empty() ||
+                       !args.process_spec.empty() || args.pyramid_levels > 0 || args.content != "noise"))
+    {
+        std::cerr << "Error: --fused solo genera ruido en los guardadores; no admite --shm-ring, --ingest, --replay, --process,"
+                  << " --pyramid ni --content=coherent." << std::endl;
+        return 1;
+    }
+    if (args.fused && args.sink_specs.size() > 1)
+    {
+        std::cerr << "Error: --fused genera cada frame en el guardador que lo escribe; admite un solo --sink"
+                  << " (use dir=<d1>:<d2> para repartir entre discos)." << std::endl;
+        return 1;
+    }
+    if (!args.sizes_spec.empty())
+    {
+        FrameSizeDistribution sizes;
+        std::string error;
+        if (!sizes.parse(args.sizes_spec, cv::Size(args.width, args.height), error))
+        {
+            std::cerr << "Error: --sizes: " << error << std::endl;
+            return 1;
+        }
+        if (args.fused || !args.shm_ring_name.empty() || !args.ingest_source.empty() || !args.replay_directory.empty() ||
+            args.content != "noise")
+        {
+            std::cerr << "Error: --sizes genera ruido de tamaño variable en el hilo generador; no admite --fused,"
+                      << " --shm-ring, --ingest, --replay ni --content=coherent." << std::endl;
+            return 1;
+        }
+    }
+    if (!args.watermark.empty() && !args.shm_ring_name.empty())
+    {
+        std::cerr << "Error: --shm-ring escribe los frames directamente en el anillo y no admite --watermark"
+                  << " (use --sink=shm:<nombre>)." << std::endl;
+        return 1;
+    }
+    if (args.batch > 1 && (args.fused || !args.shm_ring_name.empty() || !args.ingest_source.empty() ||
+                           !args.replay_directory.empty()))
+    {
+        std::cerr << "Error: --batch agrupa la generación de ruido del hilo generador; no admite --fused, --shm-ring,"
+                  << " --ingest ni --replay." << std::endl;
+        return 1;
+    }
+    if (!args.replay_directory.empty())
+    {
+        std::error_code ec;
+        if (!fs::is_directory(args.replay_directory))
+        {
+            std::cerr << "Error: El directorio de replay no existe: " << args.replay_directory << std::endl;
+            return 1;
+        }
+        for (const std::string &directory : args.output_directories)
+        {
+            if (fs::exists(directory) && fs::equivalent(args.replay_directory, directory, ec))
+            {
+                std::cerr << "Error: El directorio de replay no puede ser un directorio de salida ("
+                          << directory << ")." << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    Pipeline pipeline;
+    pipeline.setTargetFps(args.fps);
+    pipeline.setDemandDriven(args.demand);
+    pipeline.setFused(args.fused, args.fused_deadline_ms);
+    pipeline.setBatchSize(args.batch);
+    pipeline.setWatermark(args.watermark == "pixels" || args.watermark == "both");
+    ProcessingChain *processingChain = nullptr; // Owned by the pipeline; kept for the report.
+
+    // Shared-memory output replaces the sinks (the generator publishes every frame itself).
+    if (args.shm_ring_name.empty())
     {
-        if (!fs::create_directories(args.output_directory))
+        // Without --sink, a single disk sink for <extensión> in the output directories.
+        if (args.sink_specs.empty() && args.image_extension == "raw")
         {
-            std::cerr << "Error: No se pudo crear el directorio de salida: " << args.output_directory << std::endl;
+            std::cerr << "Error: La extensión raw solo está soportada con --shm-ring." << std::endl;
             return 1;
         }
+        std::vector<std::string> specs = args.sink_specs;
+        if (specs.empty())
+        {
+            specs.push_back(args.image_extension);
+        }
+        // Fan-out: one route (queues + savers + drop policy) per --sink, creating the output
+        // directories if they do not exist.
+        for (const std::string &spec : specs)
+        {
+            std::string error;
+            std::unique_ptr<SinkRoute> route = makeSinkRoute(spec, args, error);
+            if (!route)
+            {
+                std::cerr << "Error: No se pudo crear el destino " << spec << ": " << error << std::endl;
+                return 1;
+            }
+            pipeline.addRoute(std::move(route));
+        }
+
+        // Processing stage (also used to build pyramid levels): its pool keeps enough output
+        // buffers for every frame that can be queued or being written at once, so in steady
+        // state nothing is allocated.
+        if (!args.process_spec.empty() || args.pyramid_levels > 0)
+        {
+            size_t in_flight = static_cast<size_t>(args.process_threads);
+            for (auto &route : pipeline.routes())
+            for (auto &channel : route->channels)
+            {
+                in_flight += channel->max_queue_size + static_cast<size_t>(channel->num_threads);
+            }
+            auto chain = std::make_unique<ProcessingChain>(in_flight * (args.pyramid_levels + 1));
+            chain->setPyramidLevels(args.pyramid_levels);
+            std::string error;
+            if (!chain->parse(args.process_spec, error))
+            {
+                std::cerr << "Error: --process: " << error << std::endl;
+                return 1;
+            }
+            processingChain = chain.get();
+            pipeline.setStage(std::move(chain), args.process_threads);
+        }
+    }
+    const SinkChannel *processingChannel = pipeline.stageChannel();
+
+    // Used by the savers in fused mode, so it lives until the pipeline has been waited for.
+    std::string generator_error;
+    std::unique_ptr<FrameGenerator> generator = makeFrameGenerator(args, pipeline, generator_error);
+    if (!generator)
+    {
+        std::cerr << "Error: " << generator_error << std::endl;
+        return 1;
     }
 
-    auto start_global = std::chrono::steady_clock::now(); // Record global start time.
+    // The signals were blocked at the top of main(); this thread waits for them.
+    std::atomic<int> stop_signal{0}; // SIGINT or SIGTERM once the run has been interrupted.
+    std::atomic<bool> signal_watcher_stop{false};
+    std::thread signalThread(signalWatcher, std::ref(pipeline), args.drain_deadline, args.stats_file,
+                             std::ref(stop_signal), std::ref(signal_watcher_stop));
 
     // --- Thread Creation and Management ---
-    // Create and start the image generator thread.
-    std::thread generatorThread(imageGenerator, args);
+    // Start the processing workers and the saver threads of every sink (none when publishing
+    // to shared memory), then the image generator thread (which receives or replays the frames
+    // in ingest and replay modes).
+    pipeline.start();
+    auto start_global = pipeline.startTime(); // Record global start time.
+    std::thread generatorThread(imageGenerator, args, std::ref(pipeline), std::ref(*generator));
 
-    // Create and start multiple image saver threads.
-    std::vector<std::thread> saverThreads;
-    for (int i = 0; i < NUM_SAVER_THREADS; ++i)
+    // Runtime reconfiguration. It stops with the producer, before the savers are joined, so
+    // it never starts savers that nobody would join.
+    std::atomic<bool> control_stop{false};
+    std::thread controlThread;
+    if (!args.control_path.empty())
     {
-        saverThreads.emplace_back(imageSaver, args, i); // Pass args and a unique ID to each saver.
+        int listen_fd = -1;
+        std::string error;
+        if ((listen_fd = frameSocketListen(args.control_path, error)) < 0)
+        {
+            std::cerr << "Advertencia: No se pudo abrir el socket de control: " << error << std::endl;
+        }
+        else
+        {
+            std::cout << "Socket de control escuchando en " << args.control_path << std::endl;
+            controlThread = std::thread(controlServer, std::ref(pipeline), listen_fd, std::ref(control_stop));
+        }
     }
 
     // Wait for the generator thread to complete its execution.
     generatorThread.join();
-
-    // Wait for all saver threads to complete their execution.
-    for (int i = 0; i < NUM_SAVER_THREADS; ++i)
+    auto producer_end = std::chrono::steady_clock::now();
+    if (controlThread.joinable())
     {
-        if(saverThreads[i].joinable()) saverThreads[i].join();
+        control_stop = true;
+        controlThread.join();
+        ::unlink(args.control_path.c_str());
     }
 
+    // Wait for the processing workers and saver threads, then let each sink flush.
+    pipeline.wait();
+    signal_watcher_stop = true;
+    signalThread.join();
+
     auto end_global = std::chrono::steady_clock::now(); // Record global end time.
     std::chrono::duration<double> total_elapsed = end_global - start_global;
 
     // --- Final Summary Output ---
+    const PipelineCounters &counters = pipeline.counters();
     std::cout << "\n--- Resumen Global ---\n";
-    std::cout << "Imágenes generadas (contador global): " << total_images_generated_count.load() << "\n";
-    std::cout << "Imágenes guardadas (contador global): " << total_images_saved_count.load() << "\n";
+    int total_abandoned = processingChannel ? processingChannel->abandoned.load() : 0;
+    for (auto &route : pipeline.routes())
+    for (auto &channel : route->channels)
+    {
+        total_abandoned += channel->abandoned.load();
+    }
+    if (pipeline.stopRequested())
+    {
+        std::cout << std::fixed << std::setprecision(2) << "Ejecución interrumpida por "
+                  << (stop_signal == SIGINT ? "SIGINT" : "SIGTERM") << " a los "
+                  << std::chrono::duration<double>(producer_end - start_global).count() << " segundos; vaciado en "
+                  << std::chrono::duration<double>(end_global - producer_end).count() << " segundos (plazo "
+                  << args.drain_deadline << ")\n";
+        std::cout << "Imágenes abandonadas al vencer el plazo de vaciado: " << total_abandoned << "\n";
+    }
+    std::cout << "Imágenes generadas (contador global): " << counters.generated.load() << "\n";
+    std::cout << "Imágenes guardadas (contador global): " << counters.saved.load() << "\n";
     std::cout << std::fixed << std::setprecision(2)
               << "Tiempo total de ejecución: " << total_elapsed.count() << " segundos\n";
 
     if (total_elapsed.count() > 0)
     {
-        double overall_saving_fps = total_images_saved_count.load() / total_elapsed.count();
+        double overall_saving_fps = counters.saved.load() / total_elapsed.count();
         std::cout << std::fixed << std::setprecision(2)
                   << "FPS efectivo de guardado (global, basado en tiempo total): " << overall_saving_fps << "\n";
 
         // Calculate losses based on the current logic (bounded queue, explicit drop tracking).
-        int lost_due_to_queue = total_images_enqueued_count.load() - total_images_saved_count.load();
+        int lost_due_to_queue = counters.enqueued.load() - counters.saved.load();
         if (lost_due_to_queue < 0) lost_due_to_queue = 0; // Safety check, should not be negative.
         
-        int lost_due_to_delay = total_images_dropped_due_to_delay.load();
-        int total_lost_images = lost_due_to_queue + lost_due_to_delay;
+        int lost_due_to_delay = counters.late.load();
+        int lost_in_processing = processingChannel ? processingChannel->dropped.load() + processingChannel->abandoned.load() +
+                                                         processingChannel->failed.load() : 0;
+        int total_lost_images = lost_due_to_queue + lost_due_to_delay + lost_in_processing + counters.undemanded.load();
 
         std::cout << "Imágenes perdidas por cola (no alcanzaron a guardarse): " << lost_due_to_queue << "\n";
         std::cout << "Imágenes perdidas por atraso (ni siquiera generadas): " << lost_due_to_delay << "\n";
+        if (pipeline.demandDriven())
+        {
+            std::cout << "Imágenes sin demanda (destinos llenos, no generadas): " << counters.undemanded.load() << "\n";
+        }
+        if (processingChannel)
+        {
+            std::cout << "Imágenes perdidas en procesamiento (cola llena, abandonadas o con error): " << lost_in_processing << "\n";
+        }
         std::cout << "TOTAL imágenes perdidas: " << total_lost_images << "\n";
     }
 
+    // Fused mode: the frames were generated by the saver threads, right before writing them.
+    if (pipeline.fused())
+    {
+        long long generate_ns = 0;
+        int generated_by_savers = counters.generated.load(); // Counted once per frame, when a saver generates it.
+        int expired = 0;
+        for (const auto &route : pipeline.routes())
+        for (const auto &channel : route->channels)
+        {
+            generate_ns += channel->generate_ns.load();
+            expired += channel->expired.load();
+        }
+        std::cout << "\n--- Generación en los guardadores (--fused) ---\n";
+        std::cout << "Frames generados por los guardadores: " << generated_by_savers << "\n";
+        if (generated_by_savers > 0)
+        {
+            std::cout << std::fixed << std::setprecision(3)
+                      << "Generación media: " << generate_ns / 1e6 / generated_by_savers << " ms/frame\n";
+        }
+        std::cout << "Índices con plazo vencido (no generados): " << expired << "\n";
+    }
+
+    // Watermarks: frames that could not carry one in their pixels.
+    if (!args.watermark.empty())
+    {
+        std::cout << "\n--- Marcas de agua (--watermark=" << args.watermark << ") ---\n";
+        if (pipeline.watermark())
+        {
+            std::cout << "Frames sin marca en píxeles (demasiado pequeños o no de 8 bits): "
+                      << pipeline.counters().unmarked.load() << "\n";
+        }
+        std::cout << "Para auditar la salida en disco: --verify-watermarks=<directorio>\n";
+    }
+
+    // Processing stage: cost of each operator and how much CPU it leaves for encoding.
+    if (processingChain && !processingChain->empty())
+    {
+        std::cout << "\n--- Procesamiento ---\n";
+        std::cout << "Cadena:";
+        for (size_t k = 0; k < processingChain->size(); ++k)
+        {
+            std::cout << (k == 0 ? " " : " -> ") << processingChain->name(k);
+        }
+        std::cout << " (" << processingChannel->num_threads << " hilos)\n";
+        std::cout << "Frames procesados: " << processingChain->frames()
+                  << ", descartados por cola llena: " << processingChannel->dropped.load()
+                  << ", reenviados sin procesar (codificados): " << processingChannel->passed_through.load()
+                  << ", con error (no reenviados): " << processingChannel->failed.load() << "\n";
+        long long chain_ns = 0;
+        for (size_t k = 0; k < processingChain->size(); ++k)
+        {
+            chain_ns += processingChain->nanoseconds(k);
+        }
+        long long frames = processingChain->frames();
+        if (frames > 0 && chain_ns > 0)
+        {
+            for (size_t k = 0; k < processingChain->size(); ++k)
+            {
+                std::cout << std::fixed << std::setprecision(3) << "  " << processingChain->name(k) << ": "
+                          << processingChain->nanoseconds(k) / 1e6 / frames << " ms/frame ("
+                          << std::setprecision(1) << 100.0 * processingChain->nanoseconds(k) / chain_ns << "%)\n";
+            }
+            std::cout << std::fixed << std::setprecision(3)
+                      << "Coste total: " << chain_ns / 1e6 / frames << " ms/frame\n";
+        }
+        if (total_elapsed.count() > 0)
+        {
+            // CPU time of the chain over wall time = cores kept busy by processing.
+            double cores_busy = chain_ns / 1e9 / total_elapsed.count();
+            unsigned int cores = std::thread::hardware_concurrency();
+            std::cout << std::fixed << std::setprecision(2) << "Núcleos ocupados por el procesamiento: " << cores_busy;
+            if (cores > 0)
+            {
+                std::cout << " de " << cores << " (quedan " << std::max(0.0, cores - cores_busy) << " para codificar y guardar)";
+            }
+            std::cout << "\n";
+        }
+        long long requests = processingChain->pool().hits() + processingChain->pool().misses();
+        if (requests > 0)
+        {
+            std::cout << std::fixed << std::setprecision(1) << "Buffers de salida reutilizados: "
+                      << 100.0 * processingChain->pool().hits() / requests << "% ("
+                      << processingChain->pool().misses() << " asignaciones)\n";
+        }
+    }
+
+    // Pyramid: cost of the reduced levels next to saving the full resolution alone.
+    if (processingChain && processingChain->pyramidLevels() > 0)
+    {
+        std::cout << "\n--- Pirámide ---\n";
+        long long extra_ns = 0;
+        for (int level = 0; level <= processingChain->pyramidLevels(); ++level)
+        {
+            int saved = counters.level_saved[level].load();
+            std::cout << "Nivel " << level << " (1/" << (1 << level) << "): guardadas " << saved;
+            if (saved > 0)
+            {
+                std::cout << std::fixed << std::setprecision(3)
+                          << ", escritura media " << counters.level_write_ns[level].load() / 1e6 / saved << " ms";
+            }
+            if (level > 0 && processingChannel->saved.load() > 0)
+            {
+                std::cout << std::fixed << std::setprecision(3) << ", reducción media "
+                          << processingChain->pyramidNanoseconds(level) / 1e6 / processingChannel->saved.load() << " ms";
+                extra_ns += counters.level_write_ns[level].load() + processingChain->pyramidNanoseconds(level);
+            }
+            std::cout << "\n";
+        }
+        // Writing and downsampling the levels, relative to writing the full-resolution frames.
+        if (counters.level_write_ns[0].load() > 0)
+        {
+            std::cout << std::fixed << std::setprecision(1) << "Coste adicional de los niveles: +"
+                      << 100.0 * extra_ns / counters.level_write_ns[0].load() << "% sobre guardar solo la resolución completa\n";
+        }
+    }
+
+    // Per-sink (and per-device) breakdown when frames were fanned out or striped.
+    bool striped = false;
+    for (const auto &route : pipeline.routes())
+    {
+        striped = striped || route->channels.size() > 1;
+    }
+    // The publish mode's cost is only visible in the per-sink report, so it is shown for it too.
+    if (!args.sink_specs.empty() || striped || args.publish_mode != "direct")
+    {
+        std::cout << "\n--- Resumen por destino ---\n";
+        for (size_t r = 0; r < pipeline.routes().size(); ++r)
+        {
+            const SinkRoute &route = *pipeline.routes()[r];
+            if (route.channels.size() > 1)
+            {
+                std::cout << "[" << r << "] Repartido entre " << route.channels.size() << " dispositivos ("
+                          << (route.stripe_policy == StripePolicy::RoundRobin ? "rr" : "adaptive") << ")\n";
+            }
+            for (const auto &channel : route.channels)
+            {
+                std::cout << (route.channels.size() > 1 ? "  - " : "[" + std::to_string(r) + "] ")
+                          << channel->sink->describe() << " (hilos " << channel->num_threads
+                          << ", cola " << channel->max_queue_size << ", descarte "
+                          << dropPolicyName(channel->drop_policy) << ")\n";
+                std::cout << "    Encoladas: " << channel->enqueued.load() << ", guardadas: " << channel->saved.load()
+                          << ", descartadas por cola llena: " << channel->dropped.load()
+                          << ", errores de escritura: " << channel->failed.load() << "\n";
+                int writes = channel->saved.load() + channel->failed.load();
+                if (channel->abandoned.load() > 0)
+                {
+                    std::cout << "    Abandonadas al vencer el plazo de vaciado: " << channel->abandoned.load() << "\n";
+                }
+                if (channel->expired.load() > 0)
+                {
+                    std::cout << "    Plazo vencido antes de generarlas (--fused): " << channel->expired.load() << "\n";
+                }
+                if (channel->blocked.load() > 0)
+                {
+                    std::cout << std::fixed << std::setprecision(2) << "    Esperas por cola llena (drop=block): "
+                              << channel->blocked.load() << " (" << channel->blocked_ns.load() / 1e6 << " ms en total)\n";
+                }
+                // Every frame that entered the queue was written, failed, pushed out by a newer one,
+                // abandoned at the drain deadline or (fused mode) not started by its deadline.
+                int expected = channel->enqueued.load() - channel->abandoned.load() - channel->evicted.load() -
+                               channel->expired.load();
+                if (writes != expected)
+                {
+                    std::cout << "    Advertencia: contabilidad inconsistente (" << writes << " escrituras, "
+                              << expected << " esperadas)\n";
+                }
+                if (writes > 0)
+                {
+                    std::cout << std::fixed << std::setprecision(3)
+                              << "    Tiempo medio de escritura: " << channel->write_ns_total.load() / 1e6 / writes << " ms\n";
+                }
+                if (channel->peak_queued_bytes.load() > 0)
+                {
+                    std::cout << std::fixed << std::setprecision(2) << "    Memoria máxima en cola: "
+                              << channel->peak_queued_bytes.load() / (1024.0 * 1024.0) << " MB\n";
+                }
+                if (total_elapsed.count() > 0)
+                {
+                    std::cout << std::fixed << std::setprecision(2)
+                              << "    FPS efectivo de guardado: " << channel->saved.load() / total_elapsed.count();
+                    if (channel->sink->bytesWritten() > 0)
+                    {
+                        std::cout << " (" << channel->sink->bytesWritten() / (1024.0 * 1024.0) / total_elapsed.count() << " MB/s)";
+                    }
+                    std::cout << "\n";
+                }
+                std::cout << channel->sink->report();
+            }
+        }
+        printPublishComparison(pipeline);
+    }
+
     // Optional: Verify by counting files in the output directory.
     int files_in_directory = 0;
+    if (!args.shm_ring_name.empty())
+    {
+        return 0; // Nothing was written to disk.
+    }
     try
     {
-        for (const auto &entry : fs::directory_iterator(args.output_directory))
+        for (const std::string &directory : args.output_directories)
         {
-            if (entry.is_regular_file())
+            if (!fs::exists(directory))
+            {
+                continue;
+            }
+            for (const auto &entry : fs::directory_iterator(directory))
             {
-                files_in_directory++;
+                if (entry.is_regular_file())
+                {
+                    files_in_directory++;
+                }
             }
         }
     }
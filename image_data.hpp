@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>  // For int64_t
+#include <opencv2/core.hpp> // OpenCV core functionalities
+
+// Structure to hold an image and its unique generation index.
+// This is passed through the queues from the generator to the sinks. Copies share the
+// pixel buffer through cv::Mat reference counting, so fanning a frame out to several
+// sinks never copies the pixels.
+struct ImageData
+{
+    cv::Mat image; // The OpenCV matrix holding image data.
+    int index;     // Unique index of the image, used for naming files.
+    bool encoded = false; // True if `image` holds already-encoded bytes (1xN CV_8UC1) to write as-is.
+    int level = 0;        // Pyramid level (0 = full resolution, k = 1/2^k of it; see --pyramid).
+    int64_t created_ns = 0; // liveStatsNowNs() when the frame entered the pipeline (0 = not set yet).
+    int64_t deadline_ns = 0; // Fused mode: a saver that cannot start the frame by then skips it (0 = none).
+};
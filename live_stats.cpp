@@ -0,0 +1,128 @@
+#include "live_stats.hpp"
+#include <algorithm> // For std::min
+#include <cstring>   // For std::strncpy
+#include <ctime>     // For clock_gettime
+#include <iomanip>   // For std::setprecision
+#include <sstream>   // For std::ostringstream
+
+int64_t liveStatsNowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+    if (ns < 0)
+    {
+        ns = 0;
+    }
+    int bucket = 0;
+    for (uint64_t v = static_cast<uint64_t>(ns); v > 0 && bucket < BUCKETS - 1; v >>= 1)
+    {
+        bucket++;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    int64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+double LatencyHistogram::meanNs() const
+{
+    uint64_t n = count();
+    return n > 0 ? static_cast<double>(sum_ns_.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+int64_t LatencyHistogram::quantileNs(double fraction) const
+{
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int b = 0; b < BUCKETS; ++b)
+    {
+        counts[b] = buckets_[b].load(std::memory_order_relaxed);
+        total += counts[b];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; ++b)
+    {
+        seen += counts[b];
+        if (seen >= target)
+        {
+            // The maximum is a tighter bound for the top bucket.
+            return std::min(b == 0 ? 0 : (int64_t(1) << b) - 1, maxNs());
+        }
+    }
+    return maxNs();
+}
+
+std::string LatencyHistogram::summary() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "n=" << count() << " media=" << meanNs() / 1e6
+        << " ms p50<=" << quantileNs(0.50) / 1e6 << " p90<=" << quantileNs(0.90) / 1e6 << " p99<="
+        << quantileNs(0.99) / 1e6 << " máx=" << maxNs() / 1e6 << " ms";
+    return out.str();
+}
+
+int ThreadRegistry::add(const std::string &label)
+{
+    int slot = used_.load();
+    do
+    {
+        if (slot >= MAX_THREADS)
+        {
+            return -1;
+        }
+    } while (!used_.compare_exchange_weak(slot, slot + 1));
+    // The label is written before the slot is published by set(); snapshot() reads it only
+    // once since_ns is non-zero.
+    std::strncpy(slots_[slot].label, label.c_str(), sizeof(slots_[slot].label) - 1);
+    set(slot, ThreadActivity::Waiting);
+    return slot;
+}
+
+void ThreadRegistry::set(int slot, ThreadActivity activity, int frame)
+{
+    if (slot < 0)
+    {
+        return;
+    }
+    slots_[slot].activity.store(static_cast<int>(activity), std::memory_order_relaxed);
+    slots_[slot].frame.store(frame, std::memory_order_relaxed);
+    slots_[slot].since_ns.store(liveStatsNowNs(), std::memory_order_release);
+}
+
+std::string ThreadRegistry::snapshot() const
+{
+    static const char *NAMES[] = {"esperando", "trabajando", "terminado"};
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    int64_t now = liveStatsNowNs();
+    int used = std::min(used_.load(), MAX_THREADS);
+    for (int s = 0; s < used; ++s)
+    {
+        int64_t since = slots_[s].since_ns.load(std::memory_order_acquire);
+        if (since == 0)
+        {
+            continue; // Registered but not published yet.
+        }
+        int frame = slots_[s].frame.load(std::memory_order_relaxed);
+        out << "  " << slots_[s].label << ": " << NAMES[slots_[s].activity.load(std::memory_order_relaxed)];
+        if (frame >= 0)
+        {
+            out << " (imagen " << frame << ")";
+        }
+        out << " desde hace " << (now - since) / 1e6 << " ms\n";
+    }
+    return out.str();
+}
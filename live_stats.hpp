@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>   // For std::atomic counters
+#include <cstdint>  // For fixed-width integer types
+#include <string>   // For std::string
+
+/**
+ * @brief Histogram of durations in nanoseconds with power-of-two buckets.
+ *
+ * record() is a few relaxed atomic increments, so writers never block, and a snapshot can be
+ * taken at any time while they run (counts may be off by the samples in flight).
+ */
+class LatencyHistogram
+{
+public:
+    static const int BUCKETS = 48; // Bucket b holds [2^(b-1), 2^b) ns; the last one is open-ended.
+
+    void record(int64_t ns);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t maxNs() const { return max_ns_.load(std::memory_order_relaxed); }
+    double meanNs() const;
+
+    /**
+     * @brief Upper bound of the bucket that holds the `fraction` quantile (0 if empty).
+     */
+    int64_t quantileNs(double fraction) const;
+
+    /**
+     * @brief One-line summary: "n=<count> media=<ms> p50<=<ms> p90<=<ms> p99<=<ms> máx=<ms>".
+     */
+    std::string summary() const;
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> sum_ns_{0};
+    std::atomic<int64_t> max_ns_{0};
+};
+
+// What a registered pipeline thread is doing right now.
+enum class ThreadActivity
+{
+    Waiting, // Idle, waiting for work (or for the next frame slot).
+    Working, // Generating, processing or writing a frame.
+    Exited
+};
+
+/**
+ * @brief Fixed table where pipeline threads publish their activity for live snapshots.
+ *
+ * Threads register once (taking a slot) and then only store atomics, so updating and reading
+ * the table never takes a lock. Threads beyond MAX_THREADS are simply not tracked.
+ */
+class ThreadRegistry
+{
+public:
+    static const int MAX_THREADS = 512;
+
+    /**
+     * @brief Takes a slot for the calling thread.
+     * @return Slot index, or -1 if the table is full.
+     */
+    int add(const std::string &label);
+
+    /**
+     * @brief Records that thread `slot` switched to `activity` (on frame `frame`, or -1).
+     */
+    void set(int slot, ThreadActivity activity, int frame = -1);
+
+    /**
+     * @brief One line per registered thread: label, activity, frame and time in that state.
+     */
+    std::string snapshot() const;
+
+private:
+    struct Slot
+    {
+        char label[48] = {};
+        std::atomic<int> activity{static_cast<int>(ThreadActivity::Waiting)};
+        std::atomic<int> frame{-1};
+        std::atomic<int64_t> since_ns{0};
+    };
+    Slot slots_[MAX_THREADS];
+    std::atomic<int> used_{0};
+};
+
+/**
+ * @brief CLOCK_MONOTONIC time in nanoseconds (same clock as shmRingNowNs()).
+ */
+int64_t liveStatsNowNs();
@@ -0,0 +1,976 @@
+#include "pipeline.hpp"
+#include <algorithm> // For std::max, std::min
+#include <iomanip>   // For std::setprecision
+#include <iostream>  // For std::cerr
+#include "watermark.hpp" // stampWatermark
+
+const char *dropPolicyName(DropPolicy policy)
+{
+    switch (policy)
+    {
+    case DropPolicy::Oldest:
+        return "oldest";
+    case DropPolicy::Newest:
+        return "newest";
+    case DropPolicy::Block:
+        return "block";
+    }
+    return "?";
+}
+
+bool parseDropPolicy(const std::string &text, DropPolicy &policy)
+{
+    for (DropPolicy candidate : {DropPolicy::Oldest, DropPolicy::Newest, DropPolicy::Block})
+    {
+        if (text == dropPolicyName(candidate))
+        {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Queue bookkeeping for a frame entering or leaving a channel's queue (under queueMutex).
+ *        Frames of different sizes weigh differently, so the depth in frames alone does not
+ *        tell how much memory a queue holds.
+ */
+static void queueAdded(SinkChannel &channel, const ImageData &frame)
+{
+    channel.queue_depth++;
+    long long bytes = channel.queued_bytes += static_cast<long long>(frame.image.total() * frame.image.elemSize());
+    if (bytes > channel.peak_queued_bytes.load(std::memory_order_relaxed))
+    {
+        channel.peak_queued_bytes = bytes;
+    }
+}
+
+static void queueRemoved(SinkChannel &channel, const ImageData &frame)
+{
+    channel.queue_depth--;
+    channel.queued_bytes -= static_cast<long long>(frame.image.total() * frame.image.elemSize());
+}
+
+Pipeline::~Pipeline()
+{
+    if (started_ && !waited_)
+    {
+        finishProducing();
+        wait();
+    }
+}
+
+void Pipeline::addRoute(std::unique_ptr<SinkRoute> route)
+{
+    for (size_t k = 0; k < route->channels.size(); ++k)
+    {
+        route->channels[k]->label = "[" + std::to_string(routes_.size()) +
+                                    (route->channels.size() > 1 ? "." + std::to_string(k) : "") + "]";
+    }
+    routes_.push_back(std::move(route));
+}
+
+void Pipeline::setStage(std::unique_ptr<FrameStage> stage, int threads)
+{
+    stage_ = std::move(stage);
+    stage_channel_ = std::make_unique<SinkChannel>();
+    stage_channel_->num_threads = threads;
+}
+
+void Pipeline::start()
+{
+    start_time_ = std::chrono::steady_clock::now();
+    started_ = true;
+    if (demand_driven_)
+    {
+        if (stage_channel_)
+        {
+            stage_channel_->drop_policy = DropPolicy::Block;
+        }
+        for (auto &route : routes_)
+        for (auto &channel : route->channels)
+        {
+            channel->drop_policy = DropPolicy::Block;
+        }
+    }
+
+    // Processing workers (when there is a stage) sit between the producer and the savers.
+    if (stage_channel_)
+    {
+        active_processing_workers_ = stage_channel_->num_threads.load();
+        for (int i = 0; i < stage_channel_->num_threads; ++i)
+        {
+            stage_channel_->saverThreads.emplace_back(&Pipeline::frameProcessor, this, i);
+        }
+    }
+
+    // Create and start the saver threads of every sink.
+    for (auto &route : routes_)
+    for (auto &channel : route->channels)
+    {
+        for (int i = 0; i < channel->num_threads; ++i)
+        {
+            channel->saverThreads.emplace_back(&Pipeline::imageSaver, this, channel.get(), next_saver_id_++); // Unique ID per saver.
+        }
+    }
+}
+
+/**
+ * @brief Chooses the channel of a route that receives the next frame.
+ */
+/**
+ * @brief Whether a push to `channel` would not block. Call with its queueMutex held.
+ */
+static bool channelHasRoom(const SinkChannel &channel)
+{
+    return channel.imageQueue.size() < channel.max_queue_size || channel.drop_policy != DropPolicy::Block;
+}
+
+SinkChannel *Pipeline::pickChannel(SinkRoute &route)
+{
+    if (route.channels.size() == 1)
+    {
+        return route.channels[0].get();
+    }
+    size_t start = route.next_channel++ % route.channels.size();
+    if (route.stripe_policy == StripePolicy::RoundRobin)
+    {
+        return route.channels[start].get();
+    }
+    // Adaptive: expected wait = (queued + 1) * time per write / saver threads. Channels that
+    // have not been measured yet count as fast so that every device gets sampled. In
+    // demand-driven mode a channel with room beats any full one, which would block the push.
+    SinkChannel *best = nullptr;
+    double best_wait = 0;
+    bool best_room = false;
+    for (size_t k = 0; k < route.channels.size(); ++k)
+    {
+        SinkChannel *channel = route.channels[(start + k) % route.channels.size()].get();
+        double wait = (channel->queue_depth.load(std::memory_order_relaxed) + 1.0) *
+                      static_cast<double>(channel->write_ns_ewma.load(std::memory_order_relaxed)) / channel->num_threads;
+        bool room = true;
+        if (demand_driven_)
+        {
+            std::lock_guard<std::mutex> lock(channel->queueMutex);
+            room = channelHasRoom(*channel);
+        }
+        if (!best || (room && !best_room) || (room == best_room && wait < best_wait))
+        {
+            best = channel;
+            best_wait = wait;
+            best_room = room;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Demand-driven mode: waits until the queue the next frame will enter has room (the
+ *        stage queue, the next channel of every round-robin route, or any channel of an
+ *        adaptive route, which pickChannel() then prefers). Only the producer fills those
+ *        queues, so the room is still there when the frame is pushed.
+ * @return true if it had to wait.
+ */
+bool Pipeline::waitForDemand(std::chrono::steady_clock::time_point end_time)
+{
+    // Each entry is a set of channels of which one must have room.
+    std::vector<std::vector<SinkChannel *>> entries;
+    if (stage_channel_)
+    {
+        entries.push_back({stage_channel_.get()});
+    }
+    else
+    {
+        for (auto &route : routes_)
+        {
+            if (route->channels.size() == 1 || route->stripe_policy == StripePolicy::RoundRobin)
+            {
+                entries.push_back({route->channels[route->next_channel % route->channels.size()].get()});
+            }
+            else
+            {
+                std::vector<SinkChannel *> any;
+                for (auto &channel : route->channels)
+                {
+                    any.push_back(channel.get());
+                }
+                entries.push_back(any);
+            }
+        }
+    }
+    auto finished = [&] {
+        return abandon_queued_frames_ || stop_requested_ || std::chrono::steady_clock::now() >= end_time;
+    };
+    bool waited = false;
+    for (const std::vector<SinkChannel *> &entry : entries)
+    {
+        for (size_t turn = 0; !finished(); ++turn)
+        {
+            bool room = false;
+            for (SinkChannel *channel : entry)
+            {
+                std::lock_guard<std::mutex> lock(channel->queueMutex);
+                room = room || channelHasRoom(*channel);
+            }
+            if (room)
+            {
+                break;
+            }
+            waited = true;
+            // Bounded wait: requestStop(), the end of the run and the other channels of an
+            // adaptive route are not signalled on this channel's spaceCV.
+            SinkChannel *channel = entry[turn % entry.size()];
+            std::unique_lock<std::mutex> lock(channel->queueMutex);
+            channel->spaceCV.wait_for(lock, std::chrono::milliseconds(entry.size() > 1 ? 10 : 100),
+                                      [&] { return channelHasRoom(*channel); });
+        }
+    }
+    return waited;
+}
+
+/**
+ * @brief Pushes images into a channel's queue, applying the channel's drop policy to each one
+ *        if the queue is full, and wakes up the channel's threads. A batch takes the queue
+ *        mutex and notifies the savers once.
+ * @param frames Images to enqueue. Their pixel buffers are shared, not copied.
+ * @param count Number of images.
+ */
+void Pipeline::offerToChannel(SinkChannel *channel, const ImageData *frames, size_t count)
+{
+    // --- Critical Section: Accessing the channel's queue ---
+    {
+        std::unique_lock<std::mutex> lock(channel->queueMutex); // Lock the mutex to protect the queue.
+        for (size_t k = 0; k < count; ++k)
+        {
+            if (channel->drop_policy == DropPolicy::Block && channel->imageQueue.size() >= channel->max_queue_size &&
+                !abandon_queued_frames_)
+            {
+                // Wait for a saver to take a frame (or for the policy or the limit to change).
+                if (k > 0)
+                {
+                    channel->queueCV.notify_all(); // The savers may be waiting for the first frames of the batch.
+                }
+                auto wait_start = std::chrono::steady_clock::now();
+                channel->spaceCV.wait(lock, [this, channel] {
+                    return channel->imageQueue.size() < channel->max_queue_size ||
+                           channel->drop_policy != DropPolicy::Block || abandon_queued_frames_;
+                });
+                channel->blocked++;
+                channel->blocked_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - wait_start).count();
+            }
+            if (abandon_queued_frames_)
+            {
+                // Drain deadline expired: frames still on their way are counted, not written.
+                channel->enqueued++;
+                channel->abandoned++;
+                continue;
+            }
+            // If the queue has reached its maximum allowed size, apply the drop policy.
+            if (channel->imageQueue.size() >= channel->max_queue_size)
+            {
+                channel->dropped++;
+                if (channel->drop_policy == DropPolicy::Newest)
+                {
+                    continue; // Keep the queue as it is; this channel never sees the new image.
+                }
+                queueRemoved(*channel, channel->imageQueue.front());
+                channel->imageQueue.pop_front(); // Remove from the front (oldest).
+                channel->evicted++;
+            }
+            // Add the new image to the back of the queue.
+            channel->imageQueue.push_back(frames[k]);
+            queueAdded(*channel, frames[k]);
+            channel->enqueued++;
+        }
+    } // Mutex is automatically released here by unique_lock.
+
+    // Notify one or all waiting threads that a new image is available.
+    // notify_all() is used here; notify_one() could be an alternative if only one saver
+    // is expected to wake up and process efficiently.
+    channel->queueCV.notify_all();
+}
+
+/**
+ * @brief Writes the pixel watermark of a frame that is about to be queued for the sinks; no sink
+ *        holds the buffer yet, so it can be written in place.
+ */
+void Pipeline::stampFrame(const ImageData &frame)
+{
+    if (frame.encoded || frame.image.empty())
+    {
+        return; // Encoded bytes, or a fused-mode order (stamped by the saver that generates it).
+    }
+    cv::Mat image = frame.image; // Same pixels, writable header.
+    if (!stampWatermark(image, {frame.index, watermarkTimeNs(frame.created_ns)}))
+    {
+        counters_.unmarked++;
+    }
+}
+
+/**
+ * @brief Offers images to every route (all of them to the same channel of it).
+ * @param frames Images to enqueue. Their pixel buffers are shared, not copied, between sinks.
+ * @param count Number of images.
+ */
+void Pipeline::fanOutImages(const ImageData *frames, size_t count)
+{
+    for (size_t k = 0; watermark_ && k < count; ++k)
+    {
+        stampFrame(frames[k]);
+    }
+    for (auto &route : routes_)
+    {
+        counters_.enqueued += static_cast<int>(count); // Count every image offered to a sink, even if it is rejected.
+        offerToChannel(pickChannel(*route), frames, count);
+    }
+}
+
+void Pipeline::push(ImageData frame)
+{
+    if (frame.created_ns == 0)
+    {
+        frame.created_ns = liveStatsNowNs();
+    }
+    if (!fused_generator_)
+    {
+        counters_.generated++; // Fused-mode orders are counted by the saver that generates them.
+    }
+    if (stage_channel_)
+    {
+        offerToChannel(stage_channel_.get(), &frame, 1);
+    }
+    else
+    {
+        fanOutImages(&frame, 1);
+    }
+}
+
+void Pipeline::pushBatch(std::vector<ImageData> &frames)
+{
+    int64_t now_ns = liveStatsNowNs();
+    for (ImageData &frame : frames)
+    {
+        if (frame.created_ns == 0)
+        {
+            frame.created_ns = now_ns;
+        }
+    }
+    counters_.generated += static_cast<int>(frames.size());
+    if (stage_channel_)
+    {
+        offerToChannel(stage_channel_.get(), frames.data(), frames.size());
+    }
+    else
+    {
+        fanOutImages(frames.data(), frames.size());
+    }
+}
+
+/**
+ * @brief Tells the threads of a channel that no more images will be enqueued.
+ */
+void Pipeline::finishChannel(SinkChannel &channel)
+{
+    {
+        std::lock_guard<std::mutex> lock(channel.queueMutex); // Lock to safely modify finishedGenerating.
+        channel.finishedGenerating = true; // Set the flag.
+    }
+    channel.queueCV.notify_all(); // Notify all threads so they can check the flag and exit if queue is empty.
+}
+
+/**
+ * @brief Signals the saver threads of every sink that no more images will be enqueued.
+ */
+void Pipeline::finishSinks()
+{
+    for (auto &route : routes_)
+    for (auto &channel : route->channels)
+    {
+        finishChannel(*channel);
+    }
+}
+
+void Pipeline::finishProducing()
+{
+    if (producing_finished_)
+    {
+        return;
+    }
+    producing_finished_ = true;
+    if (stage_channel_)
+    {
+        finishChannel(*stage_channel_);
+    }
+    else
+    {
+        finishSinks();
+    }
+}
+
+/**
+ * @brief Pushes or counts what one FrameGenerator::generate() call produced.
+ * @return false if the generator is finished.
+ */
+bool Pipeline::acceptGenerated(FrameGenerator::Result result, ImageData &frame)
+{
+    switch (result)
+    {
+    case FrameGenerator::Result::Frame:
+        push(std::move(frame));
+        break;
+    case FrameGenerator::Result::Delivered:
+        counters_.enqueued++;
+        counters_.saved++; // Delivering the frame is that generator's "save".
+        counters_.generated++;
+        break;
+    case FrameGenerator::Result::Failed:
+        break;
+    case FrameGenerator::Result::Finished:
+        return false;
+    }
+    return true;
+}
+
+void Pipeline::generate(FrameGenerator &generator, std::chrono::steady_clock::time_point end_time)
+{
+    // Calculate the duration of a single frame based on the target FPS.
+    double fps = target_fps_.load();
+    std::chrono::duration<double> frame_duration(1.0 / fps);
+
+    int i = 0; // Counter for generated images (used for indexing).
+    auto start_time = std::chrono::steady_clock::now();
+    // The schedule restarts from frame schedule_base whenever the target FPS changes.
+    auto schedule_start = start_time;
+    int schedule_base = 0;
+    bool starved = false; // Demand-driven mode: waited for room since the last frame generated.
+    if (fused_ && (!generator.independentFrames() || stage_channel_ || routes_.size() > 1))
+    {
+        // A saver can only generate frame k on its own if frame k does not depend on frame k-1,
+        // and with several routes every route's saver would generate the same frame again.
+        std::cerr << "Advertencia: El generador no produce frames independientes (o hay etapa de procesamiento"
+                  << " o varios destinos); se genera sin --fused." << std::endl;
+        fused_ = false;
+    }
+    fused_generator_ = fused_ ? &generator : nullptr;
+    int batch = fused_ ? 1 : batch_size_; // Frames per wakeup.
+    std::vector<ImageData> frames;        // Batched mode: the frames of the current batch.
+    long long frame_count = generator.frameCount(); // -1 = unlimited.
+    int state_slot = thread_registry_.add("generador");
+    generator.begin(end_time, stop_requested_);
+
+    // Unpaced sources (ingest) deliver frames at their own rate: push each one as it arrives.
+    while (!generator.paced() && !stop_requested_ && std::chrono::steady_clock::now() < end_time)
+    {
+        thread_registry_.set(state_slot, ThreadActivity::Waiting);
+        ImageData frame{cv::Mat(), i};
+        FrameGenerator::Result result = generator.generate(i, frame);
+        thread_registry_.set(state_slot, ThreadActivity::Working, frame.index);
+        if (!acceptGenerated(result, frame))
+        {
+            break;
+        }
+        i++;
+    }
+
+    // Loop until the specified end time (or until a stop is requested).
+    while (generator.paced() && !stop_requested_ && std::chrono::steady_clock::now() < end_time &&
+           (frame_count < 0 || i < frame_count))
+    {
+        auto current_time = std::chrono::steady_clock::now();
+        double requested_fps = target_fps_.load(std::memory_order_relaxed);
+        if (requested_fps != fps)
+        {
+            // New rate: keep the slot already due and space the following ones anew.
+            auto due = schedule_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_duration * (i - schedule_base));
+            schedule_start = std::max(due, current_time);
+            schedule_base = i;
+            fps = requested_fps;
+            frame_duration = std::chrono::duration<double>(1.0 / fps);
+        }
+        // Frames in this wakeup: the last batch only holds the slots that fall before end_time.
+        int count = batch;
+        if (batch > 1)
+        {
+            double slots_left = std::chrono::duration<double>(end_time - schedule_start) / frame_duration - (i - schedule_base);
+            count = static_cast<int>(std::min<double>(batch, slots_left));
+            if (frame_count >= 0)
+            {
+                count = static_cast<int>(std::min<long long>(count, frame_count - i));
+            }
+            if (count < 1)
+            {
+                break;
+            }
+        }
+
+        // Calculate the ideal time at which the next frame *should* be generated. A batch is
+        // generated at the slot of its last frame, so all its frames are already due.
+        auto next_frame_time = schedule_start + frame_duration * (i - schedule_base + count);
+
+        // --- FPS Control Logic ---
+        // If the current time is already past the ideal time for the next frame,
+        // it means we're falling behind. Skip this frame. Lateness is judged by each frame's
+        // own slot, so a batch starts at its first frame that is not late.
+        auto own_slot = schedule_start + frame_duration * (i - schedule_base + 1);
+        if (current_time > own_slot)
+        {
+            // Slots that passed while the sinks had no room were never demanded, not missed.
+            if (starved)
+            {
+                counters_.undemanded++;
+            }
+            else
+            {
+                counters_.late++; // Increment counter for skipped frames.
+            }
+            i++; // Still increment image index to maintain sequence for subsequent frames.
+            continue; // Skip to the next iteration to try for the next frame.
+        }
+
+        // Wait/sleep until the ideal time for the next frame arrives.
+        // This helps maintain the target FPS if generation is faster than required.
+        thread_registry_.set(state_slot, ThreadActivity::Waiting);
+        if (demand_driven_ && waitForDemand(end_time))
+        {
+            starved = true;
+            continue; // Re-check the schedule: the slot may have passed while waiting.
+        }
+        std::this_thread::sleep_until(next_frame_time);
+        thread_registry_.set(state_slot, ThreadActivity::Working, i);
+        starved = false;
+
+        if (fused_)
+        {
+            // Fused mode: hand out the index and its deadline; a saver generates the frame.
+            ImageData order{cv::Mat(), i};
+            order.deadline_ns = liveStatsNowNs() + fused_deadline_ns_;
+            push(std::move(order));
+            i++;
+            continue;
+        }
+
+        if (batch > 1)
+        {
+            // Batched mode: one wakeup, one generator call and one lock per queue for `batch`
+            // frames. Each frame is stamped with the time of its own slot.
+            int64_t wake_ns = liveStatsNowNs();
+            auto wake_time = std::chrono::steady_clock::now();
+            frames.clear();
+            generator.generateBatch(i, count, frames);
+            for (ImageData &frame : frames)
+            {
+                auto slot = schedule_start + frame_duration * (frame.index - schedule_base + 1);
+                frame.created_ns = wake_ns + std::chrono::duration_cast<std::chrono::nanoseconds>(slot - wake_time).count();
+            }
+            pushBatch(frames);
+            counters_.batches++;
+            i += count;
+            continue;
+        }
+
+        // Generate the actual image (one virtual call per frame).
+        ImageData frame{cv::Mat(), i};
+        if (!acceptGenerated(generator.generate(i, frame), frame))
+        {
+            break;
+        }
+        i++; // Increment image index for the next image.
+    }
+
+    // --- Post-generation: Signal savers that generation is complete ---
+    thread_registry_.set(state_slot, ThreadActivity::Exited);
+    finishProducing();
+}
+
+void Pipeline::wait()
+{
+    if (waited_)
+    {
+        return;
+    }
+    waited_ = true;
+    if (stage_channel_)
+    {
+        for (std::thread &t : stage_channel_->saverThreads)
+        {
+            t.join();
+        }
+    }
+
+    // Wait for all saver threads to complete their execution, then let each sink flush.
+    for (auto &route : routes_)
+    for (auto &channel : route->channels)
+    {
+        for (std::thread &t : channel->saverThreads)
+        {
+            if (t.joinable()) t.join();
+        }
+        channel->sink->finish();
+    }
+}
+
+/**
+ * @brief Empties a channel's queue, counting its frames as abandoned.
+ */
+void Pipeline::abandonQueue(SinkChannel &channel)
+{
+    std::lock_guard<std::mutex> lock(channel.queueMutex);
+    channel.abandoned += static_cast<int>(channel.imageQueue.size());
+    channel.queue_depth -= static_cast<int>(channel.imageQueue.size());
+    channel.queued_bytes = 0;
+    channel.imageQueue.clear();
+    channel.spaceCV.notify_all(); // Producers waiting for room (drop=block) see abandon_queued_frames_.
+}
+
+void Pipeline::abandonPending()
+{
+    abandon_queued_frames_ = true;
+    if (stage_channel_)
+    {
+        abandonQueue(*stage_channel_);
+    }
+    for (auto &route : routes_)
+    for (auto &channel : route->channels)
+    {
+        abandonQueue(*channel);
+    }
+}
+
+bool Pipeline::setSaverCount(size_t route, int threads, std::string &error)
+{
+    if (route >= routes_.size())
+    {
+        error = "destino inexistente";
+        return false;
+    }
+    if (threads < 1)
+    {
+        error = "se necesita al menos un hilo guardador";
+        return false;
+    }
+    for (auto &channel : routes_[route]->channels)
+    {
+        if (channel->ordered && threads != 1)
+        {
+            error = "el destino necesita un solo hilo";
+            return false;
+        }
+    }
+    // Striped routes have one channel per stripe: all of them are checked before any is changed,
+    // so a route is never left with different saver counts.
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto &channel : routes_[route]->channels)
+    {
+        locks.emplace_back(channel->queueMutex);
+        if (channel->finishedGenerating)
+        {
+            error = "la generación ya terminó";
+            return false;
+        }
+    }
+    for (auto &channel : routes_[route]->channels)
+    {
+        int current = channel->num_threads;
+        if (threads > current)
+        {
+            // Savers asked to retire but still running are kept instead of starting new ones.
+            int kept = std::min(channel->retire_requests, threads - current);
+            channel->retire_requests -= kept;
+            for (int k = current + kept; k < threads; ++k)
+            {
+                channel->saverThreads.emplace_back(&Pipeline::imageSaver, this, channel.get(), next_saver_id_++);
+            }
+        }
+        else if (threads < current)
+        {
+            channel->retire_requests += current - threads;
+            channel->queueCV.notify_all();
+        }
+        channel->num_threads = threads;
+    }
+    return true;
+}
+
+bool Pipeline::setDropPolicy(size_t route, DropPolicy policy)
+{
+    if (route >= routes_.size())
+    {
+        return false;
+    }
+    if (demand_driven_ && policy != DropPolicy::Block)
+    {
+        return false; // Any other policy would have frames generated only to be dropped.
+    }
+    for (auto &channel : routes_[route]->channels)
+    {
+        std::lock_guard<std::mutex> lock(channel->queueMutex);
+        channel->drop_policy = policy;
+        channel->spaceCV.notify_all();
+    }
+    return true;
+}
+
+bool Pipeline::setQueueLimit(size_t route, size_t limit)
+{
+    if (route >= routes_.size() || limit == 0)
+    {
+        return false;
+    }
+    for (auto &channel : routes_[route]->channels)
+    {
+        // A smaller limit is reached by not accepting frames, never by discarding queued ones.
+        std::lock_guard<std::mutex> lock(channel->queueMutex);
+        channel->max_queue_size = limit;
+        channel->spaceCV.notify_all();
+    }
+    return true;
+}
+
+/**
+ * @brief Function executed by each processing worker: takes frames from the stage queue,
+ *        runs the stage and fans the results out to the sinks.
+ */
+void Pipeline::frameProcessor(int worker_id)
+{
+    SinkChannel *channel = stage_channel_.get();
+    std::vector<cv::Mat> scratch; // Intermediate results of this worker, reused for every frame.
+    std::vector<ImageData> extra; // Derived frames (pyramid levels) of the current frame.
+    int state_slot = thread_registry_.add("procesador " + std::to_string(worker_id));
+    while (true)
+    {
+        ImageData imgData;
+        {
+            std::unique_lock<std::mutex> lock(channel->queueMutex);
+            thread_registry_.set(state_slot, ThreadActivity::Waiting);
+            channel->queueCV.wait(lock, [channel]
+                                  { return !channel->imageQueue.empty() || channel->finishedGenerating; });
+            if (channel->imageQueue.empty())
+            {
+                break; // Producer finished and the queue is drained.
+            }
+            imgData = std::move(channel->imageQueue.front());
+            channel->imageQueue.pop_front();
+            queueRemoved(*channel, imgData);
+            if (channel->drop_policy == DropPolicy::Block)
+            {
+                channel->spaceCV.notify_one();
+            }
+        }
+
+        // Frames that arrived already encoded (ingest mode) cannot be processed; they are
+        // passed through unchanged.
+        thread_registry_.set(state_slot, ThreadActivity::Working, imgData.index);
+        auto process_start = std::chrono::steady_clock::now();
+        extra.clear();
+        if (!imgData.encoded)
+        {
+            try
+            {
+                stage_->processFrame(imgData, extra, scratch);
+                channel->saved++;
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Error: Hilo de procesamiento " << worker_id << " falló con la imagen "
+                          << imgData.index << ": " << e.what() << std::endl;
+                channel->failed++;
+                continue;
+            }
+        }
+        else
+        {
+            channel->passed_through++;
+        }
+        channel->write_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - process_start).count());
+        fanOutImages(&imgData, 1);
+        for (const ImageData &derived : extra)
+        {
+            fanOutImages(&derived, 1);
+        }
+    }
+    thread_registry_.set(state_slot, ThreadActivity::Exited);
+    if (--active_processing_workers_ == 0)
+    {
+        finishSinks();
+    }
+}
+
+/**
+ * @brief Fused mode: generates the frame of an order on the calling saver. `buffer` (the
+ *        saver's previous frame) is reused unless a sink still holds a reference to it.
+ * @return false if the frame was not generated: its deadline had passed (counted as expired)
+ *         or the generator failed (counted as failed).
+ */
+bool Pipeline::generateAssigned(SinkChannel *channel, ImageData &order, cv::Mat &buffer)
+{
+    if (order.deadline_ns > 0 && liveStatsNowNs() > order.deadline_ns)
+    {
+        channel->dropped++;
+        channel->expired++;
+        return false;
+    }
+    if (buffer.u && buffer.u->refcount > 1)
+    {
+        buffer.release(); // Kept by a sink: leave it to the sink and allocate a new one.
+    }
+    order.image = buffer;
+    auto generate_start = std::chrono::steady_clock::now();
+    bool ok = fused_generator_->generate(order.index, order) == FrameGenerator::Result::Frame;
+    channel->generate_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - generate_start).count();
+    if (!ok)
+    {
+        channel->failed++;
+        return false;
+    }
+    counters_.generated++;
+    if (watermark_)
+    {
+        stampFrame(order);
+    }
+    buffer = order.image;
+    return true;
+}
+
+/**
+ * @brief Function executed by each saver thread of a channel.
+ *
+ * Continuously takes images from the channel's queue and delivers them to its sink.
+ * Exits when generation is finished and the queue is empty, or when the saver count of the
+ * channel is lowered.
+ *
+ * @param channel Channel whose queue this saver drains.
+ * @param saver_id Unique ID for this saver thread (for logging purposes).
+ */
+void Pipeline::imageSaver(SinkChannel *channel, int saver_id)
+{
+    int state_slot = thread_registry_.add("guardador " + std::to_string(saver_id) + " " + channel->label);
+    cv::Mat fused_buffer; // Fused mode: this saver's frame buffer, reused from frame to frame.
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(channel->queueMutex); // Acquire lock to check queue and wait.
+        // Wait on the condition variable. The thread will sleep until:
+        // 1. The queue is not empty (an image is available), OR
+        // 2. The `finishedGenerating` flag is true (generator is done).
+        // The lambda predicate prevents spurious wakeups.
+        channel->queueCV.wait(lock, [channel]
+                              { return !channel->imageQueue.empty() || channel->finishedGenerating || channel->retire_requests > 0; });
+
+        // --- Process images currently in the queue ---
+        // This inner loop ensures all available images are processed after a wakeup
+        // before re-evaluating the main loop condition (especially `finishedGenerating`).
+        while (!channel->imageQueue.empty())
+        {
+            ImageData imgData = std::move(channel->imageQueue.front()); // Get image from the front of the queue.
+            channel->imageQueue.pop_front();                            // Remove it from the queue.
+            queueRemoved(*channel, imgData);
+            if (channel->drop_policy == DropPolicy::Block)
+            {
+                channel->spaceCV.notify_one(); // Room for a producer waiting on a full queue.
+            }
+            lock.unlock(); // IMPORTANT: Unlock the mutex while saving the image (I/O bound, can be slow).
+                           // This allows other savers or the generator to access the queue.
+
+            thread_registry_.set(state_slot, ThreadActivity::Working, imgData.index);
+            // Fused mode: the queue holds frame indices; generate this one here, on the core
+            // that is about to encode it.
+            if (fused_generator_ && imgData.image.empty() && !generateAssigned(channel, imgData, fused_buffer))
+            {
+                thread_registry_.set(state_slot, ThreadActivity::Waiting);
+                lock.lock();
+                continue;
+            }
+            auto write_start = std::chrono::steady_clock::now();
+            bool success = channel->sink->write(imgData, saver_id);
+            long long write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count();
+            thread_registry_.set(state_slot, ThreadActivity::Waiting);
+            channel->write_ns_total += write_ns;
+            channel->write_latency.record(write_ns);
+            channel->frame_age.record(liveStatsNowNs() - imgData.created_ns);
+            // Moving average with weight 1/8 for the new sample; an occasional lost update between
+            // savers only delays the estimate slightly.
+            long long ewma = channel->write_ns_ewma.load(std::memory_order_relaxed);
+            channel->write_ns_ewma.store(ewma == 0 ? write_ns : ewma + (write_ns - ewma) / 8, std::memory_order_relaxed);
+
+            if (success)
+            {
+                channel->saved++;
+                counters_.saved++; // Increment pipeline counter for saved images.
+                counters_.level_saved[imgData.level]++;
+                counters_.level_write_ns[imgData.level] += write_ns;
+            }
+            else
+            {
+                channel->failed++;
+            }
+
+            lock.lock(); // Re-acquire the lock before checking imageQueue.empty() in the loop condition
+                         // and before potentially waiting on queueCV again.
+            if (channel->retire_requests > 0)
+            {
+                break; // The saver count was lowered: leave after the frame in hand, below.
+            }
+        }
+
+        // The saver count was lowered (setSaverCount): this saver exits, the others go on.
+        if (channel->retire_requests > 0)
+        {
+            channel->retire_requests--;
+            break;
+        }
+
+        // --- Exit Condition for Saver Thread ---
+        // If image generation is finished AND the queue is now empty, the saver can exit.
+        if (channel->finishedGenerating && channel->imageQueue.empty())
+        {
+            break; // Exit the while(true) loop.
+        }
+        // If finishedGenerating is true but queue was not empty, loop continues to process remaining items.
+        // If queue became empty but finishedGenerating is false, loop continues to wait for more images.
+    }
+    thread_registry_.set(state_slot, ThreadActivity::Exited);
+}
+
+void Pipeline::dumpLiveStats(std::ostream &out) const
+{
+    auto channelLines = [&out](const SinkChannel &channel) {
+        out << "    encoladas " << channel.enqueued.load() << ", guardadas " << channel.saved.load() << ", descartadas "
+            << channel.dropped.load() << ", errores " << channel.failed.load() << ", en cola "
+            << channel.queue_depth.load() << "/" << channel.max_queue_size << " ("
+            << channel.queued_bytes.load() / (1024.0 * 1024.0) << " MB), hilos " << channel.num_threads;
+        if (channel.blocked.load() > 0)
+        {
+            out << ", esperas por cola llena " << channel.blocked.load();
+        }
+        out << "\n";
+        out << "    escritura: " << channel.write_latency.summary() << "\n";
+        if (channel.frame_age.count() > 0)
+        {
+            out << "    edad al escribir: " << channel.frame_age.summary() << "\n";
+        }
+    };
+    out << std::fixed << std::setprecision(2) << "=== Estadísticas en vivo (SIGUSR1) a los "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count() << " s ===\n";
+    out << "Generadas " << counters_.generated.load() << ", guardadas " << counters_.saved.load()
+        << ", descartadas por atraso " << counters_.late.load();
+    if (demand_driven_)
+    {
+        out << ", sin demanda " << counters_.undemanded.load();
+    }
+    out << ", FPS objetivo " << target_fps_.load() << (stop_requested_ ? " (deteniéndose)" : "") << "\n";
+    if (stage_channel_)
+    {
+        out << "Procesamiento (tiempo por imagen):\n";
+        channelLines(*stage_channel_);
+    }
+    for (size_t r = 0; r < routes_.size(); ++r)
+    for (const auto &channel : routes_[r]->channels)
+    {
+        out << "[" << r << "] " << channel->sink->describe() << "\n";
+        channelLines(*channel);
+    }
+    out << "Hilos:\n" << thread_registry_.snapshot() << std::flush;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm> // For std::max
+#include <atomic>   // For std::atomic counters and flags
+#include <chrono>   // For std::chrono::steady_clock
+#include <condition_variable> // For std::condition_variable
+#include <deque>    // For std::deque
+#include <memory>   // For std::unique_ptr
+#include <mutex>    // For std::mutex
+#include <ostream>  // For std::ostream (live statistics)
+#include <string>   // For std::string
+#include <thread>   // For std::thread
+#include <vector>   // For std::vector
+#include "image_data.hpp"       // ImageData
+#include "sinks.hpp"            // FrameSink
+#include "processing.hpp"       // FrameStage, MAX_PYRAMID_LEVELS
+#include "frame_generators.hpp" // FrameGenerator
+#include "live_stats.hpp"       // LatencyHistogram, ThreadRegistry
+
+// Default number of saver threads per sink.
+const int NUM_SAVER_THREADS = 7;
+
+// Maximum number of images allowed in a sink's queue (default). If full, oldest is dropped.
+// Could manually increase it if the computer can handle it.
+const size_t MAX_QUEUE_SIZE = 100;
+
+// What a sink does with a new image when its queue is full.
+enum class DropPolicy
+{
+    Oldest, // Drop the oldest queued image to make room (the original behaviour).
+    Newest, // Reject the incoming image and keep the queue as it is.
+    Block   // Wait for a saver to make room: the producer slows down to what the sink takes.
+};
+
+// Name of a drop policy as written in sink specs and control commands ("oldest", "newest", "block").
+const char *dropPolicyName(DropPolicy policy);
+bool parseDropPolicy(const std::string &text, DropPolicy &policy);
+
+// A sink together with its own bounded queue, saver threads and statistics.
+// Every frame is offered to one channel of every route, sharing the pixel buffer through
+// cv::Mat reference counting; a slow channel only drops its own frames and never blocks the others.
+struct SinkChannel
+{
+    std::unique_ptr<FrameSink> sink;
+    std::atomic<int> num_threads{NUM_SAVER_THREADS}; // Saver threads running (see Pipeline::setSaverCount).
+    bool ordered = false;                    // The sink needs frames in order from a single thread.
+    std::string label;                       // "[r]" or "[r.k]" as in the reports, for thread listings.
+    // The following two are changed under queueMutex while the savers run.
+    size_t max_queue_size = MAX_QUEUE_SIZE;
+    DropPolicy drop_policy = DropPolicy::Oldest;
+
+    // Queue to transfer ImageData from the generator thread to this sink's saver threads.
+    std::deque<ImageData> imageQueue;
+    // Mutex to protect access to imageQueue and the finishedGenerating flag.
+    std::mutex queueMutex;
+    // Condition variable to signal saver threads when new images are available or generation is finished.
+    std::condition_variable queueCV;
+    // Signalled when a frame leaves the queue under DropPolicy::Block, for producers waiting for room.
+    std::condition_variable spaceCV;
+    // Flag to indicate to saver threads that the image generator has finished its work.
+    bool finishedGenerating = false;
+    std::vector<std::thread> saverThreads;
+    int retire_requests = 0; // Savers asked to exit (under queueMutex).
+
+    std::atomic<int> enqueued{0}; // Images accepted into the queue.
+    std::atomic<int> dropped{0};  // Images dropped because the queue was full.
+    std::atomic<int> saved{0};    // Images written successfully.
+    std::atomic<int> failed{0};   // Images the sink failed to write.
+    std::atomic<int> abandoned{0}; // Images left unwritten when the drain deadline expired.
+    std::atomic<int> evicted{0};   // Queued images pushed out by newer ones (drop=oldest); part of dropped.
+    std::atomic<int> blocked{0};   // Images that had to wait for room (drop=block).
+    std::atomic<int> passed_through{0}; // Processing stage: encoded frames forwarded unprocessed.
+    std::atomic<int> expired{0};   // Fused mode: frames skipped because no saver started them by their deadline; part of dropped.
+    std::atomic<long long> generate_ns{0}; // Fused mode: time spent generating frames on this channel's savers.
+    std::atomic<long long> blocked_ns{0}; // Time those images waited.
+    std::atomic<int> queue_depth{0};          // imageQueue.size(), readable without the mutex.
+    std::atomic<long long> queued_bytes{0};      // Pixel (or encoded) bytes of the frames in imageQueue.
+    std::atomic<long long> peak_queued_bytes{0}; // Highest queued_bytes seen (updated under queueMutex).
+    std::atomic<long long> write_ns_total{0}; // Time spent in sink->write() by all savers.
+    std::atomic<long long> write_ns_ewma{0};  // Moving average of the time of one write (0 = not measured yet).
+    LatencyHistogram write_latency; // Time of each sink->write() (or of each frame, in the processing stage).
+    LatencyHistogram frame_age;     // From the frame entering the pipeline to it being written.
+};
+
+// How a route with several channels (one per output device) picks the channel for each frame.
+enum class StripePolicy
+{
+    RoundRobin, // Channels take turns.
+    Adaptive    // Channel with the shortest expected wait (queue depth x measured write time).
+};
+
+// One logical output, as given by --sink. Usually a single channel; a disk sink striped across
+// several output directories has one channel per directory, each with its own queue and savers,
+// and every frame goes to exactly one of them.
+struct SinkRoute
+{
+    std::vector<std::unique_ptr<SinkChannel>> channels;
+    StripePolicy stripe_policy = StripePolicy::RoundRobin;
+    size_t next_channel = 0; // Round-robin position; only the producer thread uses it.
+};
+
+// Frame counters of a pipeline.
+struct PipelineCounters
+{
+    std::atomic<int> generated{0}; // Frames that entered the pipeline.
+    std::atomic<int> saved{0};     // Frames written successfully, all sinks together.
+    std::atomic<int> enqueued{0};  // Frames offered to a sink queue (once per sink), even if rejected.
+    std::atomic<int> late{0};      // Frames skipped because the producer was behind its schedule.
+    std::atomic<int> undemanded{0}; // Frames skipped, never generated, while the sinks had no room (demand-driven mode).
+    std::atomic<int> batches{0};    // Batches generated (batched mode).
+    std::atomic<int> unmarked{0};   // Frames too small (or not 8-bit) for a pixel watermark (setWatermark()).
+    // Images saved and time spent writing them, per pyramid level (level 0 = full resolution).
+    std::atomic<int> level_saved[MAX_PYRAMID_LEVELS + 1] = {};
+    std::atomic<long long> level_write_ns[MAX_PYRAMID_LEVELS + 1] = {};
+};
+
+/**
+ * @brief A producer -> optional processing stage -> sinks pipeline.
+ *
+ * Every frame pushed into the pipeline goes through the stage (on its worker threads), then is
+ * offered to one channel of every route. Each channel has its own bounded queue, drop policy
+ * and saver threads, which call FrameSink::write() once per frame. Nothing is shared between
+ * pipelines, so several can run in one process.
+ *
+ * Usage: addRoute() and setStage(), then start(); feed frames with push() (or generate()) from
+ * one producer thread and call finishProducing(); wait() then joins every thread and finishes
+ * the sinks.
+ */
+class Pipeline
+{
+public:
+    Pipeline() = default;
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    /**
+     * @brief Finishes the pipeline (finishProducing() + wait()) if that was not done yet.
+     */
+    ~Pipeline();
+
+    // --- Setup, before start() ---
+
+    /**
+     * @brief Adds an output. Its channels are labelled "[r]" (or "[r.k]" when striped).
+     */
+    void addRoute(std::unique_ptr<SinkRoute> route);
+
+    /**
+     * @brief Runs `stage` on `threads` worker threads before the sinks.
+     */
+    void setStage(std::unique_ptr<FrameStage> stage, int threads);
+
+    /**
+     * @brief Demand-driven generation: start() gives every channel (and the processing stage)
+     *        DropPolicy::Block, and generate() only generates a frame once the queue it will enter
+     *        has room. Slots that pass while waiting are skipped without generating anything and
+     *        counted as undemanded, so no frame is generated just to be dropped.
+     */
+    void setDemandDriven(bool on) { demand_driven_ = on; }
+    bool demandDriven() const { return demand_driven_; }
+
+    /**
+     * @brief Fused generate+encode: generate() only schedules, handing out each frame index
+     *        with a deadline `deadline_ms` after its slot, and the saver that takes the index
+     *        generates the frame and writes it right away, on the same core. Needs a generator
+     *        with independentFrames(), no processing stage and a single route (which may be
+     *        striped), otherwise generate() warns and runs unfused. counters().generated counts
+     *        the frames the savers generated. The generator must outlive wait().
+     */
+    void setFused(bool on, double deadline_ms = 1000)
+    {
+        fused_ = on;
+        fused_deadline_ns_ = static_cast<int64_t>(deadline_ms * 1e6);
+    }
+    bool fused() const { return fused_; }
+
+    /**
+     * @brief Batched generation for high frame rates: generate() wakes up once every `frames`
+     *        slots, at the slot of the last one, has the generator produce them together
+     *        (FrameGenerator::generateBatch()) and pushes them with pushBatch(). Every frame
+     *        keeps its own index, and its created_ns is the time of its own slot. Ignored in
+     *        fused mode.
+     */
+    void setBatchSize(int frames) { batch_size_ = std::max(1, frames); }
+    int batchSize() const { return batch_size_; }
+
+    /**
+     * @brief Pixel watermarks: every frame gets its index and the time it entered the pipeline
+     *        as a barcode in its top rows (stampWatermark()), right before it is queued for the
+     *        sinks, after the processing stage. Encoded frames are left alone.
+     */
+    void setWatermark(bool enabled) { watermark_ = enabled; }
+    bool watermark() const { return watermark_; }
+
+    /**
+     * @brief Starts the processing workers and the saver threads.
+     */
+    void start();
+
+    // --- Producer side (one producer thread) ---
+
+    /**
+     * @brief Feeds one frame into the pipeline and counts it as generated.
+     */
+    void push(ImageData frame);
+
+    /**
+     * @brief Feeds several frames at once: every queue is locked and its savers woken once
+     *        for the whole batch. Frames without created_ns get the current time.
+     */
+    void pushBatch(std::vector<ImageData> &frames);
+
+    /**
+     * @brief Tells the pipeline that no more frames will be pushed. With a processing stage the
+     *        sinks are finished later, by the last processing worker once the stage has drained.
+     */
+    void finishProducing();
+
+    /**
+     * @brief Pushes frames from `generator` at targetFps() until `end_time`, stopRequested() or
+     *        the end of a finite generator, then calls finishProducing(). Frames whose slot has
+     *        already passed are skipped and counted as late. Unpaced generators (ingest) are
+     *        called back to back and every frame they return is pushed.
+     */
+    void generate(FrameGenerator &generator, std::chrono::steady_clock::time_point end_time);
+
+    /**
+     * @brief Joins the processing workers and saver threads (after finishProducing()) and calls
+     *        finish() on every sink.
+     */
+    void wait();
+
+    // --- Runtime control; safe while the pipeline runs ---
+
+    void setTargetFps(double fps) { target_fps_ = fps; }
+    double targetFps() const { return target_fps_.load(); }
+
+    /**
+     * @brief Asks the producer to stop; the queues still drain normally.
+     */
+    void requestStop() { stop_requested_ = true; }
+    bool stopRequested() const { return stop_requested_.load(); }
+
+    /**
+     * @brief Empties every queue and discards frames pushed from now on, counting them as
+     *        abandoned. Frames being written are finished.
+     */
+    void abandonPending();
+    bool abandoning() const { return abandon_queued_frames_.load(); }
+
+    /**
+     * @brief Starts or retires saver threads of a route. Retiring savers finish the frame in hand.
+     * @return false with `error` set if the route does not exist, needs a single thread or is done.
+     */
+    bool setSaverCount(size_t route, int threads, std::string &error);
+
+    /**
+     * @brief Changes the drop policy or the queue limit of a route. Lowering the limit never
+     *        discards frames already queued. In demand-driven mode only DropPolicy::Block is
+     *        accepted.
+     */
+    bool setDropPolicy(size_t route, DropPolicy policy);
+    bool setQueueLimit(size_t route, size_t limit);
+
+    // --- Inspection ---
+
+    const std::vector<std::unique_ptr<SinkRoute>> &routes() const { return routes_; }
+    const SinkChannel *stageChannel() const { return stage_channel_.get(); }
+    PipelineCounters &counters() { return counters_; }
+    const PipelineCounters &counters() const { return counters_; }
+    ThreadRegistry &threads() { return thread_registry_; }
+    std::chrono::steady_clock::time_point startTime() const { return start_time_; }
+
+    /**
+     * @brief Writes a snapshot of the running pipeline: counters, queue depths, latency
+     *        histograms and the activity of every thread.
+     *
+     * It only reads atomics (never a queue mutex), so the producer and the savers are not
+     * paused; the figures of different sinks may be a few frames apart.
+     */
+    void dumpLiveStats(std::ostream &out) const;
+
+private:
+    SinkChannel *pickChannel(SinkRoute &route);
+    bool waitForDemand(std::chrono::steady_clock::time_point end_time);
+    bool generateAssigned(SinkChannel *channel, ImageData &order, cv::Mat &buffer);
+    bool acceptGenerated(FrameGenerator::Result result, ImageData &frame);
+    void offerToChannel(SinkChannel *channel, const ImageData *frames, size_t count);
+    void fanOutImages(const ImageData *frames, size_t count);
+    void stampFrame(const ImageData &frame);
+    void finishChannel(SinkChannel &channel);
+    void finishSinks();
+    void abandonQueue(SinkChannel &channel);
+    void frameProcessor(int worker_id);
+    void imageSaver(SinkChannel *channel, int saver_id);
+
+    std::vector<std::unique_ptr<SinkRoute>> routes_;
+    // Optional processing stage between the producer and the sinks. It reuses the queue of a
+    // SinkChannel (without a sink): its worker threads run the stage and fan each result out
+    // to the sink routes.
+    std::unique_ptr<FrameStage> stage_;
+    std::unique_ptr<SinkChannel> stage_channel_;
+    // Processing workers still running; the last one to exit tells the sinks no more frames will come.
+    std::atomic<int> active_processing_workers_{0};
+
+    PipelineCounters counters_;
+    std::atomic<double> target_fps_{30};
+    std::atomic<int> next_saver_id_{0}; // Savers started at runtime continue the sequence.
+    std::atomic<bool> stop_requested_{false};
+    std::atomic<bool> abandon_queued_frames_{false};
+    ThreadRegistry thread_registry_; // Activity of the producer, processing and saver threads.
+    std::chrono::steady_clock::time_point start_time_;
+    bool demand_driven_ = false;
+    bool fused_ = false;
+    int batch_size_ = 1;
+    bool watermark_ = false;
+    int64_t fused_deadline_ns_ = 0;
+    FrameGenerator *fused_generator_ = nullptr; // Set by generate() in fused mode, before the first order.
+    bool started_ = false;
+    bool producing_finished_ = false;
+    bool waited_ = false;
+};
@@ -0,0 +1,239 @@
+#include "processing.hpp"
+
+#include <chrono>   // For timing each operator
+#include <cmath>    // For std::pow
+#include <sstream>  // For std::istringstream
+#include <opencv2/imgproc.hpp> // OpenCV image processing
+#include "yuv420.hpp" // BGR to NV12/I420 conversion
+
+namespace
+{
+
+// resize:<factor> or resize:<ancho>x<alto>. INTER_AREA when shrinking (the usual capture
+// downscale), INTER_LINEAR when enlarging.
+class ResizeOperator : public FrameOperator
+{
+public:
+    ResizeOperator(double factor, cv::Size size) : factor_(factor), size_(size) {}
+    void apply(const cv::Mat &src, cv::Mat &dst) const override
+    {
+        cv::Size out = outputSize(src.size());
+        int interpolation = out.area() < src.size().area() ? cv::INTER_AREA : cv::INTER_LINEAR;
+        cv::resize(src, dst, out, 0, 0, interpolation);
+    }
+    cv::Size outputSize(cv::Size input) const override
+    {
+        if (size_.width > 0)
+        {
+            return size_;
+        }
+        return cv::Size(std::max(1, static_cast<int>(input.width * factor_ + 0.5)),
+                        std::max(1, static_cast<int>(input.height * factor_ + 0.5)));
+    }
+    std::string name() const override
+    {
+        return size_.width > 0 ? "resize:" + std::to_string(size_.width) + "x" + std::to_string(size_.height)
+                               : "resize:" + std::to_string(factor_).substr(0, 4);
+    }
+
+private:
+    double factor_;
+    cv::Size size_;
+};
+
+// yuv: BGR to packed YUV 4:4:4 (same size, 3 channels). gray: BGR to 1-channel luma.
+class ColorOperator : public FrameOperator
+{
+public:
+    ColorOperator(int code, int channels, std::string name) : code_(code), channels_(channels), name_(std::move(name)) {}
+    void apply(const cv::Mat &src, cv::Mat &dst) const override { cv::cvtColor(src, dst, code_); }
+    int outputType(int input) const override { return CV_MAKETYPE(CV_MAT_DEPTH(input), channels_); }
+    std::string name() const override { return name_; }
+
+private:
+    int code_;
+    int channels_;
+    std::string name_;
+};
+
+// nv12 / i420: BGR to YUV 4:2:0 for encoder-style consumers ((height * 3 / 2) x width, 1 channel).
+// The ":cv" variants use cv::cvtColor instead of the built-in converter, for comparison.
+class Yuv420Operator : public FrameOperator
+{
+public:
+    Yuv420Operator(Yuv420Layout layout, bool use_opencv) : layout_(layout), use_opencv_(use_opencv) {}
+    void apply(const cv::Mat &src, cv::Mat &dst) const override
+    {
+        if (use_opencv_)
+        {
+            bgrToYuv420OpenCV(src, dst, layout_);
+        }
+        else
+        {
+            bgrToYuv420(src, dst, layout_);
+        }
+    }
+    cv::Size outputSize(cv::Size input) const override { return cv::Size(input.width, input.height * 3 / 2); }
+    int outputType(int) const override { return CV_8UC1; }
+    std::string name() const override
+    {
+        return std::string(layout_ == Yuv420Layout::NV12 ? "nv12" : "i420") + (use_opencv_ ? ":cv" : "");
+    }
+
+private:
+    Yuv420Layout layout_;
+    bool use_opencv_;
+};
+
+// gamma:<g>: out = 255 * (in / 255)^(1/g) through a 256-entry lookup table.
+class GammaOperator : public FrameOperator
+{
+public:
+    explicit GammaOperator(double gamma) : gamma_(gamma), table_(1, 256, CV_8UC1)
+    {
+        for (int v = 0; v < 256; ++v)
+        {
+            table_.at<uchar>(0, v) = cv::saturate_cast<uchar>(255.0 * std::pow(v / 255.0, 1.0 / gamma));
+        }
+    }
+    void apply(const cv::Mat &src, cv::Mat &dst) const override { cv::LUT(src, table_, dst); }
+    std::string name() const override { return "gamma:" + std::to_string(gamma_).substr(0, 4); }
+
+private:
+    double gamma_;
+    cv::Mat table_;
+};
+
+// blur:<k>: Gaussian blur with a k x k kernel (k odd).
+class BlurOperator : public FrameOperator
+{
+public:
+    explicit BlurOperator(int kernel) : kernel_(kernel) {}
+    void apply(const cv::Mat &src, cv::Mat &dst) const override { cv::GaussianBlur(src, dst, cv::Size(kernel_, kernel_), 0); }
+    std::string name() const override { return "blur:" + std::to_string(kernel_); }
+
+private:
+    int kernel_;
+};
+
+} // namespace
+
+ProcessingChain::ProcessingChain(size_t pool_buffers) : pool_(pool_buffers)
+{
+}
+
+bool ProcessingChain::parse(const std::string &spec, std::string &error)
+{
+    std::istringstream tokens(spec);
+    std::string token;
+    while (std::getline(tokens, token, ','))
+    {
+        size_t colon = token.find(':');
+        std::string op = token.substr(0, colon);
+        std::string param = colon == std::string::npos ? "" : token.substr(colon + 1);
+        try
+        {
+            if (op == "resize" && param.find('x') != std::string::npos)
+            {
+                int w = std::stoi(param.substr(0, param.find('x')));
+                int h = std::stoi(param.substr(param.find('x') + 1));
+                if (w <= 0 || h <= 0) throw std::invalid_argument(param);
+                operators_.push_back(std::make_unique<ResizeOperator>(0.0, cv::Size(w, h)));
+            }
+            else if (op == "resize" && std::stod(param) > 0)
+            {
+                operators_.push_back(std::make_unique<ResizeOperator>(std::stod(param), cv::Size()));
+            }
+            else if (op == "yuv" && param.empty())
+            {
+                operators_.push_back(std::make_unique<ColorOperator>(cv::COLOR_BGR2YUV, 3, "yuv"));
+            }
+            else if ((op == "nv12" || op == "i420") && (param.empty() || param == "cv"))
+            {
+                operators_.push_back(std::make_unique<Yuv420Operator>(
+                    op == "nv12" ? Yuv420Layout::NV12 : Yuv420Layout::I420, param == "cv"));
+            }
+            else if (op == "gray" && param.empty())
+            {
+                operators_.push_back(std::make_unique<ColorOperator>(cv::COLOR_BGR2GRAY, 1, "gray"));
+            }
+            else if (op == "gamma" && std::stod(param) > 0)
+            {
+                operators_.push_back(std::make_unique<GammaOperator>(std::stod(param)));
+            }
+            else if (op == "blur" && std::stoi(param) > 0 && std::stoi(param) % 2 == 1)
+            {
+                operators_.push_back(std::make_unique<BlurOperator>(std::stoi(param)));
+            }
+            else
+            {
+                error = "operador desconocido o parámetro inválido: " + token;
+                return false;
+            }
+        }
+        catch (...)
+        {
+            error = "parámetro inválido: " + token;
+            return false;
+        }
+    }
+    timings_ = std::make_unique<std::atomic<long long>[]>(operators_.size());
+    for (size_t k = 0; k < operators_.size(); ++k)
+    {
+        timings_[k] = 0;
+    }
+    return true;
+}
+
+cv::Mat ProcessingChain::process(const cv::Mat &input, std::vector<cv::Mat> &scratch)
+{
+    scratch.resize(operators_.size());
+    const cv::Mat *current = &input;
+    for (size_t k = 0; k < operators_.size(); ++k)
+    {
+        cv::Mat &dst = scratch[k];
+        if (k + 1 == operators_.size())
+        {
+            // The last result leaves this thread, so it comes from the pool.
+            dst = pool_.acquire(operators_[k]->outputSize(current->size()), operators_[k]->outputType(current->type()));
+        }
+        auto start = std::chrono::steady_clock::now();
+        operators_[k]->apply(*current, dst);
+        timings_[k] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        current = &dst;
+    }
+    cv::Mat output = scratch.back();
+    scratch.back().release(); // Only the queues (and the pool) keep the output alive.
+    frames_++;
+    return output;
+}
+
+void ProcessingChain::processFrame(ImageData &frame, std::vector<ImageData> &extra, std::vector<cv::Mat> &scratch)
+{
+    if (!empty())
+    {
+        frame.image = process(frame.image, scratch);
+    }
+    std::vector<cv::Mat> levels = pyramid(frame.image);
+    for (size_t k = 0; k < levels.size(); ++k)
+    {
+        extra.push_back({levels[k], frame.index, false, static_cast<int>(k + 1), frame.created_ns});
+    }
+}
+
+std::vector<cv::Mat> ProcessingChain::pyramid(const cv::Mat &base)
+{
+    std::vector<cv::Mat> levels;
+    levels.reserve(pyramid_levels_); // `previous` points into the vector.
+    const cv::Mat *previous = &base;
+    for (int level = 1; level <= pyramid_levels_; ++level)
+    {
+        cv::Size size((previous->cols + 1) / 2, (previous->rows + 1) / 2);
+        auto start = std::chrono::steady_clock::now();
+        levels.push_back(pool_.acquire(size, previous->type()));
+        cv::resize(*previous, levels.back(), size, 0, 0, cv::INTER_AREA);
+        pyramid_ns_[level] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        previous = &levels.back();
+    }
+    return levels;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>   // For std::atomic timing counters
+#include <memory>   // For std::unique_ptr
+#include <string>   // For std::string
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+#include "frame_pool.hpp"   // Reusable output buffers
+#include "image_data.hpp"   // ImageData (FrameStage)
+
+// Maximum number of reduced levels below the full-resolution frame (--pyramid).
+const int MAX_PYRAMID_LEVELS = 7;
+
+/**
+ * @brief One per-frame processing step (resize, color conversion, gamma, blur...).
+ *
+ * apply() must write into `dst`; when `dst` already has the size and type reported by
+ * outputSize()/outputType(), OpenCV reuses its memory instead of allocating.
+ */
+class FrameOperator
+{
+public:
+    virtual ~FrameOperator() = default;
+    virtual void apply(const cv::Mat &src, cv::Mat &dst) const = 0;
+    virtual cv::Size outputSize(cv::Size input) const { return input; }
+    virtual int outputType(int input) const { return input; }
+    virtual std::string name() const = 0;
+};
+
+/**
+ * @brief Processing stage of a Pipeline: runs on its worker threads between the producer and
+ *        the sinks, once per frame.
+ *
+ * processFrame() is called concurrently from several workers; each passes its own scratch
+ * vector, which it may use to keep intermediate buffers from frame to frame.
+ */
+class FrameStage
+{
+public:
+    virtual ~FrameStage() = default;
+
+    /**
+     * @brief Transforms `frame` in place and appends any derived frames (e.g. pyramid levels)
+     *        to `extra`. All of them are then offered to every sink. May throw on failure.
+     */
+    virtual void processFrame(ImageData &frame, std::vector<ImageData> &extra, std::vector<cv::Mat> &scratch) = 0;
+};
+
+/**
+ * @brief Ordered list of operators applied to every frame, with per-operator timing.
+ *
+ * process() may be called from several threads at once; each thread passes its own scratch
+ * vector, which holds the intermediate results and is reused from frame to frame. The final
+ * result is taken from a FramePool so it can be queued to the sinks without a copy.
+ */
+class ProcessingChain : public FrameStage
+{
+public:
+    explicit ProcessingChain(size_t pool_buffers);
+
+    /**
+     * @brief FrameStage entry point: process() followed by pyramid(), whose levels go to `extra`.
+     */
+    void processFrame(ImageData &frame, std::vector<ImageData> &extra, std::vector<cv::Mat> &scratch) override;
+
+    /**
+     * @brief Parses a chain such as "resize:0.5,yuv,gamma:2.2,blur:5".
+     * @return false (with `error` set) on an unknown operator or invalid parameter.
+     */
+    bool parse(const std::string &spec, std::string &error);
+
+    bool empty() const { return operators_.empty(); }
+
+    /**
+     * @brief Runs every operator on `input` and returns the result.
+     */
+    cv::Mat process(const cv::Mat &input, std::vector<cv::Mat> &scratch);
+
+    void setPyramidLevels(int levels) { pyramid_levels_ = levels; }
+    int pyramidLevels() const { return pyramid_levels_; }
+
+    /**
+     * @brief Builds the reduced levels of `base`: level k (1-based) is 1/2^k of its size and is
+     *        downsampled from level k-1 with INTER_AREA, which OpenCV vectorizes for exact 2x
+     *        reductions. The levels come from the buffer pool.
+     */
+    std::vector<cv::Mat> pyramid(const cv::Mat &base);
+
+    size_t size() const { return operators_.size(); }
+    std::string name(size_t k) const { return operators_[k]->name(); }
+    long long nanoseconds(size_t k) const { return timings_[k].load(); } // Time spent in operator k.
+    long long frames() const { return frames_.load(); }                  // Frames processed.
+    long long pyramidNanoseconds(int level) const { return pyramid_ns_[level].load(); } // Time spent building level.
+    const FramePool &pool() const { return pool_; }
+
+private:
+    std::vector<std::unique_ptr<FrameOperator>> operators_;
+    std::unique_ptr<std::atomic<long long>[]> timings_;
+    std::atomic<long long> frames_{0};
+    int pyramid_levels_ = 0;
+    std::atomic<long long> pyramid_ns_[MAX_PYRAMID_LEVELS + 1] = {};
+    FramePool pool_;
+};
@@ -0,0 +1,401 @@
+#pragma once
+
+// Shared-memory frame ring used to hand frames to another process on the same host.
+//
+// Layout of the POSIX shared memory object:
+//   [ShmRingHeader][slot 0: ShmSlotHeader + payload][slot 1] ... [slot N-1]
+//
+// One producer publishes frames in sequence order; sequence `s` lives in slot `s % slot_count`.
+// The producer never blocks: when the consumer falls more than `slot_count` frames behind,
+// the oldest slot is overwritten (same policy as MAX_QUEUE_SIZE in the generator) and the
+// overrun is counted. Each slot carries a seqlock-style sequence word so a consumer can read
+// the payload in place (zero copy) and detect afterwards whether it was overwritten meanwhile.
+//
+// This header has no OpenCV dependency so external consumers can include it on its own.
+
+#include <atomic>   // For std::atomic counters shared between processes
+#include <cerrno>   // For errno
+#include <cstdint>  // For fixed-width integer types
+#include <cstring>  // For std::strerror
+#include <new>      // For placement new
+#include <string>   // For std::string
+#include <time.h>   // For clock_gettime
+#include <fcntl.h>    // For O_* flags
+#include <sys/mman.h> // For shm_open, mmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For ftruncate, close
+
+// "VFGR" in little-endian; identifies a ring created by random_image_generator.
+const uint32_t SHM_RING_MAGIC = 0x52474656;
+const uint32_t SHM_RING_VERSION = 1;
+
+// Payload formats stored in a slot.
+const uint32_t SHM_FORMAT_RAW = 0;     // Raw pixels, `step` bytes per row, OpenCV type in `type`.
+const uint32_t SHM_FORMAT_ENCODED = 1; // Encoded image bytes (png, jpg, ...) of length `bytes`.
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory ring requires lock-free 64-bit atomics");
+
+// Global ring header, placed at offset 0 of the shared memory object.
+// Producer and consumer fields are kept on separate cache lines.
+struct ShmRingHeader
+{
+    uint32_t magic;        // SHM_RING_MAGIC once the ring is fully initialised.
+    uint32_t version;      // SHM_RING_VERSION.
+    uint32_t slot_count;   // Number of frame slots in the ring.
+    uint32_t reserved;
+    uint64_t slot_bytes;   // Payload capacity of each slot in bytes.
+    uint64_t slot_stride;  // Distance in bytes between consecutive slot headers.
+    alignas(64) std::atomic<uint64_t> head;     // Next sequence number the producer will publish.
+    std::atomic<uint64_t> overruns;             // Unconsumed frames the producer had to overwrite.
+    std::atomic<uint32_t> producer_done;        // Set to 1 when the producer will publish no more frames.
+    alignas(64) std::atomic<uint64_t> tail;     // Next sequence number the consumer will read.
+};
+
+// Per-slot header, followed by the payload at the next 64-byte boundary.
+struct alignas(64) ShmSlotHeader
+{
+    // 2*s+1 while sequence s is being written, 2*s+2 once it is published.
+    std::atomic<uint64_t> seq;
+    int64_t index;        // Frame index assigned by the producer (may have gaps if frames were skipped).
+    int64_t timestamp_ns; // CLOCK_MONOTONIC time at which the frame was published.
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;        // OpenCV matrix type (e.g. CV_8UC3) for SHM_FORMAT_RAW.
+    uint32_t format;      // SHM_FORMAT_RAW or SHM_FORMAT_ENCODED.
+    uint64_t bytes;       // Number of valid payload bytes.
+    uint64_t step;        // Bytes per row for SHM_FORMAT_RAW.
+};
+
+/**
+ * @brief Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ *
+ * std::chrono::steady_clock uses the same clock on Linux, so timestamps are comparable
+ * between the producer and any consumer process.
+ */
+inline int64_t shmRingNowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Maps a ring of `slot_count` slots able to hold `slot_bytes` each (producer side).
+ */
+class ShmRingProducer
+{
+public:
+    ShmRingProducer() = default;
+    ShmRingProducer(const ShmRingProducer &) = delete;
+    ShmRingProducer &operator=(const ShmRingProducer &) = delete;
+    ~ShmRingProducer() { close(); }
+
+    /**
+     * @brief Creates (or recreates) the shared memory object and initialises the ring.
+     * @param name POSIX shm name, e.g. "/vfig_ring".
+     * @param slot_count Number of slots.
+     * @param slot_bytes Payload capacity of each slot.
+     * @param error Receives a description of the failure, if any.
+     * @return true on success.
+     */
+    bool create(const std::string &name, uint32_t slot_count, uint64_t slot_bytes, std::string &error)
+    {
+        close();
+        if (slot_count == 0 || slot_bytes == 0)
+        {
+            error = "el anillo necesita al menos un slot de tamaño no nulo";
+            return false;
+        }
+        name_ = name;
+        ::shm_unlink(name_.c_str()); // Remove a stale ring left behind by a previous run.
+        int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            error = "shm_open(" + name_ + "): " + std::strerror(errno);
+            return false;
+        }
+
+        uint64_t header_bytes = alignUp(sizeof(ShmRingHeader), 4096);
+        uint64_t stride = alignUp(sizeof(ShmSlotHeader) + slot_bytes, 4096);
+        map_bytes_ = header_bytes + stride * slot_count;
+        if (::ftruncate(fd, static_cast<off_t>(map_bytes_)) != 0)
+        {
+            error = "ftruncate: " + std::string(std::strerror(errno));
+            ::close(fd);
+            ::shm_unlink(name_.c_str());
+            return false;
+        }
+        // MAP_POPULATE pre-faults every page so the hot path never takes a page fault.
+        void *base = ::mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+        {
+            error = "mmap: " + std::string(std::strerror(errno));
+            ::shm_unlink(name_.c_str());
+            return false;
+        }
+
+        base_ = static_cast<uint8_t *>(base);
+        header_ = new (base_) ShmRingHeader();
+        header_->version = SHM_RING_VERSION;
+        header_->slot_count = slot_count;
+        header_->slot_bytes = slot_bytes;
+        header_->slot_stride = stride;
+        header_->head.store(0, std::memory_order_relaxed);
+        header_->overruns.store(0, std::memory_order_relaxed);
+        header_->producer_done.store(0, std::memory_order_relaxed);
+        header_->tail.store(0, std::memory_order_relaxed);
+        slots_ = base_ + header_bytes;
+        for (uint32_t i = 0; i < slot_count; ++i)
+        {
+            new (slots_ + stride * i) ShmSlotHeader();
+            slotAt(i)->seq.store(0, std::memory_order_relaxed);
+        }
+        // Publishing the magic last lets consumers detect a half-initialised ring.
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = SHM_RING_MAGIC;
+        return true;
+    }
+
+    /**
+     * @brief Claims the slot for the next sequence number and returns its payload pointer.
+     *
+     * The payload can be written directly (e.g. by wrapping it in a cv::Mat) and must be
+     * published with commit(). Only one write may be in progress at a time.
+     */
+    uint8_t *beginWrite()
+    {
+        uint64_t s = header_->head.load(std::memory_order_relaxed);
+        uint64_t tail = header_->tail.load(std::memory_order_acquire);
+        if (s - tail >= header_->slot_count)
+        {
+            // The consumer has not read this slot yet: we are about to overwrite it.
+            header_->overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        ShmSlotHeader *slot = slotAt(s % header_->slot_count);
+        slot->seq.store(2 * s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        current_ = slot;
+        return payloadOf(slot);
+    }
+
+    /**
+     * @brief Publishes the slot claimed by beginWrite() with the given metadata.
+     */
+    void commit(int64_t index, uint32_t width, uint32_t height, uint32_t type, uint32_t format, uint64_t bytes, uint64_t step)
+    {
+        uint64_t s = header_->head.load(std::memory_order_relaxed);
+        current_->index = index;
+        current_->timestamp_ns = shmRingNowNs();
+        current_->width = width;
+        current_->height = height;
+        current_->type = type;
+        current_->format = format;
+        current_->bytes = bytes;
+        current_->step = step;
+        current_->seq.store(2 * s + 2, std::memory_order_release);
+        header_->head.store(s + 1, std::memory_order_release);
+        current_ = nullptr;
+    }
+
+    /**
+     * @brief Marks the stream as finished, unmaps the ring and removes its name.
+     *
+     * Consumers that are already attached keep their mapping and can drain the remaining frames.
+     */
+    void close()
+    {
+        if (!base_)
+        {
+            return;
+        }
+        header_->producer_done.store(1, std::memory_order_release);
+        ::munmap(base_, map_bytes_);
+        ::shm_unlink(name_.c_str());
+        base_ = nullptr;
+        header_ = nullptr;
+        slots_ = nullptr;
+    }
+
+    bool isOpen() const { return base_ != nullptr; }
+    uint32_t slotCount() const { return header_ ? header_->slot_count : 0; }
+    uint64_t slotBytes() const { return header_ ? header_->slot_bytes : 0; }
+    uint64_t published() const { return header_ ? header_->head.load(std::memory_order_relaxed) : 0; }
+    uint64_t overruns() const { return header_ ? header_->overruns.load(std::memory_order_relaxed) : 0; }
+    uint64_t consumed() const { return header_ ? header_->tail.load(std::memory_order_relaxed) : 0; }
+
+private:
+    static uint64_t alignUp(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+    ShmSlotHeader *slotAt(uint64_t i) { return reinterpret_cast<ShmSlotHeader *>(slots_ + header_->slot_stride * i); }
+    static uint8_t *payloadOf(ShmSlotHeader *slot) { return reinterpret_cast<uint8_t *>(slot) + sizeof(ShmSlotHeader); }
+
+    std::string name_;
+    uint8_t *base_ = nullptr;
+    uint64_t map_bytes_ = 0;
+    ShmRingHeader *header_ = nullptr;
+    uint8_t *slots_ = nullptr;
+    ShmSlotHeader *current_ = nullptr;
+};
+
+// Result of ShmRingConsumer::acquire().
+enum class ShmReadResult
+{
+    Frame,    // A frame is available in the returned view.
+    Empty,    // No new frame yet; try again later.
+    Finished  // The producer closed the ring and every frame has been read.
+};
+
+// Zero-copy view of a published slot. Valid until ShmRingConsumer::release().
+struct ShmRingFrame
+{
+    const ShmSlotHeader *meta = nullptr; // Frame metadata (index, size, timestamp...).
+    const uint8_t *data = nullptr;       // Payload, read in place from shared memory.
+    uint64_t sequence = 0;               // Ring sequence number of this frame.
+};
+
+/**
+ * @brief Reads frames from a ring created by ShmRingProducer (single consumer).
+ *
+ * Typical loop:
+ *   ShmRingFrame f;
+ *   while ((r = ring.acquire(f)) != ShmReadResult::Finished)
+ *       if (r == ShmReadResult::Frame) { use(f.data); ring.release(f); }
+ */
+class ShmRingConsumer
+{
+public:
+    ShmRingConsumer() = default;
+    ShmRingConsumer(const ShmRingConsumer &) = delete;
+    ShmRingConsumer &operator=(const ShmRingConsumer &) = delete;
+    ~ShmRingConsumer() { detach(); }
+
+    /**
+     * @brief Maps an existing ring. Starts reading at the oldest frame still in the ring.
+     * @return true on success; false (with `error` set) if the ring does not exist or is invalid.
+     */
+    bool attach(const std::string &name, std::string &error)
+    {
+        detach();
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+        {
+            error = "shm_open(" + name + "): " + std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(ShmRingHeader))
+        {
+            error = "el anillo " + name + " no está inicializado";
+            ::close(fd);
+            return false;
+        }
+        void *base = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+        {
+            error = "mmap: " + std::string(std::strerror(errno));
+            return false;
+        }
+        base_ = static_cast<uint8_t *>(base);
+        map_bytes_ = static_cast<uint64_t>(st.st_size);
+        header_ = reinterpret_cast<ShmRingHeader *>(base_);
+        if (header_->magic != SHM_RING_MAGIC || header_->version != SHM_RING_VERSION)
+        {
+            error = "el anillo " + name + " no tiene un formato reconocido";
+            detach();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        slots_ = base_ + ((sizeof(ShmRingHeader) + 4095) / 4096 * 4096);
+        uint64_t head = header_->head.load(std::memory_order_acquire);
+        tail_ = head > header_->slot_count ? head - header_->slot_count : 0;
+        header_->tail.store(tail_, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Gets a view of the next unread frame, skipping frames that were overwritten.
+     */
+    ShmReadResult acquire(ShmRingFrame &frame)
+    {
+        while (true)
+        {
+            uint64_t head = header_->head.load(std::memory_order_acquire);
+            if (tail_ == head)
+            {
+                return header_->producer_done.load(std::memory_order_acquire) ? ShmReadResult::Finished : ShmReadResult::Empty;
+            }
+            if (head - tail_ > header_->slot_count)
+            {
+                // The producer lapped us: everything older than head - slot_count is gone.
+                lost_ += head - header_->slot_count - tail_;
+                tail_ = head - header_->slot_count;
+            }
+            const ShmSlotHeader *slot = slotAt(tail_ % header_->slot_count);
+            uint64_t seq = slot->seq.load(std::memory_order_acquire);
+            if (seq != 2 * tail_ + 2)
+            {
+                // Already being overwritten by a newer sequence: count it as lost and move on.
+                lost_++;
+                tail_++;
+                header_->tail.store(tail_, std::memory_order_release);
+                continue;
+            }
+            frame.meta = slot;
+            frame.data = reinterpret_cast<const uint8_t *>(slot) + sizeof(ShmSlotHeader);
+            frame.sequence = tail_;
+            return ShmReadResult::Frame;
+        }
+    }
+
+    /**
+     * @brief Returns the slot to the producer.
+     * @return false if the producer overwrote the slot while it was being read (torn frame).
+     */
+    bool release(const ShmRingFrame &frame)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool intact = frame.meta->seq.load(std::memory_order_relaxed) == 2 * frame.sequence + 2;
+        if (intact)
+        {
+            read_++;
+        }
+        else
+        {
+            torn_++;
+        }
+        tail_ = frame.sequence + 1;
+        header_->tail.store(tail_, std::memory_order_release);
+        return intact;
+    }
+
+    void detach()
+    {
+        if (base_)
+        {
+            ::munmap(base_, map_bytes_);
+        }
+        base_ = nullptr;
+        header_ = nullptr;
+        slots_ = nullptr;
+    }
+
+    uint64_t framesRead() const { return read_; }      // Frames released intact.
+    uint64_t framesLost() const { return lost_; }      // Frames overwritten before we reached them.
+    uint64_t framesTorn() const { return torn_; }      // Frames overwritten while we were reading them.
+    uint64_t producerOverruns() const { return header_ ? header_->overruns.load(std::memory_order_relaxed) : 0; }
+    uint32_t slotCount() const { return header_ ? header_->slot_count : 0; }
+    uint64_t slotBytes() const { return header_ ? header_->slot_bytes : 0; }
+
+private:
+    const ShmSlotHeader *slotAt(uint64_t i) const { return reinterpret_cast<const ShmSlotHeader *>(slots_ + header_->slot_stride * i); }
+
+    uint8_t *base_ = nullptr;
+    uint64_t map_bytes_ = 0;
+    ShmRingHeader *header_ = nullptr;
+    uint8_t *slots_ = nullptr;
+    uint64_t tail_ = 0;
+    uint64_t read_ = 0;
+    uint64_t lost_ = 0;
+    uint64_t torn_ = 0;
+};
@@ -0,0 +1,100 @@
+#include <iostream> // For standard I/O (cout, cerr)
+#include <string>   // For std::string
+#include <chrono>   // For time-related operations (steady_clock, duration)
+#include <iomanip>  // For I/O manipulators (setprecision, fixed)
+#include <thread>   // For std::this_thread::sleep_for
+#include "shm_ring.hpp" // Shared-memory frame ring consumer
+
+/**
+ * @brief Example consumer for the shared-memory ring published with --shm-ring.
+ *
+ * Attaches to the ring (waiting up to `wait_seconds` for the producer to create it), reads
+ * every frame in place and prints throughput, latency and loss statistics when the producer
+ * finishes.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "Uso: " << argv[0] << " <nombre_anillo> [espera_segundos]\n";
+        std::cerr << "Ejemplo: " << argv[0] << " /vfig_ring 10\n";
+        return 1;
+    }
+    std::string name = argv[1][0] == '/' ? argv[1] : "/" + std::string(argv[1]);
+    int wait_seconds = 10;
+    try
+    {
+        if (argc == 3) wait_seconds = std::stoi(argv[2]);
+    }
+    catch (...)
+    {
+        std::cerr << "Error en los argumentos\n";
+        return 1;
+    }
+
+    // Wait for the producer to create the ring.
+    ShmRingConsumer ring;
+    std::string error;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(wait_seconds);
+    while (!ring.attach(name, error))
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            std::cerr << "Error: No se pudo abrir el anillo: " << error << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long bytes_read = 0;
+    unsigned long long checksum = 0;   // Touches the payload so the read is not optimised away.
+    long double latency_sum_ns = 0;
+    long long latency_max_ns = 0;
+    ShmRingFrame frame;
+    ShmReadResult result;
+    while ((result = ring.acquire(frame)) != ShmReadResult::Finished)
+    {
+        if (result == ShmReadResult::Empty)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        long long latency_ns = shmRingNowNs() - frame.meta->timestamp_ns;
+        uint64_t bytes = frame.meta->bytes;
+        for (uint64_t b = 0; b < bytes; b += 64) // One byte per cache line.
+        {
+            checksum += frame.data[b];
+        }
+        if (ring.release(frame))
+        {
+            bytes_read += bytes;
+            latency_sum_ns += latency_ns;
+            if (latency_ns > latency_max_ns) latency_max_ns = latency_ns;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "--- Resumen consumidor del anillo ---\n";
+    std::cout << "Anillo: " << name << " (" << ring.slotCount() << " slots de " << ring.slotBytes() << " bytes)\n";
+    std::cout << "Frames leídos: " << ring.framesRead() << "\n";
+    std::cout << "Frames perdidos (sobrescritos antes de leerlos): " << ring.framesLost() << "\n";
+    std::cout << "Frames corruptos (sobrescritos durante la lectura): " << ring.framesTorn() << "\n";
+    std::cout << "Overruns reportados por el productor: " << ring.producerOverruns() << "\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "Tiempo de lectura: " << elapsed << " segundos\n";
+    if (elapsed > 0)
+    {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Throughput de lectura: " << bytes_read / (1024.0 * 1024.0) / elapsed << " MB/s ("
+                  << ring.framesRead() / elapsed << " FPS)\n";
+    }
+    if (ring.framesRead() > 0)
+    {
+        std::cout << std::fixed << std::setprecision(3)
+                  << "Latencia publicación→lectura: media " << static_cast<double>(latency_sum_ns / ring.framesRead()) / 1e6
+                  << " ms, máx " << latency_max_ns / 1e6 << " ms\n";
+    }
+    std::cout << "Checksum: " << checksum << "\n";
+    return 0;
+}
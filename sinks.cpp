@@ -0,0 +1,1109 @@
+#include "sinks.hpp"
+
+#include <iostream> // For standard I/O (cerr)
+#include <fstream>  // For std::ofstream (writing already-encoded frames)
+#include <cstring>  // For std::memcpy
+#include <algorithm> // For std::max
+#include <cmath>    // For std::fmod, std::log
+#include <iomanip>  // For std::setprecision (reports)
+#include <sstream>  // For std::ostringstream (reports)
+#include <opencv2/imgcodecs.hpp> // OpenCV image reading/writing
+#include "frame_socket.hpp" // Unix socket framing protocol (SocketSink, SegmentSink)
+#include "watermark.hpp"    // addWatermarkMetadata (DiskSink)
+#include <chrono>   // For segment timing
+#include <cstdio>   // For std::snprintf, std::rename
+#include <fcntl.h>  // For open, fallocate, O_TMPFILE, linkat
+#include <sys/uio.h> // For pwritev
+#include <random>   // For the SlowSink latency distributions
+#include <thread>   // For std::this_thread::sleep_until
+
+/**
+ * @brief Writes an already-encoded frame to disk unchanged.
+ * @return true if every byte was written.
+ */
+static bool writeEncodedImage(const std::string &filename, const uchar *data, size_t size)
+{
+    std::ofstream out(filename, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    return static_cast<bool>(out);
+}
+
+// Set by FaultSink while the wrapped sink writes a frame that must see a short write; the
+// first write syscall of that frame consumes it.
+static thread_local bool short_write_armed = false;
+
+/**
+ * @brief Returns how many of `size` bytes the next write syscall may write: half if a short
+ *        write was injected for this frame, otherwise all of them.
+ */
+static size_t injectedWriteLength(size_t size)
+{
+    if (short_write_armed && size > 1)
+    {
+        short_write_armed = false;
+        return size / 2;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes `size` bytes to `fd`, retrying on short writes and EINTR.
+ */
+static bool writeAll(int fd, const uchar *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::write(fd, data, injectedWriteLength(size));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+DiskSink::DiskSink(std::string output_directory, std::string image_extension, PublishMode publish_mode)
+    : output_directory_(std::move(output_directory)), image_extension_(std::move(image_extension)), publish_mode_(publish_mode)
+{
+}
+
+bool DiskSink::publishAtomically(const std::string &filename, const uchar *data, size_t size, int saver_id)
+{
+    if (publish_mode_ == PublishMode::TmpFile)
+    {
+        int fd = ::open(output_directory_.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL))
+        {
+            // The filesystem has no O_TMPFILE: use temporary names from now on.
+            if (publish_mode_.exchange(PublishMode::Rename) == PublishMode::TmpFile)
+            {
+                std::cerr << "Advertencia: " << output_directory_ << " no admite O_TMPFILE; se usará rename." << std::endl;
+            }
+            return publishAtomically(filename, data, size, saver_id);
+        }
+        bool ok = fd >= 0 && writeAll(fd, data, size);
+        if (ok)
+        {
+            // Linking through /proc needs no privileges (AT_EMPTY_PATH would need CAP_DAC_READ_SEARCH).
+            std::string proc_path = "/proc/self/fd/" + std::to_string(fd);
+            ok = ::linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, filename.c_str(), AT_SYMLINK_FOLLOW) == 0;
+            if (!ok && errno == EEXIST)
+            {
+                // linkat never replaces: remove the file left by an earlier run and retry.
+                ::unlink(filename.c_str());
+                ok = ::linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, filename.c_str(), AT_SYMLINK_FOLLOW) == 0;
+            }
+        }
+        int saved_errno = errno;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        if (!ok)
+        {
+            std::cerr << "Error: Hilo guardador " << saver_id << " no pudo publicar " << filename << ": "
+                      << std::strerror(saved_errno) << std::endl;
+        }
+        return ok;
+    }
+
+    // Rename: a hidden name in the same directory, so the rename never crosses filesystems.
+    size_t slash = filename.find_last_of('/');
+    std::string temporary = filename.substr(0, slash + 1) + "." + filename.substr(slash + 1) + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && writeAll(fd, data, size);
+    int saved_errno = errno;
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    if (ok && std::rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        ok = false;
+        saved_errno = errno;
+    }
+    if (!ok)
+    {
+        std::cerr << "Error: Hilo guardador " << saver_id << " no pudo publicar " << filename << ": "
+                  << std::strerror(saved_errno) << std::endl;
+        ::unlink(temporary.c_str());
+    }
+    return ok;
+}
+
+std::vector<int> DiskSink::encoderParams() const
+{
+    std::lock_guard<std::mutex> lock(params_mutex_);
+    return params_;
+}
+
+bool DiskSink::setParameter(const std::string &name, const std::string &value, std::string &error)
+{
+    if (name == "publish")
+    {
+        if (value != "direct" && value != "tmpfile" && value != "rename")
+        {
+            error = "publish debe ser direct, tmpfile o rename";
+            return false;
+        }
+        publish_mode_ = value == "direct" ? PublishMode::Direct : value == "tmpfile" ? PublishMode::TmpFile : PublishMode::Rename;
+        return true;
+    }
+    int id = name == "jpeg_quality" ? cv::IMWRITE_JPEG_QUALITY
+           : name == "png_compression" ? cv::IMWRITE_PNG_COMPRESSION
+           : name == "webp_quality" ? cv::IMWRITE_WEBP_QUALITY : -1;
+    int low = name == "webp_quality" ? 1 : 0;
+    int high = name == "png_compression" ? 9 : 100;
+    int number = -1;
+    try
+    {
+        number = std::stoi(value);
+    }
+    catch (...)
+    {
+    }
+    if (id < 0)
+    {
+        error = "parámetro desconocido: " + name;
+        return false;
+    }
+    if (number < low || number > high)
+    {
+        error = name + " debe estar entre " + std::to_string(low) + " y " + std::to_string(high);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(params_mutex_);
+    for (size_t k = 0; k < params_.size(); k += 2)
+    {
+        if (params_[k] == id)
+        {
+            params_[k + 1] = number;
+            return true;
+        }
+    }
+    params_.push_back(id);
+    params_.push_back(number);
+    return true;
+}
+
+bool DiskSink::write(const ImageData &imgData, int saver_id)
+{
+    // Construct the filename. Reduced pyramid levels get a "_l<level>" suffix.
+    std::string filename = output_directory_ + "/image_" + std::to_string(imgData.index) +
+                           (imgData.level > 0 ? "_l" + std::to_string(imgData.level) : "") + "." + image_extension_;
+    PublishMode mode = publish_mode_;
+    // Every mode encodes in memory first (adding the watermark metadata, if any), so encoding
+    // and writing are timed apart and the atomic modes compare with a direct write of the same
+    // bytes. Frames that arrived already encoded (ingest mode) are written unchanged.
+    thread_local std::vector<uchar> encoded;
+    const uchar *data = imgData.image.data;
+    size_t size = imgData.image.total();
+    auto start = std::chrono::steady_clock::now();
+    if (!imgData.encoded)
+    {
+        if (!cv::imencode("." + image_extension_, imgData.image, encoded, encoderParams()))
+        {
+            std::cerr << "Error: Hilo guardador " << saver_id << " no pudo codificar la imagen: " << filename << std::endl;
+            return false;
+        }
+        data = encoded.data();
+        size = encoded.size();
+    }
+    if (watermark_metadata_)
+    {
+        if (imgData.encoded)
+        {
+            encoded.assign(data, data + size);
+        }
+        if (!addWatermarkMetadata(encoded, {imgData.index, watermarkTimeNs(imgData.created_ns)}))
+        {
+            std::cerr << "Error: Hilo guardador " << saver_id << " no pudo añadir la marca (no es PNG ni JPEG): "
+                      << filename << std::endl;
+            return false;
+        }
+        data = encoded.data();
+        size = encoded.size();
+    }
+    auto encoded_at = std::chrono::steady_clock::now();
+    bool ok;
+    if (mode == PublishMode::Direct)
+    {
+        // What cv::imwrite does: the bytes go straight to the final name.
+        ok = writeEncodedImage(filename, data, size);
+        if (!ok)
+        {
+            std::cerr << "Error: Hilo guardador " << saver_id << " no pudo guardar la imagen: " << filename << std::endl;
+        }
+    }
+    else
+    {
+        ok = publishAtomically(filename, data, size, saver_id);
+    }
+    if (!ok)
+    {
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+    long long encode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(encoded_at - start).count();
+    long long write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - encoded_at).count();
+    if (mode == PublishMode::Direct)
+    {
+        direct_encode_ns_ += encode_ns;
+        direct_write_ns_ += write_ns;
+        direct_written_++;
+    }
+    else
+    {
+        encode_ns_ += encode_ns;
+        publish_ns_ += write_ns;
+        published_++;
+    }
+    bytes_written_ += static_cast<long long>(size);
+    return true;
+}
+
+std::string DiskSink::describe() const
+{
+    PublishMode mode = publish_mode_.load();
+    return image_extension_ + " -> " + output_directory_ +
+           (mode == PublishMode::TmpFile ? " [O_TMPFILE]" : mode == PublishMode::Rename ? " [rename]" : "");
+}
+
+std::string DiskSink::report() const
+{
+    PublishTimes direct = directTimes();
+    PublishTimes atomic = atomicTimes();
+    if (atomic.frames == 0 && direct.frames == 0)
+    {
+        return std::string();
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    if (direct.frames > 0)
+    {
+        out << "    Escritura directa: codificación media " << direct.encodeMs() << " ms, escritura media "
+            << direct.writeMs() << " ms (" << direct.frames << " frames)\n";
+    }
+    if (atomic.frames > 0)
+    {
+        out << "    Publicación atómica: codificación media " << atomic.encodeMs() << " ms, escritura y publicación media "
+            << atomic.writeMs() << " ms (" << atomic.frames << " frames)\n";
+    }
+    if (direct.frames > 0 && atomic.frames > 0)
+    {
+        out << "    Coste de la publicación atómica: " << std::showpos << atomic.writeMs() - direct.writeMs()
+            << std::noshowpos << " ms por frame frente a la escritura directa\n";
+    }
+    return out.str();
+}
+
+bool NullSink::write(const ImageData &imgData, int saver_id)
+{
+    (void)saver_id;
+    bytes_written_ += static_cast<long long>(imgData.image.total() * imgData.image.elemSize());
+    return true;
+}
+
+bool SlowStorageConfig::parseLatency(const std::string &value)
+{
+    std::istringstream tokens(value);
+    std::string kind, a, b;
+    std::getline(tokens, kind, ':');
+    std::getline(tokens, a, ':');
+    std::getline(tokens, b, ':');
+    try
+    {
+        latency_a = a.empty() ? -1 : std::stod(a);
+        latency_b = b.empty() ? -1 : std::stod(b);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    latency = kind;
+    bool one = latency_a >= 0 && b.empty();
+    bool two = latency_a >= 0 && latency_b >= 0;
+    return ((kind == "fixed" || kind == "exp") && one) || (kind == "uniform" && two && latency_b >= latency_a) ||
+           ((kind == "normal" || kind == "lognormal") && two);
+}
+
+bool SlowStorageConfig::parseStall(const std::string &value)
+{
+    size_t colon = value.find(':');
+    try
+    {
+        stall_every_s = std::stod(value.substr(0, colon));
+        stall_ms = colon == std::string::npos ? -1 : std::stod(value.substr(colon + 1));
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return stall_every_s > 0 && stall_ms > 0 && stall_ms < stall_every_s * 1000.0;
+}
+
+std::string SlowStorageConfig::describe() const
+{
+    std::ostringstream out;
+    if (!latency.empty())
+    {
+        out << " latencia " << latency << ":" << latency_a;
+        if (latency != "fixed" && latency != "exp")
+        {
+            out << ":" << latency_b;
+        }
+        out << " ms";
+    }
+    if (bandwidth_mb_s > 0) out << " " << bandwidth_mb_s << " MB/s";
+    if (stall_ms > 0) out << " parada de " << stall_ms << " ms cada " << stall_every_s << " s";
+    return out.str();
+}
+
+SlowSink::SlowSink(std::unique_ptr<FrameSink> inner, SlowStorageConfig config)
+    : inner_(std::move(inner)), config_(std::move(config)), start_(std::chrono::steady_clock::now()),
+      bandwidth_free_at_(start_)
+{
+}
+
+bool SlowSink::write(const ImageData &imgData, int saver_id)
+{
+    using clock = std::chrono::steady_clock;
+    writes_++;
+
+    // Periodic stall: writes arriving inside a stall window wait for it to end.
+    if (config_.stall_ms > 0)
+    {
+        double since_start_ms = std::chrono::duration<double, std::milli>(clock::now() - start_).count();
+        double into_period = std::fmod(since_start_ms, config_.stall_every_s * 1000.0);
+        if (into_period < config_.stall_ms)
+        {
+            double wait_ms = config_.stall_ms - into_period;
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait_ms));
+            stalled_writes_++;
+            stall_wait_ns_ += static_cast<long long>(wait_ms * 1e6);
+        }
+    }
+
+    // Per-write latency from the configured distribution. Each saver has its own generator in
+    // each sink, so runs with the same seed and thread count draw the same sequences.
+    if (!config_.latency.empty())
+    {
+        std::mt19937 *generator;
+        {
+            std::lock_guard<std::mutex> lock(rng_mutex_);
+            auto found = rngs_.find(saver_id);
+            if (found == rngs_.end())
+            {
+                found = rngs_.emplace(saver_id, std::mt19937(config_.seed + static_cast<unsigned int>(saver_id))).first;
+            }
+            generator = &found->second; // std::map never moves its elements.
+        }
+        std::mt19937 &rng = *generator;
+        double ms = config_.latency_a;
+        if (config_.latency == "uniform") ms = std::uniform_real_distribution<double>(config_.latency_a, config_.latency_b)(rng);
+        else if (config_.latency == "normal") ms = std::normal_distribution<double>(config_.latency_a, config_.latency_b)(rng);
+        else if (config_.latency == "exp") ms = config_.latency_a > 0 ? std::exponential_distribution<double>(1.0 / config_.latency_a)(rng) : 0;
+        else if (config_.latency == "lognormal") ms = std::lognormal_distribution<double>(std::log(std::max(config_.latency_a, 1e-6)), config_.latency_b)(rng);
+        ms = std::max(0.0, ms);
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+        long long ns = static_cast<long long>(ms * 1e6);
+        latency_ns_ += ns;
+        long long max = latency_ns_max_.load(std::memory_order_relaxed);
+        while (ns > max && !latency_ns_max_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    long long before = inner_->bytesWritten();
+    bool success = inner_->write(imgData, saver_id);
+    long long bytes = std::max(0LL, inner_->bytesWritten() - before);
+    bytes_written_ += bytes;
+
+    // Bandwidth cap: the device transfers one write at a time at bandwidth_mb_s; this write
+    // finishes when the transfers booked before it and its own are done.
+    if (config_.bandwidth_mb_s > 0 && bytes > 0)
+    {
+        auto transfer = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(bytes / (config_.bandwidth_mb_s * 1024.0 * 1024.0)));
+        clock::time_point done;
+        {
+            std::lock_guard<std::mutex> lock(bandwidth_mutex_);
+            bandwidth_free_at_ = std::max(bandwidth_free_at_, clock::now()) + transfer;
+            done = bandwidth_free_at_;
+        }
+        auto now = clock::now();
+        if (done > now)
+        {
+            bandwidth_wait_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(done - now).count();
+            std::this_thread::sleep_until(done);
+        }
+    }
+    return success;
+}
+
+std::string SlowSink::describe() const
+{
+    return inner_->describe() + " [lento:" + config_.describe() + "]";
+}
+
+std::string SlowSink::report() const
+{
+    int writes = writes_.load();
+    std::ostringstream out;
+    if (writes > 0)
+    {
+        out << std::fixed << std::setprecision(3);
+        out << "    Simulación: latencia inyectada media " << latency_ns_.load() / 1e6 / writes << " ms (máx "
+            << latency_ns_max_.load() / 1e6 << " ms), espera por ancho de banda media "
+            << bandwidth_wait_ns_.load() / 1e6 / writes << " ms, escrituras detenidas por paradas "
+            << stalled_writes_.load() << " (" << stall_wait_ns_.load() / 1e6 << " ms en total)\n";
+    }
+    return out.str() + inner_->report();
+}
+
+// errno values accepted by FaultInjectionConfig::parseErrors.
+static const struct
+{
+    const char *name;
+    int value;
+} INJECTABLE_ERRORS[] = {{"EIO", EIO}, {"ENOSPC", ENOSPC}, {"EDQUOT", EDQUOT}, {"EROFS", EROFS},
+                         {"EACCES", EACCES}, {"EAGAIN", EAGAIN}, {"ETIMEDOUT", ETIMEDOUT}, {"EPIPE", EPIPE}};
+
+bool FaultInjectionConfig::parseErrors(const std::string &value)
+{
+    errors.clear();
+    std::istringstream tokens(value);
+    std::string name;
+    while (std::getline(tokens, name, ':'))
+    {
+        bool known = false;
+        for (const auto &error : INJECTABLE_ERRORS)
+        {
+            if (name == error.name)
+            {
+                errors.push_back(error.value);
+                known = true;
+            }
+        }
+        if (!known)
+        {
+            return false;
+        }
+    }
+    return !errors.empty();
+}
+
+bool FaultInjectionConfig::parseHang(const std::string &value)
+{
+    size_t colon = value.find(':');
+    try
+    {
+        hang_probability = std::stod(value.substr(0, colon));
+        hang_ms = colon == std::string::npos ? -1 : std::stod(value.substr(colon + 1));
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return hang_probability >= 0 && hang_probability <= 1 && hang_ms >= 0;
+}
+
+std::string FaultInjectionConfig::describe() const
+{
+    std::ostringstream out;
+    if (fail_probability > 0)
+    {
+        out << " fallos " << fail_probability * 100 << "% (";
+        for (size_t i = 0; i < errors.size(); ++i)
+        {
+            for (const auto &error : INJECTABLE_ERRORS)
+            {
+                if (error.value == errors[i]) out << (i > 0 ? ":" : "") << error.name;
+            }
+        }
+        out << ")";
+    }
+    if (short_probability > 0) out << " cortas " << short_probability * 100 << "%";
+    if (hang_probability > 0) out << " bloqueos " << hang_probability * 100 << "% de " << hang_ms << " ms";
+    out << " semilla " << seed;
+    return out.str();
+}
+
+/**
+ * @brief SplitMix64 finalizer: turns a (seed, frame) key into well-mixed bits.
+ */
+static uint64_t mixBits(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+FaultSink::FaultSink(std::unique_ptr<FrameSink> inner, FaultInjectionConfig config)
+    : inner_(std::move(inner)), config_(std::move(config))
+{
+}
+
+bool FaultSink::write(const ImageData &imgData, int saver_id)
+{
+    uint64_t bits = mixBits(mixBits(config_.seed) ^ (static_cast<uint64_t>(imgData.index) << 4) ^
+                            static_cast<uint64_t>(imgData.level));
+    double u = (bits >> 11) * (1.0 / 9007199254740992.0); // Top 53 bits -> [0, 1).
+
+    if (u < config_.fail_probability)
+    {
+        int error = config_.errors[(bits & 0x7FF) % config_.errors.size()];
+        failures_++;
+        errno = error;
+        std::cerr << "Error: Hilo guardador " << saver_id << " no pudo escribir la imagen " << imgData.index
+                  << " (fallo inyectado): " << std::strerror(error) << std::endl;
+        return false;
+    }
+    u -= config_.fail_probability;
+    bool short_write = u >= 0 && u < config_.short_probability;
+    u -= config_.short_probability;
+    if (u >= 0 && u < config_.hang_probability)
+    {
+        hangs_++;
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(config_.hang_ms));
+    }
+
+    long long before = inner_->bytesWritten();
+    short_write_armed = short_write;
+    bool success = inner_->write(imgData, saver_id);
+    if (short_write)
+    {
+        short_writes_++;
+        if (!short_write_armed)
+        {
+            short_writes_applied_++;
+        }
+    }
+    short_write_armed = false;
+    bytes_written_ += std::max(0LL, inner_->bytesWritten() - before);
+    return success;
+}
+
+std::string FaultSink::describe() const
+{
+    return inner_->describe() + " [inyección:" + config_.describe() + "]";
+}
+
+std::string FaultSink::report() const
+{
+    std::ostringstream out;
+    out << "    Fallos inyectados: errores " << failures_.load() << ", escrituras cortas " << short_writes_.load()
+        << " (aplicadas " << short_writes_applied_.load() << "), bloqueos " << hangs_.load() << "\n";
+    return out.str() + inner_->report();
+}
+
+SocketSink::SocketSink(std::string path) : path_(std::move(path))
+{
+}
+
+SocketSink::~SocketSink()
+{
+    finish();
+}
+
+bool SocketSink::open(std::string &error)
+{
+    fd_ = frameSocketConnect(path_, error);
+    return fd_ >= 0;
+}
+
+bool SocketSink::write(const ImageData &imgData, int saver_id)
+{
+    const cv::Mat &image = imgData.image;
+    FrameSocketHeader header = {};
+    header.magic = FRAME_SOCKET_MAGIC;
+    header.format = imgData.encoded ? SHM_FORMAT_ENCODED : SHM_FORMAT_RAW;
+    header.index = imgData.index;
+    header.timestamp_ns = shmRingNowNs();
+    header.width = static_cast<uint32_t>(image.cols);
+    header.height = static_cast<uint32_t>(image.rows);
+    header.type = static_cast<uint32_t>(image.type());
+    header.step = image.cols * image.elemSize(); // Rows are sent back to back.
+    header.bytes = header.step * image.rows;
+
+    // Non-continuous matrices (ROIs) are compacted so the payload matches `step`.
+    cv::Mat continuous = image.isContinuous() ? image : image.clone();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    if (!frameSocketSend(fd_, header, continuous.data))
+    {
+        std::cerr << "Error: Hilo guardador " << saver_id << " perdió la conexión con " << path_ << std::endl;
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    bytes_written_ += static_cast<long long>(sizeof(header) + header.bytes);
+    return true;
+}
+
+void SocketSink::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::string SocketSink::describe() const
+{
+    return "unix:" + path_;
+}
+
+ShmSink::ShmSink(std::string name, uint32_t slots, uint64_t slot_bytes)
+    : name_(std::move(name)), slots_(slots), slot_bytes_(slot_bytes)
+{
+}
+
+bool ShmSink::open(std::string &error)
+{
+    return ring_.create(name_, slots_, slot_bytes_, error);
+}
+
+bool ShmSink::write(const ImageData &imgData, int saver_id)
+{
+    const cv::Mat &image = imgData.image;
+    uint64_t row_bytes = image.cols * image.elemSize();
+    uint64_t bytes = row_bytes * image.rows;
+    if (bytes > slot_bytes_)
+    {
+        std::cerr << "Error: Hilo guardador " << saver_id << ": la imagen " << imgData.index
+                  << " no cabe en un slot de " << name_ << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint8_t *slot = ring_.beginWrite();
+    for (int r = 0; r < image.rows; ++r)
+    {
+        std::memcpy(slot + r * row_bytes, image.ptr(r), row_bytes);
+    }
+    ring_.commit(imgData.index, image.cols, image.rows, image.type(),
+                 imgData.encoded ? SHM_FORMAT_ENCODED : SHM_FORMAT_RAW, bytes, row_bytes);
+    bytes_written_ += static_cast<long long>(bytes);
+    return true;
+}
+
+void ShmSink::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_.close();
+}
+
+std::string ShmSink::describe() const
+{
+    return "shm:" + name_;
+}
+
+ChunkSink::ChunkSink(std::string path, uint32_t codec, int level, uint32_t block_bytes)
+    : path_(std::move(path)), codec_(codec), level_(level), block_bytes_(block_bytes)
+{
+}
+
+bool ChunkSink::open(std::string &error)
+{
+    return writer_.open(path_, codec_, level_, block_bytes_, error);
+}
+
+bool ChunkSink::write(const ImageData &imgData, int saver_id)
+{
+    std::string error = imgData.encoded ? "los frames ya codificados no se pueden almacenar en bloques" : "";
+    long long stored = error.empty() ? writer_.append(imgData.image, imgData.index, error) : -1;
+    if (stored < 0)
+    {
+        std::cerr << "Error: Hilo guardador " << saver_id << " no pudo añadir la imagen " << imgData.index
+                  << " a " << path_ << ": " << error << std::endl;
+        return false;
+    }
+    bytes_written_ += stored;
+    return true;
+}
+
+void ChunkSink::finish()
+{
+    std::string error;
+    if (!writer_.close(error))
+    {
+        std::cerr << "Error: " << path_ << ": " << error << std::endl;
+    }
+}
+
+std::string ChunkSink::describe() const
+{
+    return "chunk:" + path_ + " (" + chunkCodecName(codec_) + ", bloques de " + std::to_string(block_bytes_ / 1024) + " KB)";
+}
+
+std::string ChunkSink::report() const
+{
+    long long frames = writer_.frames();
+    if (frames == 0)
+    {
+        return std::string();
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "    Bloques: " << writer_.blocks() << " (" << writer_.blocksStoredRaw() << " guardados sin comprimir por no reducirse)\n";
+    out << "    Bytes por frame: " << writer_.storedBytes() / 1024.0 / frames << " KB (sin comprimir "
+        << writer_.rawBytes() / 1024.0 / frames << " KB, ratio x" << std::setprecision(2)
+        << static_cast<double>(writer_.rawBytes()) / std::max(1LL, writer_.storedBytes()) << ")\n";
+    if (writer_.compressNs() > 0)
+    {
+        // compressNs() adds up the time of every saver thread, so this is the rate of one thread.
+        double seconds = writer_.compressNs() / 1e9;
+        out << "    Compresión por hilo: " << frames / seconds << " frames/s, "
+            << writer_.rawBytes() / (1024.0 * 1024.0) / seconds << " MB/s sin comprimir\n";
+    }
+    return out.str();
+}
+
+SegmentSink::SegmentSink(std::string directory, double seconds, uint64_t max_bytes, uint64_t preallocate_bytes)
+    : directory_(std::move(directory)), seconds_(seconds), max_bytes_(max_bytes), preallocate_bytes_(preallocate_bytes)
+{
+}
+
+SegmentSink::~SegmentSink()
+{
+    finish();
+}
+
+std::string SegmentSink::segmentPath(int number, bool partial) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "/segment_%06d.raw%s", number, partial ? ".partial" : "");
+    return directory_ + name;
+}
+
+bool SegmentSink::createSegment(Segment &segment, std::string &error)
+{
+    segment = Segment();
+    segment.number = next_number_;
+    std::string path = segmentPath(segment.number, true);
+    segment.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment.fd < 0)
+    {
+        error = "open(" + path + "): " + std::strerror(errno);
+        return false; // The number is reused by the next attempt.
+    }
+    next_number_++;
+    // Reserve the space up front (without changing the file size) so the filesystem can lay the
+    // segment out contiguously and appends never wait for block allocation.
+    if (preallocate_bytes_ > 0 &&
+        ::fallocate(segment.fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate_bytes_)) != 0)
+    {
+        fallocate_failures_++; // Not supported by every filesystem; appends still work.
+    }
+    return true;
+}
+
+void SegmentSink::finalizeSegment(Segment &segment)
+{
+    if (segment.fd < 0)
+    {
+        return; // Never created.
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string partial = segmentPath(segment.number, true);
+    if (segment.size == 0)
+    {
+        ::close(segment.fd);
+        ::unlink(partial.c_str()); // Never used (the spare at the end of the recording).
+        return;
+    }
+    // Release the unused preallocation, make the data durable, then publish the final name.
+    ::ftruncate(segment.fd, static_cast<off_t>(segment.size));
+    ::fdatasync(segment.fd);
+    ::close(segment.fd);
+    if (std::rename(partial.c_str(), segmentPath(segment.number, false).c_str()) != 0)
+    {
+        std::cerr << "Error: No se pudo renombrar " << partial << ": " << std::strerror(errno) << std::endl;
+    }
+    segments_finalized_++;
+    finalized_bytes_ += static_cast<long long>(segment.size);
+    finalize_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SegmentSink::finalizerLoop()
+{
+    std::unique_lock<std::mutex> lock(finalizer_mutex_);
+    while (true)
+    {
+        finalizer_cv_.wait(lock, [this] { return spare_wanted_ || !to_finalize_.empty() || stopping_; });
+        if (spare_wanted_)
+        {
+            // The saver may be waiting for this one, so it goes before any finalization.
+            spare_wanted_ = false;
+            lock.unlock();
+            Segment segment;
+            std::string error;
+            if (!createSegment(segment, error))
+            {
+                std::cerr << "Error: " << error << std::endl;
+            }
+            lock.lock();
+            spare_ = segment;
+            spare_ready_ = true;
+            finalizer_cv_.notify_all();
+        }
+        else if (!to_finalize_.empty())
+        {
+            Segment segment = to_finalize_.front();
+            to_finalize_.pop_front();
+            lock.unlock();
+            finalizeSegment(segment);
+            lock.lock();
+        }
+        else
+        {
+            break; // Stopping and nothing left to do.
+        }
+    }
+}
+
+bool SegmentSink::open(std::string &error)
+{
+    if (!createSegment(current_, error))
+    {
+        return false;
+    }
+    spare_wanted_ = true;
+    finalizer_ = std::thread(&SegmentSink::finalizerLoop, this);
+    return true;
+}
+
+void SegmentSink::takeSpare(std::unique_lock<std::mutex> &finalizer_lock)
+{
+    finalizer_cv_.wait(finalizer_lock, [this] { return spare_ready_; });
+    if (spare_.fd < 0)
+    {
+        spare_ready_ = false;
+        spare_wanted_ = true;
+        finalizer_cv_.notify_all();
+        finalizer_cv_.wait(finalizer_lock, [this] { return spare_ready_; });
+    }
+    current_ = spare_;
+    spare_ready_ = false;
+    spare_wanted_ = true;
+    finalizer_lock.unlock();
+    finalizer_cv_.notify_all();
+}
+
+bool SegmentSink::write(const ImageData &imgData, int saver_id)
+{
+    const cv::Mat &image = imgData.image;
+    FrameSocketHeader header = {};
+    header.magic = FRAME_SOCKET_MAGIC;
+    header.format = imgData.encoded ? SHM_FORMAT_ENCODED : SHM_FORMAT_RAW;
+    header.index = imgData.index;
+    header.timestamp_ns = shmRingNowNs();
+    header.width = static_cast<uint32_t>(image.cols);
+    header.height = static_cast<uint32_t>(image.rows);
+    header.type = static_cast<uint32_t>(image.type());
+    header.step = image.cols * image.elemSize();
+    header.bytes = header.step * image.rows;
+    cv::Mat continuous = image.isContinuous() ? image : image.clone();
+    uint64_t record = sizeof(header) + header.bytes;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool expired = (seconds_ > 0 && header.timestamp_ns - current_.start_ns >= static_cast<int64_t>(seconds_ * 1e9)) ||
+                   (max_bytes_ > 0 && current_.size + record > max_bytes_);
+    if (current_.fd >= 0 && current_.size > 0 && expired)
+    {
+        // Rotation: hand the segment to the finalizer and take the spare it prepared.
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> finalizer_lock(finalizer_mutex_);
+        to_finalize_.push_back(current_);
+        takeSpare(finalizer_lock);
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (ns > rotation_ns_max_.load())
+        {
+            rotation_ns_max_ = ns;
+        }
+    }
+    if (current_.fd < 0)
+    {
+        // The segment in use could not be created: try the finalizer's next one.
+        std::unique_lock<std::mutex> finalizer_lock(finalizer_mutex_);
+        takeSpare(finalizer_lock);
+    }
+    if (current_.fd < 0)
+    {
+        return false;
+    }
+    if (current_.size == 0)
+    {
+        current_.start_ns = header.timestamp_ns;
+    }
+    iovec iov[2] = {{&header, sizeof(header)}, {continuous.data, header.bytes}};
+    uint64_t written = 0;
+    while (written < record)
+    {
+        // Resume after a short write; a frame that fails half-written is overwritten by the
+        // next one and trimmed away when the segment is finalized, since size is not advanced.
+        iovec remaining[2];
+        int count = 0;
+        uint64_t skip = written;
+        for (const iovec &part : iov)
+        {
+            if (skip >= part.iov_len)
+            {
+                skip -= part.iov_len;
+                continue;
+            }
+            remaining[count++] = {static_cast<uint8_t *>(part.iov_base) + skip, part.iov_len - skip};
+            skip = 0;
+        }
+        remaining[count - 1].iov_len = injectedWriteLength(remaining[count - 1].iov_len);
+        ssize_t n = ::pwritev(current_.fd, remaining, count, static_cast<off_t>(current_.size + written));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            std::cerr << "Error: Hilo guardador " << saver_id << " no pudo escribir en " << segmentPath(current_.number, true)
+                      << ": " << (n < 0 ? std::strerror(errno) : "escritura incompleta") << std::endl;
+            return false;
+        }
+        written += static_cast<uint64_t>(n);
+    }
+    current_.size += record;
+    bytes_written_ += static_cast<long long>(record);
+    return true;
+}
+
+void SegmentSink::finish()
+{
+    if (!finalizer_.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> finalizer_lock(finalizer_mutex_);
+        to_finalize_.push_back(current_);
+        current_ = Segment();
+        stopping_ = true;
+    }
+    finalizer_cv_.notify_all();
+    finalizer_.join();
+    // The spare prepared for the next rotation was never used.
+    if (spare_ready_)
+    {
+        finalizeSegment(spare_);
+        spare_ready_ = false;
+    }
+}
+
+std::string SegmentSink::describe() const
+{
+    std::string limits;
+    if (seconds_ > 0) limits += std::to_string(static_cast<int>(seconds_)) + " s";
+    if (max_bytes_ > 0) limits += (limits.empty() ? "" : " / ") + std::to_string(max_bytes_ >> 20) + " MB";
+    return "segment:" + directory_ + " (" + limits + " por segmento)";
+}
+
+std::string SegmentSink::report() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    int segments = segments_finalized_.load();
+    out << "    Segmentos completados: " << segments;
+    if (segments > 0)
+    {
+        out << " (media " << finalized_bytes_.load() / (1024.0 * 1024.0) / segments << " MB, finalización media "
+            << finalize_ns_.load() / 1e6 / segments << " ms en segundo plano)";
+    }
+    out << "\n    Espera máxima del hilo guardador al rotar: " << rotation_ns_max_.load() / 1e6 << " ms\n";
+    if (fallocate_failures_.load() > 0)
+    {
+        out << "    fallocate no soportado en " << fallocate_failures_.load() << " segmentos (sin preasignación)\n";
+    }
+    return out.str();
+}
+
+#ifdef VFIG_HAVE_ZLIB
+DeltaSink::DeltaSink(std::string path, int key_interval, int level)
+    : path_(std::move(path)), key_interval_(key_interval), level_(level)
+{
+}
+
+bool DeltaSink::open(std::string &error)
+{
+    return writer_.open(path_, key_interval_, level_, error);
+}
+
+bool DeltaSink::write(const ImageData &imgData, int saver_id)
+{
+    std::string error = imgData.encoded ? "los frames ya codificados no se pueden almacenar como deltas" : "";
+    long long before = writer_.keyBytes() + writer_.deltaBytes();
+    if (!error.empty() || !writer_.append(imgData.image, imgData.index, error))
+    {
+        std::cerr << "Error: Hilo guardador " << saver_id << " no pudo añadir la imagen " << imgData.index
+                  << " a " << path_ << ": " << error << std::endl;
+        return false;
+    }
+    bytes_written_ += writer_.keyBytes() + writer_.deltaBytes() - before;
+    return true;
+}
+
+void DeltaSink::finish()
+{
+    std::string error;
+    if (!writer_.close(error))
+    {
+        std::cerr << "Error: " << path_ << ": " << error << std::endl;
+    }
+}
+
+std::string DeltaSink::describe() const
+{
+    return "delta:" + path_ + " (keyframe cada " + std::to_string(key_interval_) + ")";
+}
+
+std::string DeltaSink::report() const
+{
+    long long frames = writer_.keyframes() + writer_.deltas();
+    if (frames == 0)
+    {
+        return std::string();
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "    Keyframes: " << writer_.keyframes();
+    if (writer_.keyframes() > 0)
+    {
+        out << " (" << writer_.keyBytes() / 1024.0 / writer_.keyframes() << " KB/frame)";
+    }
+    out << ", deltas: " << writer_.deltas();
+    if (writer_.deltas() > 0)
+    {
+        out << " (" << writer_.deltaBytes() / 1024.0 / writer_.deltas() << " KB/frame)";
+    }
+    long long stored = writer_.keyBytes() + writer_.deltaBytes();
+    out << "\n    Bytes por frame: " << stored / 1024.0 / frames << " KB (sin comprimir "
+        << writer_.rawBytes() / 1024.0 / frames << " KB, ratio x" << std::setprecision(2)
+        << static_cast<double>(writer_.rawBytes()) / std::max(1LL, stored) << ")\n";
+    if (writer_.encodeNs() > 0)
+    {
+        double seconds = writer_.encodeNs() / 1e9;
+        out << "    Codificación: " << frames / seconds << " frames/s, "
+            << writer_.rawBytes() / (1024.0 * 1024.0) / seconds << " MB/s sin comprimir\n";
+    }
+    return out.str();
+}
+#endif
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <string>   // For std::string
+#include <mutex>    // For std::mutex
+#include <atomic>   // For std::atomic
+#include <condition_variable> // For std::condition_variable (segment finalizer)
+#include <deque>    // For std::deque
+#include <thread>   // For std::thread
+#include <memory>   // For std::unique_ptr (SlowSink, FaultSink)
+#include <vector>   // For std::vector
+#include <cerrno>   // For EIO (FaultInjectionConfig)
+#include <chrono>   // For std::chrono::steady_clock (SlowSink)
+#include <map>      // For std::map (SlowSink latency generators)
+#include <random>   // For std::mt19937 (SlowSink)
+#include <opencv2/core.hpp> // OpenCV core functionalities
+#include "image_data.hpp"   // ImageData, the unit passed to sinks
+#include "shm_ring.hpp"     // Shared-memory frame ring (ShmSink)
+#include "chunk_format.hpp" // Chunked raw container (ChunkSink)
+#ifdef VFIG_HAVE_ZLIB
+#include "delta_format.hpp" // Delta-frame container (DeltaSink)
+#endif
+
+/**
+ * @brief Destination for frames. Each sink is fed by its own queue and saver threads.
+ *
+ * write() may be called concurrently from several saver threads unless the sink is
+ * created with a single thread.
+ */
+class FrameSink
+{
+public:
+    virtual ~FrameSink() = default;
+
+    /**
+     * @brief Delivers one frame.
+     * @param imgData Frame to deliver.
+     * @param saver_id ID of the calling saver thread (for logging purposes).
+     * @return true on success.
+     */
+    virtual bool write(const ImageData &imgData, int saver_id) = 0;
+
+    /**
+     * @brief Called once after every saver thread of the sink has exited.
+     */
+    virtual void finish() {}
+
+    /**
+     * @brief Short human-readable description used in reports (e.g. "png -> generated_images").
+     */
+    virtual std::string describe() const = 0;
+
+    /**
+     * @brief Total bytes delivered so far (encoded file sizes for disk sinks).
+     */
+    long long bytesWritten() const { return bytes_written_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Sink-specific statistics for the final report (indented lines), or empty.
+     */
+    virtual std::string report() const { return std::string(); }
+
+    /**
+     * @brief Changes a sink parameter while frames are being written (see --control).
+     *        Writes already in progress finish with the old value.
+     * @return false with `error` set if the sink has no such parameter or the value is invalid.
+     */
+    virtual bool setParameter(const std::string &name, const std::string &value, std::string &error)
+    {
+        (void)name;
+        (void)value;
+        error = "el destino no tiene parámetros ajustables";
+        return false;
+    }
+
+protected:
+    std::atomic<long long> bytes_written_{0};
+};
+
+// How DiskSink makes a file visible under its final name.
+enum class PublishMode
+{
+    Direct,  // cv::imwrite straight to the final name; readers may see a partly written file.
+    TmpFile, // Anonymous O_TMPFILE file in the directory, linked in with linkat() once complete.
+    Rename   // Hidden temporary file, renamed to the final name once complete.
+};
+
+/**
+ * @brief Saves every frame as an image file (image_<index>.<extension>) in a directory.
+ *
+ * With PublishMode::TmpFile or Rename the frame is encoded in memory and written to a file
+ * that only appears under its final name once it is complete.
+ */
+class DiskSink : public FrameSink
+{
+public:
+    DiskSink(std::string output_directory, std::string image_extension, PublishMode publish_mode = PublishMode::Direct);
+    bool write(const ImageData &imgData, int saver_id) override;
+    std::string describe() const override;
+    std::string report() const override;
+
+    /**
+     * @brief Encoder parameters: jpeg_quality (0-100), png_compression (0-9), webp_quality
+     *        (1-100); and publish (direct, tmpfile, rename).
+     */
+    bool setParameter(const std::string &name, const std::string &value, std::string &error) override;
+
+    /**
+     * @brief Adds each frame's watermark (index and entry time) to the file as metadata: a PNG
+     *        tEXt chunk or a JPEG comment (see addWatermarkMetadata()). Frames are then encoded
+     *        in memory first. Only for png and jpg; call before the savers start.
+     */
+    void setWatermarkMetadata(bool enabled) { watermark_metadata_ = enabled; }
+
+    // Time per successfully written frame, split into encoding and writing (plus publishing).
+    struct PublishTimes
+    {
+        int frames = 0;
+        long long encode_ns = 0;
+        long long write_ns = 0;
+        double encodeMs() const { return frames > 0 ? encode_ns / 1e6 / frames : 0; }
+        double writeMs() const { return frames > 0 ? write_ns / 1e6 / frames : 0; }
+    };
+    PublishTimes directTimes() const { return {direct_written_.load(), direct_encode_ns_.load(), direct_write_ns_.load()}; }
+    PublishTimes atomicTimes() const { return {published_.load(), encode_ns_.load(), publish_ns_.load()}; }
+
+private:
+    bool publishAtomically(const std::string &filename, const uchar *data, size_t size, int saver_id);
+    std::vector<int> encoderParams() const;
+
+    std::string output_directory_;
+    std::string image_extension_;
+    bool watermark_metadata_ = false;
+    std::atomic<PublishMode> publish_mode_;
+    std::atomic<long long> encode_ns_{0};  // Time in cv::imencode (atomic modes).
+    std::atomic<long long> publish_ns_{0}; // Time writing and publishing the file (atomic modes).
+    std::atomic<int> published_{0};
+    std::atomic<long long> direct_encode_ns_{0}; // Time in cv::imencode (direct mode).
+    std::atomic<long long> direct_write_ns_{0};  // Time writing the file (direct mode).
+    std::atomic<int> direct_written_{0};
+    mutable std::mutex params_mutex_;
+    std::vector<int> params_; // cv::imwrite/imencode parameters (pairs of IMWRITE_* id and value).
+};
+
+/**
+ * @brief Discards every frame (counting its raw size). Useful under SlowSink to simulate
+ *        storage without touching a disk, or to measure the rest of the pipeline.
+ */
+class NullSink : public FrameSink
+{
+public:
+    bool write(const ImageData &imgData, int saver_id) override;
+    std::string describe() const override { return "null"; }
+};
+
+// Parameters of the simulated storage behind a SlowSink; times in milliseconds.
+struct SlowStorageConfig
+{
+    std::string latency;      // Per-write latency: "", "fixed", "uniform", "normal", "exp" or "lognormal".
+    double latency_a = 0;     // fixed/exp: value/mean; uniform: min; normal: mean; lognormal: median.
+    double latency_b = 0;     // uniform: max; normal: standard deviation; lognormal: sigma.
+    double bandwidth_mb_s = 0; // Throughput cap shared by all savers of the sink; 0 = none.
+    double stall_every_s = 0; // A stall starts every stall_every_s seconds...
+    double stall_ms = 0;      // ...and blocks every write for stall_ms.
+    unsigned int seed = 1;    // Seed of the latency generator (per saver thread: seed + saver id).
+
+    bool enabled() const { return !latency.empty() || bandwidth_mb_s > 0 || stall_ms > 0; }
+
+    /**
+     * @brief Parses "fixed:<ms>", "uniform:<min>:<max>", "normal:<mean>:<sd>", "exp:<mean>" or
+     *        "lognormal:<median>:<sigma>".
+     */
+    bool parseLatency(const std::string &value);
+
+    /**
+     * @brief Parses "<every_s>:<ms>".
+     */
+    bool parseStall(const std::string &value);
+
+    std::string describe() const;
+};
+
+/**
+ * @brief Decorator that makes another sink behave like slow or jittery storage.
+ *
+ * Each write waits out any periodic stall, sleeps for a latency drawn from the configured
+ * distribution, calls the wrapped sink, and finally waits until the bandwidth cap allows the
+ * bytes the wrapped sink reported. The cap is a virtual clock shared by all saver threads, so
+ * concurrent writes queue behind each other like on a real device.
+ */
+class SlowSink : public FrameSink
+{
+public:
+    SlowSink(std::unique_ptr<FrameSink> inner, SlowStorageConfig config);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override { inner_->finish(); }
+    std::string describe() const override;
+    std::string report() const override;
+    bool setParameter(const std::string &name, const std::string &value, std::string &error) override
+    {
+        return inner_->setParameter(name, value, error);
+    }
+
+private:
+    std::unique_ptr<FrameSink> inner_;
+    SlowStorageConfig config_;
+    std::chrono::steady_clock::time_point start_;
+    std::mutex bandwidth_mutex_;
+    std::chrono::steady_clock::time_point bandwidth_free_at_; // When the simulated device is idle again.
+    std::mutex rng_mutex_;                 // Guards rngs_ itself; each generator is used by its saver only.
+    std::map<int, std::mt19937> rngs_;     // Latency generator of each saver id, seeded with seed + id.
+    std::atomic<int> writes_{0};
+    std::atomic<long long> latency_ns_{0};
+    std::atomic<long long> latency_ns_max_{0};
+    std::atomic<long long> bandwidth_wait_ns_{0};
+    std::atomic<int> stalled_writes_{0};
+    std::atomic<long long> stall_wait_ns_{0};
+};
+
+// Faults a FaultSink injects; probabilities are per frame, in [0, 1].
+struct FaultInjectionConfig
+{
+    double fail_probability = 0;  // The write fails with one of `errors`.
+    std::vector<int> errors{EIO}; // errno values for failed writes, picked per frame.
+    double short_probability = 0; // The first write() syscall of the frame only writes half.
+    double hang_probability = 0;  // The write blocks for hang_ms before going ahead.
+    double hang_ms = 0;
+    unsigned int seed = 1;
+
+    bool enabled() const { return fail_probability > 0 || short_probability > 0 || hang_probability > 0; }
+
+    /**
+     * @brief Parses a ':'-separated list of errno names (e.g. "EIO:ENOSPC").
+     */
+    bool parseErrors(const std::string &value);
+
+    /**
+     * @brief Parses "<probability>:<ms>".
+     */
+    bool parseHang(const std::string &value);
+
+    std::string describe() const;
+};
+
+/**
+ * @brief Decorator that injects write faults into another sink, reproducibly.
+ *
+ * Whether a frame gets a fault depends only on the seed, its index and its pyramid level, never
+ * on thread timing, so two runs that write the same frames see the same faults. Failed writes
+ * never reach the wrapped sink. Short writes are applied to the wrapped sink's write syscalls
+ * (atomic disk publishing and segment sinks), which must complete them; for other sinks they
+ * are counted as not applicable.
+ */
+class FaultSink : public FrameSink
+{
+public:
+    FaultSink(std::unique_ptr<FrameSink> inner, FaultInjectionConfig config);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override { inner_->finish(); }
+    std::string describe() const override;
+    std::string report() const override;
+    bool setParameter(const std::string &name, const std::string &value, std::string &error) override
+    {
+        return inner_->setParameter(name, value, error);
+    }
+
+private:
+    std::unique_ptr<FrameSink> inner_;
+    FaultInjectionConfig config_;
+    std::atomic<int> failures_{0};
+    std::atomic<int> short_writes_{0};
+    std::atomic<int> short_writes_applied_{0};
+    std::atomic<int> hangs_{0};
+};
+
+/**
+ * @brief Streams frames to a Unix socket using the frame_socket.hpp protocol.
+ *
+ * Frames are sent raw (or unchanged if they arrived encoded). Writes are serialised on one
+ * connection, so more than one saver thread only helps to absorb jitter.
+ */
+class SocketSink : public FrameSink
+{
+public:
+    explicit SocketSink(std::string path);
+    ~SocketSink() override;
+    bool open(std::string &error);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    std::mutex mutex_;
+};
+
+/**
+ * @brief Copies frames into a shared-memory ring (see shm_ring.hpp).
+ *
+ * Unlike --shm-ring, which generates in place, this sink copies because the frame buffer is
+ * shared with the other sinks. The ring has a single producer, so writes are serialised.
+ */
+class ShmSink : public FrameSink
+{
+public:
+    ShmSink(std::string name, uint32_t slots, uint64_t slot_bytes);
+    bool open(std::string &error);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override;
+
+private:
+    std::string name_;
+    uint32_t slots_;
+    uint64_t slot_bytes_;
+    ShmRingProducer ring_;
+    std::mutex mutex_;
+};
+
+/**
+ * @brief Writes raw frames, compressed in fixed-size blocks, into a chunked container
+ *        (see chunk_format.hpp). Saver threads compress and write frames in parallel.
+ */
+class ChunkSink : public FrameSink
+{
+public:
+    ChunkSink(std::string path, uint32_t codec, int level, uint32_t block_bytes);
+    bool open(std::string &error);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override;
+    std::string report() const override;
+
+private:
+    std::string path_;
+    uint32_t codec_;
+    int level_;
+    uint32_t block_bytes_;
+    ChunkWriter writer_;
+};
+
+/**
+ * @brief Records frames into rolling segment files, DVR style.
+ *
+ * Frames are appended with the frame_socket.hpp framing (FrameSocketHeader + pixels) to
+ * <dir>/segment_<n>.raw.partial. After `seconds` or `max_bytes`, the saver thread swaps in the
+ * next segment, which a background finalizer thread has already created and preallocated with
+ * fallocate(). The finalizer then trims, syncs and closes the finished segment and renames it
+ * to segment_<n>.raw, so consumers only have to watch for files without ".partial".
+ */
+class SegmentSink : public FrameSink
+{
+public:
+    /**
+     * @param seconds Segment duration (0 = no time limit).
+     * @param max_bytes Segment size limit (0 = no size limit).
+     * @param preallocate_bytes Space reserved with fallocate() for every new segment.
+     */
+    SegmentSink(std::string directory, double seconds, uint64_t max_bytes, uint64_t preallocate_bytes);
+    ~SegmentSink() override;
+    bool open(std::string &error);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override;
+    std::string report() const override;
+
+private:
+    struct Segment
+    {
+        int fd = -1;
+        int number = 0;
+        uint64_t size = 0;    // Bytes written so far.
+        int64_t start_ns = 0; // Timestamp of the first frame.
+    };
+
+    std::string segmentPath(int number, bool partial) const;
+    bool createSegment(Segment &segment, std::string &error);
+    void finalizeSegment(Segment &segment);
+    void finalizerLoop();
+    /**
+     * @brief Makes the spare the current segment and asks for the next one. A spare the finalizer
+     *        could not create is asked for once more, so a transient failure does not end the recording.
+     */
+    void takeSpare(std::unique_lock<std::mutex> &finalizer_lock);
+
+    std::string directory_;
+    double seconds_;
+    uint64_t max_bytes_;
+    uint64_t preallocate_bytes_;
+
+    std::mutex mutex_; // Serialises writes and rotation.
+    Segment current_;
+
+    // Finalizer thread: finishes old segments and prepares the next one.
+    std::thread finalizer_;
+    std::mutex finalizer_mutex_;
+    std::condition_variable finalizer_cv_;
+    std::deque<Segment> to_finalize_;
+    Segment spare_;            // Next segment, ready when spare_ready_ is set.
+    bool spare_ready_ = false;
+    bool spare_wanted_ = false;
+    bool stopping_ = false;
+    int next_number_ = 1;      // Only the finalizer thread uses it after open().
+
+    std::atomic<int> segments_finalized_{0};
+    std::atomic<long long> finalized_bytes_{0};
+    std::atomic<long long> finalize_ns_{0};
+    std::atomic<long long> rotation_ns_max_{0};
+    std::atomic<int> fallocate_failures_{0};
+};
+
+#ifdef VFIG_HAVE_ZLIB
+/**
+ * @brief Appends frames to a lossless delta-frame container (see delta_format.hpp).
+ *
+ * Every delta depends on the frame written before it, so the sink must be fed by a single
+ * saver thread; frames dropped from the queue are simply not in the file.
+ */
+class DeltaSink : public FrameSink
+{
+public:
+    DeltaSink(std::string path, int key_interval, int level);
+    bool open(std::string &error);
+    bool write(const ImageData &imgData, int saver_id) override;
+    void finish() override;
+    std::string describe() const override;
+    std::string report() const override;
+
+private:
+    std::string path_;
+    int key_interval_;
+    int level_;
+    DeltaWriter writer_;
+};
+#endif
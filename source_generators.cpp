@@ -0,0 +1,455 @@
+#include "source_generators.hpp"
+
+#include <iostream> // For std::cerr
+#include <algorithm> // For std::sort, std::find, std::transform
+#include <cctype>   // For std::isdigit, std::tolower
+#include <condition_variable> // For std::condition_variable (replay prefetcher)
+#include <cstring>  // For std::memcpy
+#include <map>      // For std::map (replay prefetch buffer)
+#include <mutex>    // For std::mutex
+#include <thread>   // For std::thread, std::this_thread::sleep_for
+#include <opencv2/imgcodecs.hpp> // For cv::imencode, cv::imread
+#include "frame_socket.hpp" // Unix socket framing protocol (socket ingest)
+
+namespace fs = std::filesystem;
+
+bool ShmRingGenerator::open(const std::string &name, uint32_t slots, std::string &error)
+{
+    // Every slot holds a full raw frame, plus headroom for encoded formats, whose output can be
+    // slightly larger than the raw pixels for noise.
+    uint64_t raw_bytes = static_cast<uint64_t>(width_) * height_ * 3;
+    uint64_t slot_bytes = extension_ == "raw" ? raw_bytes : raw_bytes + raw_bytes / 8 + 65536;
+    return ring_.create(name, slots, slot_bytes, error);
+}
+
+FrameGenerator::Result ShmRingGenerator::generate(int index, ImageData &)
+{
+    if (extension_ == "raw")
+    {
+        uint8_t *slot = ring_.beginWrite();
+        cv::Mat image(height_, width_, CV_8UC3, slot); // Header over shared memory, no allocation.
+        cv::randu(image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+        uint64_t bytes = image.total() * image.elemSize();
+        ring_.commit(index, width_, height_, image.type(), SHM_FORMAT_RAW, bytes, image.step);
+        bytes_published_ += static_cast<long long>(bytes);
+        return Result::Delivered;
+    }
+
+    std::vector<uchar> encoded;
+    if (!cv::imencode("." + extension_, generateRandomImage(width_, height_), encoded))
+    {
+        std::cerr << "Error: No se pudo codificar la imagen " << index << " como " << extension_ << std::endl;
+        return Result::Failed;
+    }
+    if (encoded.size() > ring_.slotBytes())
+    {
+        frames_too_large_++;
+        return Result::Failed;
+    }
+    uint8_t *slot = ring_.beginWrite();
+    std::memcpy(slot, encoded.data(), encoded.size());
+    ring_.commit(index, width_, height_, CV_8UC3, SHM_FORMAT_ENCODED, encoded.size(), 0);
+    bytes_published_ += static_cast<long long>(encoded.size());
+    return Result::Delivered;
+}
+
+/**
+ * @brief Copies a frame received from an external producer into an ImageData.
+ *
+ * Raw frames become a regular BGR (or other type) cv::Mat; encoded frames are kept as
+ * bytes and written to disk unchanged by the savers.
+ *
+ * @return false if the metadata is inconsistent with the payload size.
+ */
+static bool makeIngestedImage(uint32_t format, uint32_t width, uint32_t height, uint32_t type, uint64_t step,
+                              const uint8_t *data, uint64_t bytes, int64_t index, ImageData &out)
+{
+    out.index = static_cast<int>(index);
+    if (format == SHM_FORMAT_ENCODED)
+    {
+        out.image = cv::Mat(1, static_cast<int>(bytes), CV_8UC1, const_cast<uint8_t *>(data)).clone();
+        out.encoded = true;
+        return bytes > 0;
+    }
+    if (format != SHM_FORMAT_RAW || width == 0 || height == 0 || type > 4095 ||
+        step < width * CV_ELEM_SIZE(type) || step * height > bytes)
+    {
+        return false;
+    }
+    out.image = cv::Mat(static_cast<int>(height), static_cast<int>(width), static_cast<int>(type),
+                        const_cast<uint8_t *>(data), step).clone();
+    out.encoded = false;
+    return true;
+}
+
+void IngestGenerator::begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop)
+{
+    end_time_ = end_time;
+    stop_ = &stop;
+}
+
+bool IngestGenerator::runEnded() const
+{
+    return (stop_ && stop_->load()) || std::chrono::steady_clock::now() >= end_time_;
+}
+
+void ShmIngestGenerator::begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop)
+{
+    IngestGenerator::begin(end_time, stop);
+    std::string error;
+    // The producer may start after us: keep trying to attach until the run ends.
+    while (!(attached_ = ring_.attach(name_, error)))
+    {
+        if (runEnded())
+        {
+            std::cerr << "Error: No se pudo abrir el anillo de ingesta: " << error << std::endl;
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+FrameGenerator::Result ShmIngestGenerator::generate(int, ImageData &frame)
+{
+    if (!attached_)
+    {
+        return Result::Finished;
+    }
+    ShmRingFrame slot;
+    ShmReadResult result = ring_.acquire(slot);
+    if (result == ShmReadResult::Finished)
+    {
+        return Result::Finished;
+    }
+    if (result == ShmReadResult::Empty)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        return Result::Failed;
+    }
+    // The producer may be rewriting the slot (it laps us when it is fast): take one copy of
+    // the header and bound every size by the slot before touching the payload.
+    const ShmSlotHeader &meta = *slot.meta;
+    uint32_t format = meta.format;
+    uint32_t width = meta.width;
+    uint32_t height = meta.height;
+    uint32_t type = meta.type;
+    uint64_t step = meta.step;
+    uint64_t bytes = meta.bytes;
+    int64_t index = meta.index;
+    uint64_t slot_bytes = ring_.slotBytes();
+    bool in_slot = bytes <= slot_bytes &&
+                   (format != SHM_FORMAT_RAW || (step <= slot_bytes && (step == 0 || height <= slot_bytes / step)));
+    bool valid = in_slot && makeIngestedImage(format, width, height, type, step, slot.data, bytes, index, frame);
+    // Only keep the copy if the slot was not overwritten while we copied it.
+    if (!ring_.release(slot) || !valid)
+    {
+        return Result::Failed;
+    }
+    bytes_received_ += static_cast<long long>(bytes);
+    return Result::Frame;
+}
+
+long long ShmIngestGenerator::framesLost() const
+{
+    return attached_ ? static_cast<long long>(ring_.framesLost() + ring_.framesTorn()) : 0;
+}
+
+SocketIngestGenerator::~SocketIngestGenerator()
+{
+    for (const pollfd &p : fds_)
+    {
+        ::close(p.fd);
+    }
+    if (!fds_.empty())
+    {
+        ::unlink(path_.c_str());
+    }
+}
+
+bool SocketIngestGenerator::listen(std::string &error)
+{
+    int listen_fd = frameSocketListen(path_, error);
+    if (listen_fd < 0)
+    {
+        return false;
+    }
+    fds_.push_back({listen_fd, POLLIN, 0});
+    return true;
+}
+
+/**
+ * @brief frameSocketReadFully() that gives up when the run ends: a producer that stalls in the
+ *        middle of a frame must not keep ingest alive past the deadline or a stop request.
+ */
+bool SocketIngestGenerator::readFully(int fd, void *buffer, size_t size) const
+{
+    uint8_t *p = static_cast<uint8_t *>(buffer);
+    while (size > 0)
+    {
+        if (runEnded())
+        {
+            return false;
+        }
+        pollfd readable = {fd, POLLIN, 0};
+        if (::poll(&readable, 1, 100) <= 0)
+        {
+            continue; // Timeout (re-check the deadline) or EINTR.
+        }
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one frame from a connected producer.
+ * @return false when the producer disconnected, sent an invalid frame or the run ended in the
+ *         middle of the frame.
+ */
+bool SocketIngestGenerator::readFrame(int fd, ImageData &frame)
+{
+    FrameSocketHeader header;
+    if (!readFully(fd, &header, sizeof(header)))
+    {
+        return false;
+    }
+    if (header.magic != FRAME_SOCKET_MAGIC || header.bytes == 0 || header.bytes > (1ULL << 32))
+    {
+        std::cerr << "Error: Trama inválida recibida en el socket de ingesta" << std::endl;
+        return false;
+    }
+    buffer_.resize(header.bytes);
+    if (!readFully(fd, buffer_.data(), buffer_.size()))
+    {
+        return false;
+    }
+    if (!makeIngestedImage(header.format, header.width, header.height, header.type, header.step,
+                           buffer_.data(), header.bytes, header.index, frame))
+    {
+        std::cerr << "Error: Metadatos de trama inconsistentes en el socket de ingesta" << std::endl;
+        return false;
+    }
+    bytes_received_ += static_cast<long long>(header.bytes);
+    return true;
+}
+
+FrameGenerator::Result SocketIngestGenerator::generate(int, ImageData &frame)
+{
+    if (fds_.empty() || (had_producer_ && fds_.size() == 1))
+    {
+        return Result::Finished; // Not listening, or every producer has finished.
+    }
+    if (::poll(fds_.data(), fds_.size(), 100) <= 0)
+    {
+        return Result::Failed; // Timeout (lets the pipeline re-check the deadline) or EINTR.
+    }
+    if (fds_[0].revents & POLLIN)
+    {
+        int client = ::accept4(fds_[0].fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client >= 0)
+        {
+            fds_.push_back({client, POLLIN, 0});
+            had_producer_ = true;
+        }
+    }
+    // One frame per call, from the producers in turn; the others are still readable next time.
+    size_t producers = fds_.size() - 1;
+    for (size_t k = 0; k < producers; ++k)
+    {
+        size_t f = 1 + (next_producer_ - 1 + k) % producers;
+        if (!(fds_[f].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            continue;
+        }
+        next_producer_ = f + 1;
+        if (readFrame(fds_[f].fd, frame))
+        {
+            return Result::Frame;
+        }
+        ::close(fds_[f].fd);
+        fds_.erase(fds_.begin() + static_cast<long>(f));
+        return Result::Failed;
+    }
+    return Result::Failed;
+}
+
+std::vector<fs::path> listReplayFiles(const std::string &directory)
+{
+    static const std::vector<std::string> readable = {".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp",
+                                                      ".pgm", ".ppm", ".pbm", ".pnm", ".jp2", ".exr", ".hdr"};
+    std::vector<fs::path> files;
+    for (const auto &entry : fs::directory_iterator(directory))
+    {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (entry.is_regular_file() && std::find(readable.begin(), readable.end(), ext) != readable.end())
+        {
+            files.push_back(entry.path());
+        }
+    }
+    auto numberIn = [](const fs::path &path) {
+        std::string stem = path.stem().string();
+        size_t end = stem.size();
+        while (end > 0 && !std::isdigit(static_cast<unsigned char>(stem[end - 1]))) end--;
+        size_t begin = end;
+        while (begin > 0 && std::isdigit(static_cast<unsigned char>(stem[begin - 1]))) begin--;
+        return begin == end ? -1LL : std::stoll(stem.substr(begin, std::min<size_t>(end - begin, 18)));
+    };
+    std::sort(files.begin(), files.end(), [&](const fs::path &a, const fs::path &b) {
+        long long na = numberIn(a), nb = numberIn(b);
+        return na != nb ? na < nb : a.filename() < b.filename();
+    });
+    return files;
+}
+
+/**
+ * @brief Decodes replay files on a pool of threads, at most `prefetch` frames ahead of the
+ *        replay position, and hands them out in order.
+ */
+class ReplayPrefetcher
+{
+public:
+    ReplayPrefetcher(const std::vector<fs::path> &files, int threads, int prefetch)
+        : files_(files), prefetch_(static_cast<size_t>(prefetch))
+    {
+        for (int t = 0; t < threads; ++t)
+        {
+            decoders_.emplace_back(&ReplayPrefetcher::decodeLoop, this);
+        }
+    }
+
+    ~ReplayPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        spaceCV_.notify_all();
+        for (std::thread &t : decoders_)
+        {
+            t.join();
+        }
+    }
+
+    /**
+     * @brief Waits until frame `position` is decoded and returns it (empty on decode failure).
+     *        Frames before `position` that were not taken (e.g. skipped for being late) are
+     *        discarded, and the decoders move past them.
+     */
+    cv::Mat take(size_t position)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        advanceTo(position);
+        readyCV_.wait(lock, [&] { return ready_.count(position) > 0; });
+        cv::Mat image = std::move(ready_[position]);
+        ready_.erase(position);
+        advanceTo(position + 1);
+        return image;
+    }
+
+    std::atomic<long long> files_decoded{0};   // Successfully or not.
+    std::atomic<long long> decode_failures{0};
+    std::atomic<long long> bytes_read{0};
+    std::atomic<long long> decode_ns{0};       // Inside cv::imread, all threads together.
+
+private:
+    // Must be called with mutex_ held.
+    void advanceTo(size_t position)
+    {
+        if (position <= consumed_)
+        {
+            return;
+        }
+        consumed_ = position;
+        ready_.erase(ready_.begin(), ready_.lower_bound(position));
+        if (next_ < consumed_)
+        {
+            next_ = consumed_; // Do not decode frames nobody will take.
+        }
+        spaceCV_.notify_all();
+    }
+
+    void decodeLoop()
+    {
+        while (true)
+        {
+            size_t position;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                spaceCV_.wait(lock, [&] { return stop_ || next_ >= files_.size() || next_ < consumed_ + prefetch_; });
+                if (stop_ || next_ >= files_.size())
+                {
+                    return;
+                }
+                position = next_++;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            cv::Mat image = cv::imread(files_[position].string(), cv::IMREAD_UNCHANGED);
+            decode_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            files_decoded++;
+            std::error_code ec;
+            bytes_read += static_cast<long long>(fs::file_size(files_[position], ec));
+            if (image.empty())
+            {
+                decode_failures++;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (position >= consumed_)
+                {
+                    ready_[position] = std::move(image);
+                }
+            }
+            readyCV_.notify_all();
+        }
+    }
+
+    const std::vector<fs::path> &files_;
+    size_t prefetch_;
+    std::vector<std::thread> decoders_;
+    std::mutex mutex_;
+    std::condition_variable readyCV_;  // Signalled when a frame has been decoded.
+    std::condition_variable spaceCV_;  // Signalled when the replay position advances.
+    std::map<size_t, cv::Mat> ready_;  // Decoded frames waiting to be taken, by position.
+    size_t next_ = 0;                  // Next position a decoder will claim.
+    size_t consumed_ = 0;              // Positions below this are no longer wanted.
+    bool stop_ = false;
+};
+
+ReplayGenerator::ReplayGenerator(const std::string &directory, int threads, int prefetch)
+    : files_(listReplayFiles(directory)), threads_(threads), prefetch_(prefetch)
+{
+}
+
+ReplayGenerator::~ReplayGenerator() = default;
+
+void ReplayGenerator::begin(std::chrono::steady_clock::time_point, const std::atomic<bool> &)
+{
+    prefetcher_ = std::make_unique<ReplayPrefetcher>(files_, threads_, prefetch_);
+}
+
+FrameGenerator::Result ReplayGenerator::generate(int index, ImageData &frame)
+{
+    if (static_cast<size_t>(index) >= files_.size())
+    {
+        return Result::Finished;
+    }
+    frame.image = prefetcher_->take(static_cast<size_t>(index));
+    return frame.image.empty() ? Result::Failed : Result::Frame;
+}
+
+long long ReplayGenerator::filesDecoded() const { return prefetcher_ ? prefetcher_->files_decoded.load() : 0; }
+long long ReplayGenerator::decodeFailures() const { return prefetcher_ ? prefetcher_->decode_failures.load() : 0; }
+long long ReplayGenerator::bytesRead() const { return prefetcher_ ? prefetcher_->bytes_read.load() : 0; }
+long long ReplayGenerator::decodeNs() const { return prefetcher_ ? prefetcher_->decode_ns.load() : 0; }
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>   // For std::atomic counters
+#include <chrono>   // For std::chrono::steady_clock
+#include <cstdint>  // For uint32_t, uint64_t
+#include <filesystem> // For std::filesystem::path (replay files)
+#include <memory>   // For std::unique_ptr
+#include <string>   // For std::string
+#include <vector>   // For std::vector
+#include <poll.h>   // For pollfd (socket ingest)
+#include "frame_generators.hpp" // FrameGenerator
+#include "shm_ring.hpp"         // ShmRingProducer, ShmRingConsumer
+
+/**
+ * @brief Generator for --shm-ring: generates every frame into the next slot of a shared-memory
+ *        ring it creates, and publishes it there, so the frames never reach the pipeline's sinks.
+ *
+ * With the "raw" extension the random pixels are written straight into the slot, so the frame
+ * is never copied. Other extensions are encoded on the producer thread and the encoded bytes
+ * are copied into the slot.
+ */
+class ShmRingGenerator : public FrameGenerator
+{
+public:
+    ShmRingGenerator(int width, int height, std::string extension)
+        : width_(width), height_(height), extension_(std::move(extension)) {}
+    ~ShmRingGenerator() override { ring_.close(); }
+
+    /**
+     * @brief Creates the ring `name` with `slots` slots, each large enough for one frame.
+     * @return false (with `error` set) if the ring could not be created.
+     */
+    bool open(const std::string &name, uint32_t slots, std::string &error);
+
+    /**
+     * @brief Marks the stream as finished for the consumers and removes the ring. The figures
+     *        of ring() are only available before.
+     */
+    void close() { ring_.close(); }
+
+    Result generate(int index, ImageData &frame) override;
+
+    const ShmRingProducer &ring() const { return ring_; }
+    long long bytesPublished() const { return bytes_published_; } // Raw pixels or encoded bytes.
+    int framesTooLarge() const { return frames_too_large_; }     // Encoded frames larger than a slot.
+
+private:
+    int width_;
+    int height_;
+    std::string extension_;
+    ShmRingProducer ring_;
+    long long bytes_published_ = 0;
+    int frames_too_large_ = 0;
+};
+
+/**
+ * @brief Frames recorded from an external producer (--ingest). Ingest is not paced: every
+ *        frame is pushed as it arrives, with the index it was sent with.
+ */
+class IngestGenerator : public FrameGenerator
+{
+public:
+    bool paced() const override { return false; }
+    void begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop) override;
+
+    long long bytesReceived() const { return bytes_received_; }
+
+    /**
+     * @brief Frames the producer sent that were never received (overwritten in a ring).
+     */
+    virtual long long framesLost() const { return 0; }
+
+protected:
+    bool runEnded() const; // The deadline passed or a stop was requested.
+
+    std::chrono::steady_clock::time_point end_time_ = std::chrono::steady_clock::time_point::max();
+    const std::atomic<bool> *stop_ = nullptr;
+    long long bytes_received_ = 0;
+};
+
+/**
+ * @brief Records frames from a shared-memory ring created by another process (--ingest shm:).
+ *        The producer may start later: begin() keeps trying to attach until the run ends.
+ */
+class ShmIngestGenerator : public IngestGenerator
+{
+public:
+    explicit ShmIngestGenerator(std::string name) : name_(std::move(name)) {}
+
+    void begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop) override;
+    Result generate(int index, ImageData &frame) override;
+    long long framesLost() const override;
+
+private:
+    std::string name_;
+    ShmRingConsumer ring_;
+    bool attached_ = false;
+};
+
+/**
+ * @brief Records frames that one or more producers send to a Unix stream socket with
+ *        frameSocketSend() (--ingest unix:). The source is finished once every producer that
+ *        connected has disconnected.
+ */
+class SocketIngestGenerator : public IngestGenerator
+{
+public:
+    explicit SocketIngestGenerator(std::string path) : path_(std::move(path)) {}
+    ~SocketIngestGenerator() override;
+
+    /**
+     * @brief Creates the listening socket (replacing a stale one at the same path).
+     * @return false (with `error` set) if it could not be created.
+     */
+    bool listen(std::string &error);
+
+    Result generate(int index, ImageData &frame) override;
+
+private:
+    bool readFully(int fd, void *buffer, size_t size) const;
+    bool readFrame(int fd, ImageData &frame);
+
+    std::string path_;
+    std::vector<pollfd> fds_;     // The listening socket, then one entry per connected producer.
+    std::vector<uint8_t> buffer_; // Reused receive buffer for frame payloads.
+    size_t next_producer_ = 1;    // Producers are read in turn, starting with this entry of fds_.
+    bool had_producer_ = false;
+};
+
+/**
+ * @brief Lists the images of a directory in playback order.
+ *
+ * Files are ordered by the number embedded in their name ("image_2" before "image_10"),
+ * falling back to the plain name when the numbers are equal or absent.
+ */
+std::vector<std::filesystem::path> listReplayFiles(const std::string &directory);
+
+class ReplayPrefetcher;
+
+/**
+ * @brief Re-streams the images of a directory (--replay), frame k being the k-th file of
+ *        listReplayFiles(). Decoding runs ahead on a pool of threads started by begin(), so
+ *        the savers can transcode the frames at the target FPS.
+ */
+class ReplayGenerator : public FrameGenerator
+{
+public:
+    /**
+     * @param threads Decoder threads.
+     * @param prefetch Maximum decoded frames kept ahead of the replay position.
+     */
+    ReplayGenerator(const std::string &directory, int threads, int prefetch);
+    ~ReplayGenerator() override;
+
+    void begin(std::chrono::steady_clock::time_point end_time, const std::atomic<bool> &stop) override;
+    Result generate(int index, ImageData &frame) override;
+    long long frameCount() const override { return static_cast<long long>(files_.size()); }
+
+    int threads() const { return threads_; }
+    // Figures of the decoder threads (zero before begin()).
+    long long filesDecoded() const;   // Successfully or not.
+    long long decodeFailures() const;
+    long long bytesRead() const;
+    long long decodeNs() const;       // Time inside cv::imread, all threads together.
+
+private:
+    std::vector<std::filesystem::path> files_;
+    int threads_;
+    int prefetch_;
+    std::unique_ptr<ReplayPrefetcher> prefetcher_;
+};
@@ -0,0 +1,337 @@
+#include "watermark.hpp"
+#include <algorithm> // For std::search, std::min
+#include <array>     // For std::array (CRC table)
+#include <cstdio>    // For std::snprintf, std::sscanf
+#include <cstring>   // For std::memcpy, std::memset, std::strlen
+#include <ctime>     // For clock_gettime
+#include <iterator>  // For std::distance, std::prev
+#include <sstream>   // For std::ostringstream (reports)
+
+static const int WATERMARK_BITS = 128;
+static const uchar WATERMARK_MAGIC[2] = {'V', 'F'};
+static const char WATERMARK_KEYWORD[] = "vfig-watermark"; // PNG tEXt keyword / JPEG comment prefix.
+
+int64_t watermarkNowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+int64_t watermarkTimeNs(int64_t monotonic_ns)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t monotonic_now = static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    return watermarkNowNs() - (monotonic_now - monotonic_ns);
+}
+
+/**
+ * @brief CRC-32 (the polynomial of PNG and zlib), table-driven.
+ */
+static uint32_t crc32Of(const uchar *data, size_t size, uint32_t crc = 0)
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief The 16 bytes of the barcode: magic, index and time (little-endian), then the low 16
+ *        bits of their CRC-32.
+ */
+static void packWatermark(const Watermark &mark, uchar bytes[16])
+{
+    bytes[0] = WATERMARK_MAGIC[0];
+    bytes[1] = WATERMARK_MAGIC[1];
+    uint32_t index = static_cast<uint32_t>(mark.index);
+    uint64_t time = static_cast<uint64_t>(mark.time_ns);
+    for (int k = 0; k < 4; ++k) bytes[2 + k] = static_cast<uchar>(index >> (8 * k));
+    for (int k = 0; k < 8; ++k) bytes[6 + k] = static_cast<uchar>(time >> (8 * k));
+    uint32_t crc = crc32Of(bytes, 14);
+    bytes[14] = static_cast<uchar>(crc);
+    bytes[15] = static_cast<uchar>(crc >> 8);
+}
+
+static bool unpackWatermark(const uchar bytes[16], Watermark &mark)
+{
+    uint32_t crc = crc32Of(bytes, 14);
+    if (bytes[0] != WATERMARK_MAGIC[0] || bytes[1] != WATERMARK_MAGIC[1] || bytes[14] != static_cast<uchar>(crc) ||
+        bytes[15] != static_cast<uchar>(crc >> 8))
+    {
+        return false;
+    }
+    uint32_t index = 0;
+    uint64_t time = 0;
+    for (int k = 0; k < 4; ++k) index |= static_cast<uint32_t>(bytes[2 + k]) << (8 * k);
+    for (int k = 0; k < 8; ++k) time |= static_cast<uint64_t>(bytes[6 + k]) << (8 * k);
+    mark.index = static_cast<int>(index);
+    mark.time_ns = static_cast<int64_t>(time);
+    return true;
+}
+
+/**
+ * @brief Side of a barcode cell for an image of `cols` x `rows`: the largest of 8, 4, 2 and 1
+ *        pixels whose strip fits in a quarter of the height (0 if none does). Writer and reader
+ *        derive it from the image size alone.
+ */
+static int cellSize(int cols, int rows)
+{
+    for (int cell : {8, 4, 2, 1})
+    {
+        int per_row = cols / cell;
+        if (per_row > 0 && (WATERMARK_BITS + per_row - 1) / per_row * cell * 4 <= rows)
+        {
+            return cell;
+        }
+    }
+    return 0;
+}
+
+bool stampWatermark(cv::Mat &image, const Watermark &mark)
+{
+    int cell = cellSize(image.cols, image.rows);
+    if (image.depth() != CV_8U || cell == 0)
+    {
+        return false;
+    }
+    uchar bytes[16];
+    packWatermark(mark, bytes);
+    int per_row = image.cols / cell;
+    size_t cell_bytes = static_cast<size_t>(cell) * image.channels();
+    for (int b = 0; b < WATERMARK_BITS; ++b)
+    {
+        uchar value = (bytes[b / 8] >> (b % 8)) & 1 ? 255 : 0;
+        int top = b / per_row * cell;
+        size_t left = static_cast<size_t>(b % per_row) * cell_bytes;
+        for (int y = 0; y < cell; ++y)
+        {
+            std::memset(image.ptr(top + y) + left, value, cell_bytes);
+        }
+    }
+    return true;
+}
+
+bool readWatermark(const cv::Mat &image, Watermark &mark)
+{
+    int cell = cellSize(image.cols, image.rows);
+    if (image.depth() != CV_8U || cell == 0)
+    {
+        return false;
+    }
+    int per_row = image.cols / cell;
+    int channels = image.channels();
+    int margin = cell >= 4 ? 1 : 0; // Lossy codecs blur cell edges; read the inside only.
+    uchar bytes[16] = {};
+    for (int b = 0; b < WATERMARK_BITS; ++b)
+    {
+        int top = b / per_row * cell;
+        int left = b % per_row * cell;
+        long long sum = 0;
+        int samples = 0;
+        for (int y = margin; y < cell - margin; ++y)
+        {
+            const uchar *row = image.ptr(top + y);
+            for (int x = (left + margin) * channels; x < (left + cell - margin) * channels; ++x)
+            {
+                sum += row[x];
+                samples++;
+            }
+        }
+        if (sum > 127LL * samples)
+        {
+            bytes[b / 8] |= static_cast<uchar>(1 << (b % 8));
+        }
+    }
+    return unpackWatermark(bytes, mark);
+}
+
+bool watermarkMetadataSupported(const std::string &extension)
+{
+    return extension == "png" || extension == "jpg" || extension == "jpeg";
+}
+
+/**
+ * @brief "vfig-watermark\0index=<i> ns=<t>;": a PNG tEXt payload (keyword, NUL, text), also
+ *        used as the JPEG comment. The ';' ends the number before whatever bytes follow.
+ */
+static std::vector<uchar> metadataText(const Watermark &mark)
+{
+    char text[64];
+    int length = std::snprintf(text, sizeof(text), "index=%d ns=%lld;", mark.index, static_cast<long long>(mark.time_ns));
+    std::vector<uchar> payload(WATERMARK_KEYWORD, WATERMARK_KEYWORD + sizeof(WATERMARK_KEYWORD)); // Includes the NUL.
+    payload.insert(payload.end(), text, text + length);
+    return payload;
+}
+
+bool addWatermarkMetadata(std::vector<uchar> &encoded, const Watermark &mark)
+{
+    static const uchar png_signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    std::vector<uchar> payload = metadataText(mark);
+    if (encoded.size() >= 33 && std::memcmp(encoded.data(), png_signature, 8) == 0 &&
+        std::memcmp(encoded.data() + 12, "IHDR", 4) == 0)
+    {
+        // Chunk: length (big-endian), type, data, CRC of type and data. IHDR must stay first.
+        std::vector<uchar> chunk = {0, 0, 0, 0, 't', 'E', 'X', 't'};
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        for (int k = 0; k < 4; ++k) chunk[k] = static_cast<uchar>(length >> (24 - 8 * k));
+        chunk.insert(chunk.end(), payload.begin(), payload.end());
+        uint32_t crc = crc32Of(chunk.data() + 4, chunk.size() - 4);
+        for (int k = 0; k < 4; ++k) chunk.push_back(static_cast<uchar>(crc >> (24 - 8 * k)));
+        encoded.insert(encoded.begin() + 33, chunk.begin(), chunk.end());
+        return true;
+    }
+    if (encoded.size() >= 2 && encoded[0] == 0xFF && encoded[1] == 0xD8)
+    {
+        // COM segment after SOI and the APPn segments that follow it: JFIF and Exif readers
+        // expect APP0/APP1 first. A segment's length counts itself but not the marker.
+        size_t position = 2;
+        while (position + 4 <= encoded.size() && encoded[position] == 0xFF && encoded[position + 1] >= 0xE0 &&
+               encoded[position + 1] <= 0xEF)
+        {
+            size_t app_length = (static_cast<size_t>(encoded[position + 2]) << 8) | encoded[position + 3];
+            if (app_length < 2 || position + 2 + app_length > encoded.size())
+            {
+                break; // Malformed: keep the comment before it.
+            }
+            position += 2 + app_length;
+        }
+        size_t length = payload.size() + 2;
+        std::vector<uchar> segment = {0xFF, 0xFE, static_cast<uchar>(length >> 8), static_cast<uchar>(length)};
+        segment.insert(segment.end(), payload.begin(), payload.end());
+        encoded.insert(encoded.begin() + position, segment.begin(), segment.end());
+        return true;
+    }
+    return false;
+}
+
+bool readWatermarkMetadata(const uchar *data, size_t size, Watermark &mark)
+{
+    // Both containers place it near the start of the file.
+    const uchar *end = data + std::min<size_t>(size, 65536);
+    const uchar *found = std::search(data, end, WATERMARK_KEYWORD, WATERMARK_KEYWORD + sizeof(WATERMARK_KEYWORD));
+    if (found == end)
+    {
+        return false;
+    }
+    const uchar *text = found + sizeof(WATERMARK_KEYWORD);
+    char buffer[64] = {};
+    std::memcpy(buffer, text, std::min<size_t>(sizeof(buffer) - 1, static_cast<size_t>(data + size - text)));
+    long long time = 0;
+    char terminator = 0;
+    if (std::sscanf(buffer, "index=%d ns=%lld%c", &mark.index, &time, &terminator) != 3 || terminator != ';')
+    {
+        return false;
+    }
+    mark.time_ns = time;
+    return true;
+}
+
+void WatermarkAudit::record(const Watermark &mark, int64_t consumed_ns, int level)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_++;
+    if (!seen_.insert({level, mark.index}).second)
+    {
+        duplicates_++;
+    }
+    auto highest = highest_.find(level);
+    if (highest == highest_.end())
+    {
+        highest_[level] = mark.index;
+    }
+    else if (mark.index < highest->second)
+    {
+        reordered_++;
+    }
+    else
+    {
+        highest->second = mark.index;
+    }
+    if (consumed_ns + tolerance_ns_ >= mark.time_ns)
+    {
+        latency_.record(std::max<int64_t>(0, consumed_ns - mark.time_ns));
+    }
+    else
+    {
+        clock_skew_++;
+    }
+}
+
+void WatermarkAudit::recordUnmarked()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    unmarked_++;
+}
+
+long long WatermarkAudit::frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_;
+}
+
+long long WatermarkAudit::duplicates() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return duplicates_;
+}
+
+long long WatermarkAudit::reordered() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reordered_;
+}
+
+long long WatermarkAudit::missing() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto first = seen_.lower_bound({0, INT32_MIN});
+    auto last = seen_.lower_bound({1, INT32_MIN});
+    if (first == last)
+    {
+        return 0;
+    }
+    long long distinct = static_cast<long long>(std::distance(first, last));
+    return static_cast<long long>(std::prev(last)->second) - first->second + 1 - distinct;
+}
+
+long long WatermarkAudit::unmarked() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return unmarked_;
+}
+
+std::string WatermarkAudit::report() const
+{
+    long long missing_frames = missing();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << "    Frames con marca: " << frames_ << ", sin marca legible: " << unmarked_ << "\n";
+    if (frames_ > 0)
+    {
+        out << "    Latencia hasta el consumo: " << latency_.summary() << "\n";
+        out << "    Duplicados: " << duplicates_ << ", fuera de orden: " << reordered_
+            << ", índices ausentes (nivel 0): " << missing_frames << "\n";
+    }
+    if (clock_skew_ > 0)
+    {
+        out << "    Consumidos antes de su marca de tiempo (relojes desincronizados): " << clock_skew_ << "\n";
+    }
+    return out.str();
+}
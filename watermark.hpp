@@ -0,0 +1,116 @@
+#pragma once
+
+// Per-frame watermarks for end-to-end auditing: the frame index and the time the frame entered
+// the pipeline travel with the frame itself, as a barcode strip in the top rows of the pixels
+// and/or as a text entry in the PNG or JPEG file, so a consumer can measure latency and detect
+// reordered or duplicated frames without any side channel.
+
+#include <cstdint>  // For int64_t
+#include <map>      // For std::map
+#include <mutex>    // For std::mutex
+#include <set>      // For std::set
+#include <string>   // For std::string
+#include <utility>  // For std::pair
+#include <vector>   // For std::vector
+#include <opencv2/core.hpp> // OpenCV core functionalities
+#include "live_stats.hpp"   // LatencyHistogram
+
+// What a watermark carries.
+struct Watermark
+{
+    int index = 0;       // Frame index.
+    int64_t time_ns = 0; // When the frame entered the pipeline, CLOCK_REALTIME nanoseconds.
+};
+
+/**
+ * @brief CLOCK_REALTIME nanoseconds, comparable across processes and with file times.
+ */
+int64_t watermarkNowNs();
+
+/**
+ * @brief Converts a liveStatsNowNs() time (CLOCK_MONOTONIC, e.g. ImageData::created_ns) to
+ *        CLOCK_REALTIME nanoseconds.
+ */
+int64_t watermarkTimeNs(int64_t monotonic_ns);
+
+/**
+ * @brief Writes `mark` as a barcode of 128 black and white cells into the top rows of an 8-bit
+ *        image (any number of channels). Cells are 8x8 pixels, aligned with JPEG blocks, or
+ *        smaller if the strip would take more than a quarter of the height.
+ * @return false if the image is not 8-bit or too small to hold the strip.
+ */
+bool stampWatermark(cv::Mat &image, const Watermark &mark);
+
+/**
+ * @brief Reads a barcode written by stampWatermark().
+ * @return false if the image has no valid barcode (wrong magic or checksum).
+ */
+bool readWatermark(const cv::Mat &image, Watermark &mark);
+
+/**
+ * @brief True for the extensions whose files can carry the watermark as metadata (png, jpg).
+ */
+bool watermarkMetadataSupported(const std::string &extension);
+
+/**
+ * @brief Adds `mark` to an encoded PNG (as a tEXt chunk after IHDR) or JPEG (as a COM segment
+ *        after SOI and any APPn segments) without re-encoding the pixels.
+ * @return false if `encoded` is neither a PNG nor a JPEG file.
+ */
+bool addWatermarkMetadata(std::vector<uchar> &encoded, const Watermark &mark);
+
+/**
+ * @brief Finds the metadata written by addWatermarkMetadata() in an encoded file.
+ */
+bool readWatermarkMetadata(const uchar *data, size_t size, Watermark &mark);
+
+/**
+ * @brief Checks a stream of watermarked frames as a consumer sees them: latency from entering
+ *        the pipeline to being consumed, frames seen more than once, frames that arrive after a
+ *        later one, and indices never seen. Thread-safe.
+ */
+class WatermarkAudit
+{
+public:
+    /**
+     * @brief Records a frame consumed at `consumed_ns` (CLOCK_REALTIME). Pyramid levels are
+     *        separate streams (`level`).
+     */
+    void record(const Watermark &mark, int64_t consumed_ns, int level = 0);
+
+    /**
+     * @brief Records a frame without a readable watermark.
+     */
+    void recordUnmarked();
+
+    /**
+     * @brief Consumption times up to `ns` before the watermark count as zero latency instead
+     *        of clock skew: file modification times come from the kernel's coarse clock, which
+     *        lags CLOCK_REALTIME by about a tick (more when ticks are deferred on idle CPUs).
+     */
+    void setTolerance(int64_t ns) { tolerance_ns_ = ns; }
+
+    long long frames() const;     // Watermarked frames recorded.
+    long long duplicates() const; // Frames whose index (and level) had already been seen.
+    long long reordered() const;  // Frames that arrived after a frame with a higher index.
+    long long missing() const;    // Indices between the lowest and highest seen that never arrived (level 0).
+    long long unmarked() const;
+    const LatencyHistogram &latency() const { return latency_; }
+
+    /**
+     * @brief Report lines, indented by four spaces.
+     */
+    std::string report() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::set<std::pair<int, int>> seen_; // (level, index)
+    std::map<int, int> highest_;         // Highest index seen per level.
+    long long frames_ = 0;
+    long long duplicates_ = 0;
+    long long reordered_ = 0;
+    long long unmarked_ = 0;
+    long long clock_skew_ = 0; // Frames consumed "before" their timestamp (clocks of different hosts).
+    int64_t tolerance_ns_ = 0;
+    LatencyHistogram latency_;
+};
@@ -0,0 +1,123 @@
+#include "yuv420.hpp"
+
+#include <cstdint>   // For fixed-width integer types
+#include <cstring>   // For std::memcpy
+#include <stdexcept> // For std::invalid_argument
+#include <opencv2/imgproc.hpp> // OpenCV image processing (cvtColor)
+
+namespace
+{
+
+// Coefficients scaled by 256. Chroma works on the sum of a 2x2 block (4x the average), so it
+// is scaled by 1024; the +128 offset is folded into the constant so the sum is never negative.
+// The luma sum stays below 65536, so it is computed in 16 bits: twice as many lanes per vector.
+inline uint8_t luma(uint16_t b, uint16_t g, uint16_t r)
+{
+    return static_cast<uint8_t>((static_cast<uint16_t>(66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t chromaU(int b4, int g4, int r4)
+{
+    return static_cast<uint8_t>((-38 * r4 - 74 * g4 + 112 * b4 + (128 << 10) + 512) >> 10);
+}
+
+inline uint8_t chromaV(int b4, int g4, int r4)
+{
+    return static_cast<uint8_t>((112 * r4 - 94 * g4 - 18 * b4 + (128 << 10) + 512) >> 10);
+}
+
+void checkInput(const cv::Mat &bgr)
+{
+    if (bgr.type() != CV_8UC3 || bgr.cols % 2 != 0 || bgr.rows % 2 != 0)
+    {
+        throw std::invalid_argument("la conversión a YUV 4:2:0 requiere BGR de 8 bits con ancho y alto pares");
+    }
+}
+
+} // namespace
+
+void bgrToYuv420(const cv::Mat &bgr, cv::Mat &dst, Yuv420Layout layout)
+{
+    checkInput(bgr);
+    const int width = bgr.cols;
+    const int height = bgr.rows;
+    if (!dst.isContinuous())
+    {
+        dst.release(); // The chroma planes are addressed as one contiguous block.
+    }
+    dst.create(height * 3 / 2, width, CV_8UC1);
+    uint8_t *chroma = dst.ptr(height);
+    const int chroma_width = width / 2;
+
+    for (int y = 0; y < height; y += 2)
+    {
+        const uint8_t *__restrict s0 = bgr.ptr(y);
+        const uint8_t *__restrict s1 = bgr.ptr(y + 1);
+        uint8_t *__restrict y0 = dst.ptr(y);
+        uint8_t *__restrict y1 = dst.ptr(y + 1);
+
+        // Luma: one independent output per pixel, which vectorizes well.
+        for (int x = 0; x < width; ++x)
+        {
+            y0[x] = luma(s0[3 * x], s0[3 * x + 1], s0[3 * x + 2]);
+        }
+        for (int x = 0; x < width; ++x)
+        {
+            y1[x] = luma(s1[3 * x], s1[3 * x + 1], s1[3 * x + 2]);
+        }
+
+        // Chroma: one sample per 2x2 block, while both rows are still in cache. The two layouts
+        // have separate loops so each has a constant output stride.
+        if (layout == Yuv420Layout::NV12)
+        {
+            uint8_t *__restrict uv = chroma + (y / 2) * width;
+            for (int c = 0; c < chroma_width; ++c)
+            {
+                int b4 = s0[6 * c] + s0[6 * c + 3] + s1[6 * c] + s1[6 * c + 3];
+                int g4 = s0[6 * c + 1] + s0[6 * c + 4] + s1[6 * c + 1] + s1[6 * c + 4];
+                int r4 = s0[6 * c + 2] + s0[6 * c + 5] + s1[6 * c + 2] + s1[6 * c + 5];
+                uv[2 * c] = chromaU(b4, g4, r4);
+                uv[2 * c + 1] = chromaV(b4, g4, r4);
+            }
+        }
+        else
+        {
+            uint8_t *__restrict u = chroma + (y / 2) * chroma_width;
+            uint8_t *__restrict v = chroma + (height / 2) * chroma_width + (y / 2) * chroma_width;
+            for (int c = 0; c < chroma_width; ++c)
+            {
+                int b4 = s0[6 * c] + s0[6 * c + 3] + s1[6 * c] + s1[6 * c + 3];
+                int g4 = s0[6 * c + 1] + s0[6 * c + 4] + s1[6 * c + 1] + s1[6 * c + 4];
+                int r4 = s0[6 * c + 2] + s0[6 * c + 5] + s1[6 * c + 2] + s1[6 * c + 5];
+                u[c] = chromaU(b4, g4, r4);
+                v[c] = chromaV(b4, g4, r4);
+            }
+        }
+    }
+}
+
+void bgrToYuv420OpenCV(const cv::Mat &bgr, cv::Mat &dst, Yuv420Layout layout)
+{
+    checkInput(bgr);
+    if (layout == Yuv420Layout::I420)
+    {
+        cv::cvtColor(bgr, dst, cv::COLOR_BGR2YUV_I420);
+        return;
+    }
+    // OpenCV has no BGR to NV12 code: convert to I420 and interleave the chroma planes.
+    thread_local cv::Mat i420;
+    cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+    const int width = bgr.cols;
+    const int height = bgr.rows;
+    const int chroma_size = (width / 2) * (height / 2);
+    dst.create(height * 3 / 2, width, CV_8UC1);
+    std::memcpy(dst.data, i420.data, static_cast<size_t>(width) * height);
+    const uint8_t *u = i420.ptr(height);
+    const uint8_t *v = u + chroma_size;
+    uint8_t *uv = dst.ptr(height);
+    for (int c = 0; c < chroma_size; ++c)
+    {
+        uv[2 * c] = u[c];
+        uv[2 * c + 1] = v[c];
+    }
+}
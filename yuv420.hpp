@@ -0,0 +1,31 @@
+#pragma once
+
+// BGR to YUV 4:2:0 conversion for consumers that expect encoder-style input.
+//
+// BT.601 limited range, the same colorimetry as cv::COLOR_BGR2YUV_I420 (results differ by at
+// most a level or two because of rounding). The output is a single-channel
+// (height * 3 / 2) x width matrix: the Y plane followed by interleaved UV samples (NV12) or by
+// the U plane and then the V plane (I420). Each chroma sample is the average of a 2x2 block.
+
+#include <opencv2/core.hpp> // OpenCV core functionalities
+
+enum class Yuv420Layout
+{
+    NV12, // Y plane, then one plane of interleaved U,V pairs.
+    I420  // Y plane, then the U plane, then the V plane.
+};
+
+/**
+ * @brief Converts a CV_8UC3 BGR image with even width and height to YUV 4:2:0.
+ *
+ * Fixed-point arithmetic in plain loops that the compiler auto-vectorizes (see the flags for
+ * yuv420.cpp in CMakeLists.txt). `dst` is only reallocated if it does not already have the
+ * output size and type. Throws std::invalid_argument for other inputs.
+ */
+void bgrToYuv420(const cv::Mat &bgr, cv::Mat &dst, Yuv420Layout layout);
+
+/**
+ * @brief Same conversion through cv::cvtColor (COLOR_BGR2YUV_I420, plus a U/V interleave for
+ *        NV12). Reference for the benchmark and the ":cv" processing operators.
+ */
+void bgrToYuv420OpenCV(const cv::Mat &bgr, cv::Mat &dst, Yuv420Layout layout);